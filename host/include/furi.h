@@ -0,0 +1,58 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#define UNUSED(x) (void)(x)
+#define furi_assert(x) ((void)(x))
+#define furi_check(x) ((void)(x))
+#define COUNT_OF(x) (sizeof(x) / sizeof(x[0]))
+void sim_log(char level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+#define FURI_LOG_I(tag, ...) sim_log('I', tag, __VA_ARGS__)
+#define FURI_LOG_D(tag, ...) sim_log('D', tag, __VA_ARGS__)
+#define FURI_LOG_W(tag, ...) sim_log('W', tag, __VA_ARGS__)
+#define FURI_LOG_E(tag, ...) sim_log('E', tag, __VA_ARGS__)
+#define RECORD_GUI "gui"
+#define RECORD_STORAGE "storage"
+void* furi_record_open(const char* name);
+void furi_record_close(const char* name);
+uint32_t furi_get_tick(void);
+void furi_delay_ms(uint32_t ms);
+uint32_t furi_ms_to_ticks(uint32_t ms);
+typedef enum { FuriStatusOk = 0, FuriStatusError = -1, FuriStatusErrorTimeout = -2 } FuriStatus;
+#define FuriWaitForever 0xFFFFFFFFU
+typedef enum { FuriFlagWaitAny = 0, FuriFlagWaitAll = 1, FuriFlagNoClear = 2 } FuriFlag;
+#define FuriFlagError 0x80000000U
+typedef struct FuriThread FuriThread;
+typedef void* FuriThreadId;
+typedef int32_t (*FuriThreadCallback)(void* context);
+typedef enum { FuriThreadPriorityNone = 0, FuriThreadPriorityIdle, FuriThreadPriorityLowest, FuriThreadPriorityLow, FuriThreadPriorityNormal, FuriThreadPriorityHigh, FuriThreadPriorityHighest, FuriThreadPriorityIsr } FuriThreadPriority;
+FuriThread* furi_thread_alloc_ex(const char* name, uint32_t stack_size, FuriThreadCallback callback, void* context);
+void furi_thread_free(FuriThread* thread);
+void furi_thread_start(FuriThread* thread);
+bool furi_thread_join(FuriThread* thread);
+FuriThreadId furi_thread_get_id(FuriThread* thread);
+FuriThreadId furi_thread_get_current_id(void);
+void furi_thread_set_priority(FuriThread* thread, FuriThreadPriority priority);
+void furi_thread_set_current_priority(FuriThreadPriority priority);
+uint32_t furi_thread_get_stack_space(FuriThreadId thread_id);
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags);
+uint32_t furi_thread_flags_wait(uint32_t flags, uint32_t options, uint32_t timeout);
+uint32_t furi_thread_flags_get(void);
+uint32_t furi_thread_flags_clear(uint32_t flags);
+typedef struct FuriMutex FuriMutex;
+typedef enum { FuriMutexTypeNormal, FuriMutexTypeRecursive } FuriMutexType;
+FuriMutex* furi_mutex_alloc(FuriMutexType type);
+void furi_mutex_free(FuriMutex* mutex);
+FuriStatus furi_mutex_acquire(FuriMutex* mutex, uint32_t timeout);
+FuriStatus furi_mutex_release(FuriMutex* mutex);
+size_t memmgr_get_free_heap(void);
+size_t memmgr_get_minimum_free_heap(void);
+size_t memmgr_heap_get_max_free_block(void);
+typedef struct FuriString FuriString;
@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <furi.h>
+typedef struct { uint8_t hour, minute, second, day, month; uint16_t year; uint8_t weekday; } DateTime;
+void furi_hal_rtc_get_datetime(DateTime* datetime);
+uint32_t furi_hal_rtc_get_timestamp(void);
+uint32_t furi_hal_random_get(void);
+uint32_t furi_hal_cortex_instructions_per_microsecond(void);
+typedef struct { uint32_t start; uint32_t value; } FuriHalCortexTimer;
+FuriHalCortexTimer furi_hal_cortex_timer_get(uint32_t timeout_us);
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/canvas.h>
+void elements_button_left(Canvas* canvas, const char* str);
+void elements_button_right(Canvas* canvas, const char* str);
+void elements_button_center(Canvas* canvas, const char* str);
+void elements_progress_bar(Canvas* canvas, int32_t x, int32_t y, size_t width, float progress);
+void elements_multiline_text_aligned(Canvas* canvas, int32_t x, int32_t y, Align horizontal, Align vertical, const char* text);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/canvas.h>
+#include <gui/view.h>
+typedef struct Gui Gui;
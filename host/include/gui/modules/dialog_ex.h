@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/view.h>
+typedef struct DialogEx DialogEx;
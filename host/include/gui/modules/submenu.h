@@ -0,0 +1,14 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/view.h>
+typedef struct Submenu Submenu;
+typedef void (*SubmenuItemCallback)(void* context, uint32_t index);
+Submenu* submenu_alloc(void);
+void submenu_free(Submenu* submenu);
+View* submenu_get_view(Submenu* submenu);
+void submenu_add_item(Submenu* submenu, const char* label, uint32_t index, SubmenuItemCallback callback, void* callback_context);
+void submenu_reset(Submenu* submenu);
+void submenu_set_selected_item(Submenu* submenu, uint32_t index);
+void submenu_set_header(Submenu* submenu, const char* header);
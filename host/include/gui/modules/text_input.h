@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/view.h>
+typedef struct TextInput TextInput;
+typedef void (*TextInputCallback)(void* context);
+TextInput* text_input_alloc(void);
+void text_input_free(TextInput* text_input);
+void text_input_reset(TextInput* text_input);
+View* text_input_get_view(TextInput* text_input);
+void text_input_set_result_callback(TextInput* text_input, TextInputCallback callback, void* callback_context, char* text_buffer, size_t text_buffer_size, bool clear_default_text);
+void text_input_set_header_text(TextInput* text_input, const char* text);
@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <gui/view.h>
+typedef struct Widget Widget;
+typedef enum { GuiButtonTypeLeft, GuiButtonTypeCenter, GuiButtonTypeRight } GuiButtonType;
+typedef void (*ButtonCallback)(GuiButtonType result, InputType type, void* context);
+Widget* widget_alloc(void);
+void widget_free(Widget* widget);
+void widget_reset(Widget* widget);
+View* widget_get_view(Widget* widget);
+void widget_add_string_element(Widget* widget, uint8_t x, uint8_t y, Align horizontal, Align vertical, Font font, const char* text);
+void widget_add_string_multiline_element(Widget* widget, uint8_t x, uint8_t y, Align horizontal, Align vertical, Font font, const char* text);
+void widget_add_text_box_element(Widget* widget, uint8_t x, uint8_t y, uint8_t width, uint8_t height, Align horizontal, Align vertical, const char* text, bool strip_to_dots);
+void widget_add_text_scroll_element(Widget* widget, uint8_t x, uint8_t y, uint8_t width, uint8_t height, const char* text);
+void widget_add_button_element(Widget* widget, GuiButtonType button_type, const char* text, ButtonCallback callback, void* context);
+void widget_add_frame_element(Widget* widget, uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t radius);
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in for the firmware API of the same name, used by the host simulator
+
+#include <furi.h>
+typedef enum { InputKeyUp, InputKeyDown, InputKeyRight, InputKeyLeft, InputKeyOk, InputKeyBack, InputKeyMAX } InputKey;
+typedef enum { InputTypePress, InputTypeRelease, InputTypeShort, InputTypeLong, InputTypeRepeat, InputTypeMAX } InputType;
+typedef struct { uint32_t sequence; InputKey key; InputType type; } InputEvent;
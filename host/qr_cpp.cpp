@@ -0,0 +1,105 @@
+// Check of the C++ front end in qrcode.hpp: its constexpr sizes and capacities must
+// equal what the C library reports for every version and ECC level, and symbols of
+// several versions, encoded side by side in one binary, must decode to their payload.
+//
+//   qr_cpp [-n iterations]
+//
+// Exits non-zero on the first mismatch.
+
+#include "qrcode.hpp"
+#include "qrdecode.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+static_assert(qr::Symbol<1>::size == 21);
+static_assert(qr::Symbol<40, qr::Ecc::High>::size == 177);
+static_assert(qr::dataCapacity(1, qr::Ecc::Low) == 19);
+static_assert(qr::maxLength(40, qr::Ecc::Low, qr::Mode::Numeric) == 7089);
+static_assert(sizeof(qr::Symbol<6>().modules()) == qr::bufferSize(6));
+
+static bool cpp_check_sizes() {
+    for (uint8_t version = 1; version <= 40; version++) {
+        if (qr::bufferSize(version) != qrcode_getBufferSize(version)) {
+            std::fprintf(stderr, "version %u: buffer size %u, C says %u\n", version, qr::bufferSize(version), qrcode_getBufferSize(version));
+            return false;
+        }
+        for (uint8_t ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            qr::Ecc level = static_cast<qr::Ecc>(ecc);
+            if (qr::dataCapacity(version, level) != qrcode_getDataCapacity(version, ecc) ||
+                qr::dataCapacity(version, level) != qrdecode_getDataCapacity(version, ecc) ||
+                qr::workspaceSize(version, level) != qrcode_getWorkspaceSize(version, ecc)) {
+                std::fprintf(stderr, "version %u ecc %u: capacity or workspace size differs from the C library\n", version, ecc);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Symbol>
+static bool cpp_check_symbol(Symbol &symbol, std::string_view payload) {
+    static uint8_t decoded[qr::maxLength(40, qr::Ecc::Low, qr::Mode::Numeric)];
+
+    if (!symbol.encode(payload)) {
+        std::fprintf(stderr, "version %u: encode of %zu bytes failed\n", Symbol::version, payload.size());
+        return false;
+    }
+
+    // A copy must stand on its own
+    Symbol copy = symbol;
+    symbol.encode(std::string_view("overwritten"));
+
+    QRDecodeInfo info;
+    int8_t result = qrdecode_decode(&copy.code(), decoded, sizeof(decoded), &info);
+    if (result != QRDECODE_OK || info.version != Symbol::version || info.ecc != static_cast<uint8_t>(Symbol::ecc) ||
+        info.length != payload.size() || std::memcmp(decoded, payload.data(), payload.size()) != 0) {
+        std::fprintf(stderr, "version %u: decode failed (%d)\n", Symbol::version, result);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 4;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = std::strtoul(argv[++i], nullptr, 0);
+        } else {
+            std::fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!cpp_check_sizes()) { return 1; }
+
+    qr::Symbol<3> small;
+    qr::Symbol<6, qr::Ecc::Medium> medium;
+    qr::Symbol<10, qr::Ecc::High> large;
+    qr::Symbol<40> huge;
+
+    char payload[qr::maxLength(40, qr::Ecc::Low, qr::Mode::Byte)];
+    uint32_t symbols = 0;
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        int length = std::snprintf(payload, sizeof(payload), "upi://pay?pa=shop%lu@okaxis&pn=SHOP+%lu&cu=INR", (unsigned long)iteration, (unsigned long)iteration);
+        std::string_view text(payload, length);
+        if (!cpp_check_symbol(small, text) || !cpp_check_symbol(medium, text) || !cpp_check_symbol(large, text)) { return 1; }
+
+        // Fill the largest symbol to its byte capacity
+        std::memset(payload + length, 'A' + iteration % 26, sizeof(payload) - length);
+        if (!cpp_check_symbol(huge, std::string_view(payload, sizeof(payload)))) { return 1; }
+        symbols += 4;
+    }
+
+    // One byte past capacity must fail rather than overflow
+    static uint8_t over[qr::Symbol<3>::maxLength(qr::Mode::Byte) + 1];
+    if (small.encode(over, sizeof(over), qr::Mode::Byte) || small.valid()) {
+        std::fprintf(stderr, "version 3: encoded past capacity\n");
+        return 1;
+    }
+
+    std::printf("%lu symbols through qr::Symbol, sizes match for 160 version/ECC pairs\n", (unsigned long)symbols);
+    return 0;
+}
@@ -0,0 +1,697 @@
+// Round-trip check of the encoder: encodes payloads in every mode at every version
+// and ECC level, decodes them again with qrdecode, from the module grid and from a
+// rasterized bitmap, and compares; the rectangles drawn for vector output must cover
+// the grid exactly. Mixed payloads also hold the segmenter to the capacity limits
+// and, split in two, exercise the prefix-parity path; edited a few characters at a
+// time, incremental encodes must match full ones. Built once with the default
+// kernels, once with QR_VECTOR_RS, the batch encoder and the thread pool, and on
+// x86 CPUs that have it once more with -mssse3 for the PSHUFB kernel, so optimized
+// paths are held to the same bar; the summary line names the RS kernel built in.
+// Built with QR_PROFILE, it also checks that each encode picked the mask its recorded
+// penalties favour and prints the time spent per stage and per mask.
+//
+//   qr_roundtrip [-n iterations] [-s seed]
+//
+// Exits non-zero on the first symbol that does not decode to its payload.
+
+#include "qrcode.h"
+#include "qrdecode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDTRIP_MAX_PAYLOAD 7089
+#define ROUNDTRIP_MAX_SIZE 177
+
+// The table lookup qrcode.c's vectorized RS kernel compiles to on this target
+#if !QR_VECTOR_RS
+#define ROUNDTRIP_RS_KERNEL ""
+#elif defined(__SSSE3__)
+#define ROUNDTRIP_RS_KERNEL " PSHUFB"
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define ROUNDTRIP_RS_KERNEL " TBL"
+#else
+#define ROUNDTRIP_RS_KERNEL " scalar"
+#endif
+
+static const char roundtrip_alphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+static uint8_t roundtrip_count_bits(uint8_t version, uint8_t mode) {
+    static const uint8_t bits[3][3] = {{10, 12, 14}, {9, 11, 13}, {8, 16, 16}};
+    return bits[mode][version <= 9 ? 0 : version <= 26 ? 1 : 2];
+}
+
+// Longest payload of the mode that fits the version at the ECC level
+static uint16_t roundtrip_max_length(uint8_t version, uint8_t ecc, uint8_t mode) {
+    uint32_t bits = qrdecode_getDataCapacity(version, ecc) * 8 - 4 - roundtrip_count_bits(version, mode);
+    uint32_t length;
+    switch(mode) {
+    case MODE_NUMERIC:
+        length = bits / 10 * 3 + (bits % 10 >= 7 ? 2 : bits % 10 >= 4 ? 1 : 0);
+        break;
+    case MODE_ALPHANUMERIC:
+        length = bits / 11 * 2 + (bits % 11 >= 6 ? 1 : 0);
+        break;
+    default:
+        length = bits / 8;
+        break;
+    }
+
+    uint32_t limit = (1u << roundtrip_count_bits(version, mode)) - 1;
+    return length < limit ? length : limit;
+}
+
+static void roundtrip_fill(uint8_t* payload, uint16_t length, uint8_t mode) {
+    for(uint16_t i = 0; i < length; i++) {
+        switch(mode) {
+        case MODE_NUMERIC:
+            payload[i] = '0' + rand() % 10;
+            break;
+        case MODE_ALPHANUMERIC:
+            payload[i] = roundtrip_alphanumeric[rand() % 45];
+            break;
+        default:
+            payload[i] = rand() & 0xFF;
+            break;
+        }
+    }
+}
+
+static bool roundtrip_compare(
+    const char* what,
+    const QRCode* qrcode,
+    int8_t result,
+    const QRDecodeInfo* info,
+    const uint8_t* payload,
+    uint16_t length,
+    const uint8_t* decoded) {
+    if(result == QRDECODE_OK && info->version == qrcode->version && info->ecc == qrcode->ecc &&
+       info->mask == qrcode->mask && info->mode == qrcode->mode && info->length == length &&
+       memcmp(decoded, payload, length) == 0) {
+        return true;
+    }
+
+    fprintf(
+        stderr,
+        "%s: version %u ecc %u mode %u length %u: decode %d (version %u ecc %u mask %u/%u length %u)\n",
+        what,
+        qrcode->version,
+        qrcode->ecc,
+        qrcode->mode,
+        length,
+        result,
+        info->version,
+        info->ecc,
+        info->mask,
+        qrcode->mask,
+        info->length);
+    return false;
+}
+
+// Rasterizes at a random scale, quiet zone, offset and bit order and decodes the bitmap
+static bool roundtrip_check_raster(
+    QRCode* qrcode,
+    const uint8_t* payload,
+    uint16_t length,
+    uint8_t* decoded) {
+    static uint8_t bitmap[(ROUNDTRIP_MAX_SIZE + 8) * 4 + 8][((ROUNDTRIP_MAX_SIZE + 8) * 4 + 8) / 8 + 1];
+
+    QRRaster raster = {
+        .buffer = &bitmap[0][0],
+        .stride = sizeof(bitmap[0]),
+        .x = rand() % 8,
+        .y = rand() % 8,
+        .scale = 1 + rand() % 4,
+        .quietZone = rand() % 5,
+        .bitOrder = rand() % 2 ? QR_RASTER_XBM : QR_RASTER_MSB,
+    };
+    uint16_t raster_size = qrcode_getRasterSize(qrcode, raster.scale, raster.quietZone);
+
+    // Scale 0 is an empty raster, not a division by zero
+    QRRaster empty = raster;
+    empty.scale = 0;
+    memset(bitmap, 0, sizeof(bitmap));
+    qrcode_rasterize(qrcode, &empty);
+    qrcode_rasterizeRow(qrcode, &bitmap[0][0], 0, 0, raster.quietZone, raster.bitOrder);
+    bool written = qrcode_getRasterSize(qrcode, 0, raster.quietZone) != 0;
+    for(size_t i = 0; i < sizeof(bitmap); i++) {
+        written = written || (&bitmap[0][0])[i] != 0;
+    }
+    if(written) {
+        fprintf(stderr, "bitmap: version %u: scale 0 wrote pixels\n", qrcode->version);
+        return false;
+    }
+    
+    qrcode_rasterize(qrcode, &raster);
+
+    QRDecodeInfo info;
+    int8_t result = qrdecode_decodeBitmap(
+        &bitmap[0][0],
+        raster.x + raster_size,
+        raster.y + raster_size,
+        sizeof(bitmap[0]),
+        raster.bitOrder,
+        decoded,
+        ROUNDTRIP_MAX_PAYLOAD,
+        &info);
+    return roundtrip_compare("bitmap", qrcode, result, &info, payload, length, decoded);
+}
+
+static void roundtrip_paint_rect(void* context, const QRRect* rect) {
+    uint8_t* coverage = context;
+    for(uint8_t y = rect->y; y < rect->y + rect->height; y++) {
+        for(uint8_t x = rect->x; x < rect->x + rect->width; x++) {
+            coverage[y * ROUNDTRIP_MAX_SIZE + x]++;
+        }
+    }
+}
+
+// The rectangles of qrcode_getRects, runs and merged, must cover every dark module
+// once and no light one, merging must not add any, and every run must be counted
+static bool roundtrip_check_rects(QRCode* qrcode) {
+    static uint8_t coverage[ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE];
+    uint16_t counts[2];
+    
+    for(uint8_t merge = 0; merge < 2; merge++) {
+        memset(coverage, 0, sizeof(coverage));
+        counts[merge] = qrcode_getRects(qrcode, merge, roundtrip_paint_rect, coverage);
+        
+        for(uint8_t y = 0; y < qrcode->size; y++) {
+            for(uint8_t x = 0; x < qrcode->size; x++) {
+                if(coverage[y * ROUNDTRIP_MAX_SIZE + x] != qrcode_getModule(qrcode, x, y)) {
+                    fprintf(
+                        stderr,
+                        "rects: version %u merge %u: module (%u, %u) covered %u times\n",
+                        qrcode->version,
+                        merge,
+                        x,
+                        y,
+                        coverage[y * ROUNDTRIP_MAX_SIZE + x]);
+                    return false;
+                }
+            }
+        }
+    }
+    
+    if(counts[1] > counts[0]) {
+        fprintf(stderr, "rects: version %u: %u merged, %u runs\n", qrcode->version, counts[1], counts[0]);
+        return false;
+    }
+    return true;
+}
+
+// Random runs of digits, alphanumerics and bytes, so MODE_MIXED has to switch
+static void roundtrip_fill_mixed(uint8_t* payload, uint16_t length) {
+    for(uint16_t i = 0; i < length;) {
+        uint8_t mode = rand() % 3;
+        uint16_t run = 1 + rand() % 24;
+        if(run > length - i) run = length - i;
+        roundtrip_fill(payload + i, run, mode);
+        i += run;
+    }
+}
+
+// A mixed payload as long as the version holds (or shorter) must encode at the
+// version qrcode_getMinVersion picks, fail one version below and decode intact
+static bool roundtrip_check_mixed(
+    uint8_t version,
+    uint8_t ecc,
+    bool fill,
+    uint8_t* payload,
+    uint8_t* modules,
+    uint8_t* decoded) {
+    uint32_t capacity = qrcode_getDataCapacity(version, ecc) * 8;
+    uint16_t high = ROUNDTRIP_MAX_PAYLOAD;
+    roundtrip_fill_mixed(payload, high);
+    
+    // Longest prefix that fits, by bisection
+    uint16_t low = 0;
+    while(low < high) {
+        uint16_t middle = (low + high + 1) / 2;
+        if(qrcode_getBitLength(MODE_MIXED, version, payload, middle) <= capacity) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    uint16_t length = fill ? low : rand() % (low + 1);
+    
+    QRCode qrcode;
+    uint8_t min_version = qrcode_getMinVersion(MODE_MIXED, ecc, payload, length, 40);
+    if(min_version == 0 || min_version > version ||
+       qrcode_initBytes(&qrcode, modules, MODE_MIXED, min_version, ecc, payload, length) != 0) {
+        fprintf(
+            stderr,
+            "mixed: version %u ecc %u length %u: encode failed at version %u\n",
+            version,
+            ecc,
+            length,
+            min_version);
+        return false;
+    }
+    
+    QRCode smaller;
+    if((min_version > 1 &&
+        qrcode_initBytes(&smaller, modules, MODE_MIXED, min_version - 1, ecc, payload, length) == 0) ||
+       (fill && low < ROUNDTRIP_MAX_PAYLOAD &&
+        qrcode_initBytes(&smaller, modules, MODE_MIXED, version, ecc, payload, low + 1) == 0)) {
+        fprintf(stderr, "mixed: version %u ecc %u length %u: encoded past capacity\n", version, ecc, length);
+        return false;
+    }
+    
+    // The capacity checks above reused the module buffer
+    qrcode_initBytes(&qrcode, modules, MODE_MIXED, min_version, ecc, payload, length);
+    QRDecodeInfo info;
+    int8_t result = qrdecode_decode(&qrcode, decoded, ROUNDTRIP_MAX_PAYLOAD, &info);
+    if(result != QRDECODE_OK || info.length != length || memcmp(decoded, payload, length) != 0) {
+        fprintf(
+            stderr,
+            "mixed: version %u ecc %u length %u: decode %d (length %u, %u segments)\n",
+            min_version,
+            ecc,
+            length,
+            result,
+            info.length,
+            info.segments);
+        return false;
+    }
+    
+    return true;
+}
+
+// A mixed payload split at a random point must encode as prefix and tail, with only
+// the tail through Reed-Solomon, exactly when both segmented apart fit the version,
+// and decode intact; the decoder's syndrome check vouches for the combined parity
+static bool roundtrip_check_prefix(uint8_t version, uint8_t ecc, uint8_t* payload, uint8_t* modules, uint8_t* decoded) {
+    uint32_t capacity = qrcode_getDataCapacity(version, ecc) * 8;
+    uint16_t length = rand() % (roundtrip_max_length(version, ecc, MODE_BYTE) + 1);
+    uint16_t split = rand() % (length + 1);
+    roundtrip_fill_mixed(payload, length);
+    
+    uint32_t prefix_bits = split > 0 ? qrcode_getBitLength(MODE_MIXED, version, payload, split) : 0;
+    uint32_t tail_bits = (split < length || split == 0) ?
+                             qrcode_getBitLength(MODE_MIXED, version, payload + split, length - split) :
+                             0;
+    bool fits = prefix_bits + tail_bits <= capacity;
+    
+    uint8_t* workspace = malloc(qrcode_getWorkspaceSize(version, ecc));
+    uint8_t* cache = malloc(qrcode_getPrefixCacheSize(version, ecc));
+    QRPrefix prefix;
+    QRCode qrcode;
+    bool encoded = qrcode_initPrefix(&prefix, cache, version, ecc, payload, split, workspace) == 0 &&
+                   qrcode_initBytesPrefixed(&qrcode, modules, &prefix, payload + split, length - split, workspace) == 0;
+    
+    bool ok = encoded == fits;
+    if(!ok) {
+        fprintf(
+            stderr,
+            "prefix: version %u ecc %u length %u split %u: %s\n",
+            version,
+            ecc,
+            length,
+            split,
+            fits ? "encode failed" : "encoded past capacity");
+    } else if(encoded) {
+        QRDecodeInfo info;
+        int8_t result = qrdecode_decode(&qrcode, decoded, ROUNDTRIP_MAX_PAYLOAD, &info);
+        ok = result == QRDECODE_OK && info.length == length && memcmp(decoded, payload, length) == 0;
+        if(!ok) {
+            fprintf(
+                stderr,
+                "prefix: version %u ecc %u length %u split %u: decode %d (length %u, %u segments)\n",
+                version,
+                ecc,
+                length,
+                split,
+                result,
+                info.length,
+                info.segments);
+        }
+    }
+    
+    // Placed over the symbol of another tail, as the amount scene does, it must come
+    // out the same
+    if(ok && encoded) {
+        static uint8_t tail[ROUNDTRIP_MAX_PAYLOAD];
+        static uint8_t placed[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+        uint16_t tail_length = length - split;
+        memcpy(tail, payload + split, tail_length);
+        if(tail_length > 0) roundtrip_fill(tail + rand() % tail_length, 1, rand() % 3);
+        
+        uint8_t* state = malloc(qrcode_getIncrementalSize(version));
+        QRIncremental incremental;
+        QRCode other;
+        qrcode_initIncremental(&incremental, state, version, ecc);
+        qrcode_initBytesIncremental(&other, placed, &incremental, &prefix, tail, tail_length, workspace);
+        ok = qrcode_initBytesIncremental(&other, placed, &incremental, &prefix, payload + split, tail_length, workspace) == 0 &&
+             other.mask == qrcode.mask && memcmp(placed, modules, qrcode_getBufferSize(version)) == 0;
+        if(!ok) {
+            fprintf(stderr, "prefix: version %u ecc %u length %u split %u: incremental encode differs\n", version, ecc, length, split);
+        }
+        free(state);
+    }
+    
+    free(workspace);
+    free(cache);
+    return ok;
+}
+
+// A mixed payload edited a few characters at a time must encode incrementally to
+// exactly the symbol, mask included, that a full encode at the version gives
+static bool roundtrip_check_incremental(uint8_t version, uint8_t ecc, uint8_t* payload, uint8_t* modules) {
+    static uint8_t expected[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+    uint16_t length = rand() % (roundtrip_max_length(version, ecc, MODE_BYTE) + 1);
+    roundtrip_fill_mixed(payload, length);
+    
+    uint8_t* workspace = malloc(qrcode_getWorkspaceSize(version, ecc));
+    uint8_t* state = malloc(qrcode_getIncrementalSize(version));
+    QRIncremental incremental;
+    qrcode_initIncremental(&incremental, state, version, ecc);
+    
+    bool ok = true;
+    for(uint8_t edit = 0; ok && edit < 4; edit++) {
+        // The first encode fills the state; the later ones change 1 to 3 characters
+        if(edit > 0 && length > 0) {
+            for(uint8_t i = 1 + rand() % 3; i > 0; i--) {
+                roundtrip_fill(payload + rand() % length, 1, rand() % 3);
+            }
+        }
+        
+        QRCode qrcode;
+        QRCode full;
+        ok = qrcode_initBytesIncremental(&qrcode, modules, &incremental, NULL, payload, length, workspace) == 0 &&
+             qrcode_initBytes(&full, expected, MODE_MIXED, version, ecc, payload, length) == 0 &&
+             qrcode.mask == full.mask && memcmp(modules, expected, qrcode_getBufferSize(version)) == 0;
+        if(!ok) {
+            fprintf(
+                stderr,
+                "incremental: version %u ecc %u length %u edit %u: differs from a full encode\n",
+                version,
+                ecc,
+                length,
+                edit);
+        }
+    }
+    
+    free(state);
+    free(workspace);
+    return ok;
+}
+
+#if QR_THREADS
+#define ROUNDTRIP_POOL_ITEMS 240
+
+// Random payloads at random versions and ECC levels, plus one item that must fail,
+// encoded across a thread pool must come out as qrcode_initBytes encodes them, large
+// symbols with their mask trials split across threads included. Empty batches and
+// batches of invalid items must succeed with every result set.
+static bool roundtrip_check_threads(uint8_t threads, uint32_t* symbols) {
+    static uint8_t payloads[ROUNDTRIP_POOL_ITEMS][ROUNDTRIP_MAX_PAYLOAD];
+    static uint8_t expected[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+    QRBatchItem* items = calloc(ROUNDTRIP_POOL_ITEMS, sizeof(QRBatchItem));
+    
+    for(uint32_t i = 0; i < ROUNDTRIP_POOL_ITEMS; i++) {
+        QRBatchItem* item = &items[i];
+        item->version = 1 + rand() % 40;
+        item->ecc = rand() % 4;
+        item->mode = MODE_MIXED;
+        item->length = rand() % (roundtrip_max_length(item->version, item->ecc, MODE_BYTE) + 1);
+        roundtrip_fill_mixed(payloads[i], item->length);
+        item->data = payloads[i];
+        item->modules = malloc(qrcode_getBufferSize(item->version));
+    }
+    items[0].version = 41;
+    
+    bool ok = qrcode_encodeBatch(items, ROUNDTRIP_POOL_ITEMS, threads) == 0;
+    if(!ok) fprintf(stderr, "threads: %u threads: encode failed\n", threads);
+    if(ok && items[0].result != -1) {
+        fprintf(stderr, "threads: version 41 encoded\n");
+        ok = false;
+    }
+    
+    for(uint32_t i = 1; ok && i < ROUNDTRIP_POOL_ITEMS; i++) {
+        QRBatchItem* item = &items[i];
+        QRCode qrcode;
+        ok = item->result == 0 &&
+             qrcode_initBytes(&qrcode, expected, item->mode, item->version, item->ecc, payloads[i], item->length) == 0 &&
+             item->qrcode.mask == qrcode.mask && item->qrcode.modules == item->modules &&
+             memcmp(item->modules, expected, qrcode_getBufferSize(item->version)) == 0;
+        if(!ok) {
+            fprintf(
+                stderr,
+                "threads: %u threads: version %u ecc %u length %u: differs from qrcode_initBytes\n",
+                threads,
+                item->version,
+                item->ecc,
+                item->length);
+        }
+        (*symbols)++;
+    }
+    
+    for(uint32_t i = 0; i < ROUNDTRIP_POOL_ITEMS; i++) {
+        free(items[i].modules);
+    }
+    free(items);
+    
+    // Nothing to encode is no failure, and items that cannot be encoded still get
+    // their result when there is no workspace to size
+    QRBatchItem invalid[2] = {{.version = 0, .result = 0}, {.version = 1, .ecc = 4, .result = 0}};
+    if(ok && (qrcode_encodeBatch(invalid, 0, threads) != 0 || invalid[0].result != 0 ||
+              qrcode_encodeBatch(invalid, 2, threads) != 0 || invalid[0].result != -1 ||
+              invalid[1].result != -1)) {
+        fprintf(stderr, "threads: %u threads: empty or invalid batch mishandled\n", threads);
+        ok = false;
+    }
+    return ok;
+}
+#endif
+
+#if QR_BATCH_LANES
+// Encodes one payload per lane at the same version and ECC level; every lane must
+// decode, and the first, the last and one other must match qrcode_initBytes of their
+// payload, mode and mask included. With MODE_MIXED, lane 0 holds digits only, so
+// lanes are segmented differently.
+static bool roundtrip_check_batch(uint8_t version, uint8_t ecc, uint8_t mode, uint32_t* symbols) {
+    static uint8_t payloads[QR_BATCH_LANES][ROUNDTRIP_MAX_PAYLOAD];
+    static qr_lane_t lanes[ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 29648];
+    static uint8_t modules[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+    static uint8_t expected[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+    static uint8_t decoded[ROUNDTRIP_MAX_PAYLOAD];
+    uint8_t* data[QR_BATCH_LANES];
+    uint16_t lengths[QR_BATCH_LANES];
+
+    uint8_t count = 1 + rand() % QR_BATCH_LANES;
+    uint8_t sample = rand() % count;
+    uint16_t max = roundtrip_max_length(version, ecc, mode == MODE_MIXED ? MODE_BYTE : mode);
+    for(uint8_t lane = 0; lane < count; lane++) {
+        lengths[lane] = rand() % (max + 1);
+        if(mode != MODE_MIXED) {
+            roundtrip_fill(payloads[lane], lengths[lane], mode);
+        } else if(lane == 0) {
+            roundtrip_fill(payloads[lane], lengths[lane], MODE_NUMERIC);
+        } else {
+            roundtrip_fill_mixed(payloads[lane], lengths[lane]);
+        }
+        data[lane] = payloads[lane];
+    }
+
+    QRCodeBatch batch;
+    if(qrcode_initBytesBatch(&batch, lanes, mode, version, ecc, data, lengths, count) != 0) {
+        fprintf(stderr, "batch: version %u ecc %u mode %u: encode failed\n", version, ecc, mode);
+        return false;
+    }
+
+    for(uint8_t lane = 0; lane < count; lane++) {
+        QRCode qrcode;
+        QRDecodeInfo info;
+        QRCode single;
+        qrcode_getBatchSymbol(&batch, lane, &qrcode, modules);
+        if((lane == 0 || lane == sample || lane == count - 1) &&
+           (qrcode_initBytes(&single, expected, mode, version, ecc, payloads[lane], lengths[lane]) != 0 ||
+            qrcode.mode != single.mode || qrcode.mask != single.mask ||
+            memcmp(modules, expected, qrcode_getBufferSize(version)) != 0)) {
+            fprintf(
+                stderr,
+                "batch: version %u ecc %u mode %u lane %u: differs from qrcode_initBytes\n",
+                version,
+                ecc,
+                mode,
+                lane);
+            return false;
+        }
+        
+        // The decoder reports the mode of the first segment, so mixed lanes only have
+        // to give their payload back
+        int8_t result = qrdecode_decode(&qrcode, decoded, sizeof(decoded), &info);
+        if(mode == MODE_MIXED ? result != QRDECODE_OK || info.length != lengths[lane] ||
+                                    memcmp(decoded, payloads[lane], lengths[lane]) != 0 :
+                                !roundtrip_compare(
+                                    "batch", &qrcode, result, &info, payloads[lane], lengths[lane], decoded)) {
+            fprintf(stderr, "batch: version %u ecc %u mode %u lane %u: decode differs\n", version, ecc, mode, lane);
+            return false;
+        }
+        (*symbols)++;
+    }
+
+    return true;
+}
+#endif
+
+#if QR_PROFILE
+static const char* const roundtrip_stage_names[QR_STAGE_COUNT] =
+    {"data", "ecc", "function", "codewords", "mask", "penalty", "format"};
+
+static uint32_t roundtrip_clock(void* context) {
+    (void)context;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+// The mask chosen is the first with the lowest penalty
+static bool roundtrip_check_profile(const QRProfile* profile, const QRCode* qrcode) {
+    for(uint8_t i = 0; i < 8; i++) {
+        uint32_t chosen = profile->penalty[qrcode->mask];
+        if(profile->penalty[i] < chosen || (profile->penalty[i] == chosen && i < qrcode->mask)) {
+            fprintf(
+                stderr,
+                "profile: version %u ecc %u: mask %u chosen, but mask %u scored %lu < %lu\n",
+                qrcode->version,
+                qrcode->ecc,
+                qrcode->mask,
+                i,
+                (unsigned long)profile->penalty[i],
+                (unsigned long)chosen);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void roundtrip_print_profile(const QRProfile* profile) {
+    uint64_t total = 0;
+    for(uint8_t i = 0; i < QR_STAGE_COUNT; i++) {
+        total += profile->ticks[i];
+    }
+
+    printf("%lu encodes profiled, ns per encode:\n", (unsigned long)profile->encodes);
+    for(uint8_t i = 0; i < QR_STAGE_COUNT; i++) {
+        printf(
+            "  %-10s %9.0f %5.1f%%\n",
+            roundtrip_stage_names[i],
+            (double)profile->ticks[i] / profile->encodes,
+            total ? 100.0 * profile->ticks[i] / total : 0.0);
+    }
+    printf("  mask       ns/trial  last penalty\n");
+    for(uint8_t i = 0; i < 8; i++) {
+        printf(
+            "  %-10u %9.0f %13lu\n",
+            i,
+            (double)profile->maskTicks[i] / profile->encodes,
+            (unsigned long)profile->penalty[i]);
+    }
+}
+#endif
+
+int main(int argc, char** argv) {
+    static uint8_t payload[ROUNDTRIP_MAX_PAYLOAD];
+    static uint8_t decoded[ROUNDTRIP_MAX_PAYLOAD];
+    static uint8_t modules[(ROUNDTRIP_MAX_SIZE * ROUNDTRIP_MAX_SIZE + 7) / 8];
+    uint32_t iterations = 4;
+    unsigned seed = 1;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 0);
+        } else {
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+#if QR_PROFILE
+    QRProfile profile;
+    memset(&profile, 0, sizeof(profile));
+    profile.clock = roundtrip_clock;
+    qrcode_setProfile(&profile);
+#endif
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t symbols = 0;
+
+    for(uint32_t iteration = 0; iteration < iterations; iteration++) {
+        for(uint8_t version = 1; version <= 40; version++) {
+            for(uint8_t ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+                for(uint8_t mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                    // The first pass fills every symbol to capacity
+                    uint16_t max = roundtrip_max_length(version, ecc, mode);
+                    uint16_t length = iteration == 0 ? max : rand() % (max + 1);
+                    roundtrip_fill(payload, length, mode);
+
+                    QRCode qrcode;
+                    QRDecodeInfo info;
+                    if(qrcode_initBytes(&qrcode, modules, mode, version, ecc, payload, length) != 0) {
+                        fprintf(stderr, "grid: version %u ecc %u mode %u: encode failed\n", version, ecc, mode);
+                        return 1;
+                    }
+                    int8_t result = qrdecode_decode(&qrcode, decoded, sizeof(decoded), &info);
+                    if(!roundtrip_compare("grid", &qrcode, result, &info, payload, length, decoded) ||
+                       !roundtrip_check_raster(&qrcode, payload, length, decoded) ||
+                       !roundtrip_check_rects(&qrcode)) {
+                        return 1;
+                    }
+#if QR_PROFILE
+                    if(!roundtrip_check_profile(&profile, &qrcode)) return 1;
+#endif
+                    symbols++;
+
+#if QR_BATCH_LANES
+                    if(!roundtrip_check_batch(version, ecc, mode, &symbols)) return 1;
+#endif
+                }
+                
+                if(!roundtrip_check_mixed(version, ecc, iteration == 0, payload, modules, decoded)) return 1;
+                symbols++;
+#if QR_BATCH_LANES
+                if(!roundtrip_check_batch(version, ecc, MODE_MIXED, &symbols)) return 1;
+#endif
+
+                if(!roundtrip_check_prefix(version, ecc, payload, modules, decoded)) return 1;
+                symbols++;
+                
+                if(!roundtrip_check_incremental(version, ecc, payload, modules)) return 1;
+                symbols += 4;
+            }
+        }
+    }
+
+#if QR_THREADS
+    // A single thread, as many as there are cores, and more threads than items
+    if(!roundtrip_check_threads(1, &symbols) || !roundtrip_check_threads(0, &symbols) ||
+       !roundtrip_check_threads(ROUNDTRIP_POOL_ITEMS + 15, &symbols)) {
+        return 1;
+    }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf(
+        "%lu symbols round-tripped in %.2f s (QR_VECTOR_RS=%d%s, QR_BATCH_LANES=%d, QR_THREADS=%d)\n",
+        (unsigned long)symbols,
+        seconds,
+        QR_VECTOR_RS,
+        ROUNDTRIP_RS_KERNEL,
+        QR_BATCH_LANES,
+        QR_THREADS);
+#if QR_PROFILE
+    qrcode_setProfile(NULL);
+    roundtrip_print_profile(&profile);
+#endif
+    return 0;
+}
@@ -0,0 +1,564 @@
+/**
+ * Minimal QR code decoder; see qrdecode.h.
+ *
+ * Module layout, masks and block interleaving follow qrcode.c, but nothing is
+ * shared with it on purpose: a decoder that reused the encoder's tables and
+ * helpers would happily agree with the encoder's bugs.
+ *
+ * See: https://www.thonky.com/qr-code-tutorial/
+ */
+
+#include "qrdecode.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_VERSION        40
+#define MAX_SIZE           (4 * MAX_VERSION + 17)
+#define MAX_GRID_BYTES     ((MAX_SIZE * MAX_SIZE + 7) / 8)
+#define MAX_CODEWORDS      3706
+
+// Indexed by the ECC value of the format bits: Medium, Low, High, Quartile (as in the spec)
+static const uint16_t NUM_ERROR_CORRECTION_CODEWORDS[4][MAX_VERSION] = {
+    { 10, 16, 26, 36, 48,  64,  72,  88, 110, 130, 150, 176, 198, 216, 240, 280, 308, 338, 364, 416, 442, 476, 504, 560,  588,  644,  700,  728,  784,  812,  868,  924,  980, 1036, 1064, 1120, 1204, 1260, 1316, 1372},
+    {  7, 10, 15, 20, 26,  36,  40,  48,  60,  72,  80,  96, 104, 120, 132, 144, 168, 180, 196, 224, 224, 252, 270, 300,  312,  336,  360,  390,  420,  450,  480,  510,  540,  570,  570,  600,  630,  660,  720,  750},
+    { 17, 28, 44, 64, 88, 112, 130, 156, 192, 224, 264, 308, 352, 384, 432, 480, 532, 588, 650, 700, 750, 816, 900, 960, 1050, 1110, 1200, 1260, 1350, 1440, 1530, 1620, 1710, 1800, 1890, 1980, 2100, 2220, 2310, 2430},
+    { 13, 22, 36, 52, 72,  96, 108, 132, 160, 192, 224, 260, 288, 320, 360, 408, 448, 504, 546, 600, 644, 690, 750, 810,  870,  952, 1020, 1050, 1140, 1200, 1290, 1350, 1440, 1530, 1590, 1680, 1770, 1860, 1950, 2040},
+};
+
+static const uint8_t NUM_ERROR_CORRECTION_BLOCKS[4][MAX_VERSION] = {
+    {  1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {  1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {  1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+    {  1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+};
+
+// Format-bit ECC value to ECC_LOW ... ECC_HIGH
+static const uint8_t ECC_LEVELS[4] = { ECC_MEDIUM, ECC_LOW, ECC_HIGH, ECC_QUARTILE };
+
+static const char ALPHANUMERIC[45] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+
+static bool grid_getBit(const uint8_t *grid, uint8_t size, uint8_t x, uint8_t y) {
+    uint32_t offset = (uint32_t)y * size + x;
+    return (grid[offset >> 3] >> (7 - (offset & 7))) & 1;
+}
+
+static void grid_setBit(uint8_t *grid, uint8_t size, uint8_t x, uint8_t y) {
+    uint32_t offset = (uint32_t)y * size + x;
+    grid[offset >> 3] |= 0x80 >> (offset & 7);
+}
+
+static void grid_setRect(uint8_t *grid, uint8_t size, int16_t x, int16_t y, int16_t width, int16_t height) {
+    for (int16_t yy = y; yy < y + height; yy++) {
+        for (int16_t xx = x; xx < x + width; xx++) {
+            if (xx >= 0 && xx < size && yy >= 0 && yy < size) { grid_setBit(grid, size, xx, yy); }
+        }
+    }
+}
+
+static uint8_t countBits(uint32_t value) {
+    uint8_t count = 0;
+    for (; value; value &= value - 1) { count++; }
+    return count;
+}
+
+
+// Marks finders, separators, timing, alignment, format and version modules
+static void markFunctionModules(uint8_t *isFunction, uint8_t version) {
+    uint8_t size = 4 * version + 17;
+    memset(isFunction, 0, (size * size + 7) / 8);
+
+    // Finders with their separators and the format bits beside them (and the dark module)
+    grid_setRect(isFunction, size, 0, 0, 9, 9);
+    grid_setRect(isFunction, size, size - 8, 0, 8, 9);
+    grid_setRect(isFunction, size, 0, size - 8, 9, 8);
+
+    grid_setRect(isFunction, size, 6, 0, 1, size);
+    grid_setRect(isFunction, size, 0, 6, size, 1);
+
+    if (version > 1) {
+        uint8_t alignCount = version / 7 + 2;
+        uint8_t step = (version == 32) ? 26 : (version * 4 + alignCount * 2 + 1) / (2 * alignCount - 2) * 2;
+        uint8_t positions[7];
+        positions[0] = 6;
+        for (uint8_t i = alignCount - 1, pos = size - 7; i > 0; i--, pos -= step) {
+            positions[i] = pos;
+        }
+
+        for (uint8_t i = 0; i < alignCount; i++) {
+            for (uint8_t j = 0; j < alignCount; j++) {
+                if ((i == 0 && j == 0) || (i == 0 && j == alignCount - 1) || (i == alignCount - 1 && j == 0)) { continue; }
+                grid_setRect(isFunction, size, positions[j] - 2, positions[i] - 2, 5, 5);
+            }
+        }
+    }
+
+    if (version >= 7) {
+        grid_setRect(isFunction, size, size - 11, 0, 3, 6);
+        grid_setRect(isFunction, size, 0, size - 11, 6, 3);
+    }
+}
+
+static bool isMasked(uint8_t mask, uint8_t x, uint8_t y) {
+    switch (mask) {
+        case 0:  return (x + y) % 2 == 0;
+        case 1:  return y % 2 == 0;
+        case 2:  return x % 3 == 0;
+        case 3:  return (x + y) % 3 == 0;
+        case 4:  return (x / 3 + y / 2) % 2 == 0;
+        case 5:  return x * y % 2 + x * y % 3 == 0;
+        case 6:  return (x * y % 2 + x * y % 3) % 2 == 0;
+        default: return ((x + y) % 2 + x * y % 3) % 2 == 0;
+    }
+}
+
+
+// 15-bit format code word for (ecc << 3 | mask), BCH(15,5) and masked
+static uint16_t getFormatCodeword(uint8_t value) {
+    uint32_t rem = value;
+    for (uint8_t i = 0; i < 10; i++) {
+        rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+    }
+    return ((value << 10) | rem) ^ 0x5412;
+}
+
+// Picks the format value closest to either copy; up to 3 bit errors are tolerated
+static int8_t readFormat(const uint8_t *modules, uint8_t size, uint8_t *ecc, uint8_t *mask) {
+    uint16_t first = 0, second = 0;
+
+    for (uint8_t i = 0; i <= 5; i++) { first |= grid_getBit(modules, size, 8, i) << i; }
+    first |= grid_getBit(modules, size, 8, 7) << 6;
+    first |= grid_getBit(modules, size, 8, 8) << 7;
+    first |= grid_getBit(modules, size, 7, 8) << 8;
+    for (uint8_t i = 9; i < 15; i++) { first |= grid_getBit(modules, size, 14 - i, 8) << i; }
+
+    for (uint8_t i = 0; i <= 7; i++) { second |= grid_getBit(modules, size, size - 1 - i, 8) << i; }
+    for (uint8_t i = 8; i < 15; i++) { second |= grid_getBit(modules, size, 8, size - 15 + i) << i; }
+
+    uint8_t best = 0, bestDistance = 16;
+    for (uint8_t value = 0; value < 32; value++) {
+        uint16_t codeword = getFormatCodeword(value);
+        uint8_t distance = countBits(codeword ^ first);
+        if (countBits(codeword ^ second) < distance) { distance = countBits(codeword ^ second); }
+        if (distance < bestDistance) {
+            best = value;
+            bestDistance = distance;
+        }
+    }
+
+    if (bestDistance > 3) { return QRDECODE_ERR_FORMAT; }
+
+    *ecc = best >> 3;
+    *mask = best & 0x07;
+    return QRDECODE_OK;
+}
+
+// Versions 7 and up repeat their number in two 6*3 blocks; either copy must match
+static int8_t checkVersion(const uint8_t *modules, uint8_t size, uint8_t version) {
+    if (version < 7) { return QRDECODE_OK; }
+
+    uint32_t rem = version;
+    for (uint8_t i = 0; i < 12; i++) {
+        rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+    }
+    uint32_t expected = (uint32_t)version << 12 | rem;
+
+    uint32_t first = 0, second = 0;
+    for (uint8_t i = 0; i < 18; i++) {
+        uint8_t a = size - 11 + i % 3, b = i / 3;
+        first |= (uint32_t)grid_getBit(modules, size, a, b) << i;
+        second |= (uint32_t)grid_getBit(modules, size, b, a) << i;
+    }
+
+    if (countBits(first ^ expected) <= 3 || countBits(second ^ expected) <= 3) { return QRDECODE_OK; }
+    return QRDECODE_ERR_SIZE;
+}
+
+
+// Exponent and logarithm tables of GF(2^8/0x11D) with generator 0x02; exp is doubled
+// so products of two logarithms need no reduction
+typedef struct GaloisField {
+    uint8_t exp[512];
+    uint8_t log[256];
+} GaloisField;
+
+static void gf_init(GaloisField *gf) {
+    uint16_t value = 1;
+    for (uint16_t i = 0; i < 255; i++) {
+        gf->exp[i] = gf->exp[i + 255] = value;
+        gf->log[value] = i;
+        value = (value << 1) ^ ((value >> 7) * 0x11D);
+    }
+    gf->exp[510] = gf->exp[511] = gf->exp[0];
+}
+
+// The generator has roots 2^0 ... 2^(eccLength - 1); a clean block evaluates to zero at all of them
+static bool rs_checkSyndromes(const GaloisField *gf, const uint8_t *block, uint16_t length, uint8_t eccLength) {
+    for (uint8_t i = 0; i < eccLength; i++) {
+        uint8_t syndrome = 0;
+        for (uint16_t k = 0; k < length; k++) {
+            syndrome = (syndrome ? gf->exp[gf->log[syndrome] + i] : 0) ^ block[k];
+        }
+        if (syndrome != 0) { return false; }
+    }
+    return true;
+}
+
+
+typedef struct BitReader {
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t offset;
+} BitReader;
+
+static int32_t br_read(BitReader *reader, uint8_t count) {
+    if (reader->offset + count > reader->length) { return -1; }
+
+    int32_t value = 0;
+    for (uint8_t i = 0; i < count; i++, reader->offset++) {
+        value = (value << 1) | ((reader->data[reader->offset >> 3] >> (7 - (reader->offset & 7))) & 1);
+    }
+    return value;
+}
+
+static uint8_t getCountBits(uint8_t version, uint8_t mode) {
+    static const uint8_t COUNT_BITS[3][3] = {
+        { 10, 12, 14 },  // Numeric
+        {  9, 11, 13 },  // Alphanumeric
+        {  8, 16, 16 },  // Byte
+    };
+    uint8_t range = (version <= 9) ? 0 : (version <= 26) ? 1 : 2;
+    return COUNT_BITS[mode][range];
+}
+
+static int8_t emit(uint8_t *out, uint16_t capacity, QRDecodeInfo *info, uint8_t value) {
+    if (info->length >= capacity) { return QRDECODE_ERR_CAPACITY; }
+    out[info->length++] = value;
+    return QRDECODE_OK;
+}
+
+static int8_t parseSegments(BitReader *reader, uint8_t version, uint8_t *out, uint16_t capacity, QRDecodeInfo *info) {
+
+    // A terminator may be cut short, or left out, when the data is full
+    while (reader->offset + 4 <= reader->length) {
+        int32_t modeIndicator = br_read(reader, 4);
+        if (modeIndicator == 0) { break; }
+
+        if (modeIndicator == 7) {
+            // ECI designator: 1, 2 or 3 bytes; the payload bytes are passed through as they are
+            int32_t first = br_read(reader, 8);
+            if (first < 0) { return QRDECODE_ERR_DATA; }
+            if ((first & 0xC0) == 0x80) {
+                if (br_read(reader, 8) < 0) { return QRDECODE_ERR_DATA; }
+            } else if ((first & 0xE0) == 0xC0) {
+                if (br_read(reader, 16) < 0) { return QRDECODE_ERR_DATA; }
+            } else if (first & 0x80) {
+                return QRDECODE_ERR_DATA;
+            }
+            continue;
+        }
+
+        uint8_t mode;
+        switch (modeIndicator) {
+            case 1:  mode = MODE_NUMERIC;       break;
+            case 2:  mode = MODE_ALPHANUMERIC;  break;
+            case 4:  mode = MODE_BYTE;          break;
+            default: return QRDECODE_ERR_DATA;
+        }
+
+        int32_t count = br_read(reader, getCountBits(version, mode));
+        if (count < 0) { return QRDECODE_ERR_DATA; }
+
+        if (info->segments++ == 0) { info->mode = mode; }
+
+        int8_t result = QRDECODE_OK;
+        if (mode == MODE_NUMERIC) {
+            while (count > 0 && result == QRDECODE_OK) {
+                uint8_t digits = count >= 3 ? 3 : count;
+                int32_t value = br_read(reader, digits * 3 + 1);
+                if (value < 0 || value >= (digits == 3 ? 1000 : digits == 2 ? 100 : 10)) { return QRDECODE_ERR_DATA; }
+
+                char text[3];
+                for (int8_t i = digits - 1; i >= 0; i--, value /= 10) { text[i] = '0' + value % 10; }
+                for (uint8_t i = 0; i < digits && result == QRDECODE_OK; i++) { result = emit(out, capacity, info, text[i]); }
+                count -= digits;
+            }
+
+        } else if (mode == MODE_ALPHANUMERIC) {
+            while (count > 0 && result == QRDECODE_OK) {
+                if (count >= 2) {
+                    int32_t value = br_read(reader, 11);
+                    if (value < 0 || value >= 45 * 45) { return QRDECODE_ERR_DATA; }
+                    result = emit(out, capacity, info, ALPHANUMERIC[value / 45]);
+                    if (result == QRDECODE_OK) { result = emit(out, capacity, info, ALPHANUMERIC[value % 45]); }
+                    count -= 2;
+                } else {
+                    int32_t value = br_read(reader, 6);
+                    if (value < 0 || value >= 45) { return QRDECODE_ERR_DATA; }
+                    result = emit(out, capacity, info, ALPHANUMERIC[value]);
+                    count--;
+                }
+            }
+
+        } else {
+            for (; count > 0 && result == QRDECODE_OK; count--) {
+                int32_t value = br_read(reader, 8);
+                if (value < 0) { return QRDECODE_ERR_DATA; }
+                result = emit(out, capacity, info, value);
+            }
+        }
+
+        if (result != QRDECODE_OK) { return result; }
+    }
+
+    return QRDECODE_OK;
+}
+
+
+uint16_t qrdecode_getDataCapacity(uint8_t version, uint8_t ecc) {
+    uint8_t size = 4 * version + 17;
+    uint8_t isFunction[MAX_GRID_BYTES];
+    markFunctionModules(isFunction, version);
+
+    uint32_t dataModules = size * size;
+    for (uint16_t i = 0; i < (size * size + 7) / 8; i++) { dataModules -= countBits(isFunction[i]); }
+
+    uint8_t eccFormatBits = 0;
+    while (ECC_LEVELS[eccFormatBits] != ecc) { eccFormatBits++; }
+    return dataModules / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+}
+
+int8_t qrdecode_decode(const QRCode *qrcode, uint8_t *out, uint16_t capacity, QRDecodeInfo *info) {
+    uint8_t size = qrcode->size;
+    const uint8_t *modules = qrcode->modules;
+
+    memset(info, 0, sizeof(QRDecodeInfo));
+
+    if (size < 21 || size > MAX_SIZE || (size - 17) % 4 != 0) { return QRDECODE_ERR_SIZE; }
+    uint8_t version = (size - 17) / 4;
+
+    int8_t result = checkVersion(modules, size, version);
+    if (result != QRDECODE_OK) { return result; }
+
+    uint8_t eccFormatBits, mask;
+    result = readFormat(modules, size, &eccFormatBits, &mask);
+    if (result != QRDECODE_OK) { return result; }
+
+    info->version = version;
+    info->ecc = ECC_LEVELS[eccFormatBits];
+    info->mask = mask;
+
+    uint8_t isFunction[MAX_GRID_BYTES];
+    markFunctionModules(isFunction, version);
+
+    // Read the codewords back in the zigzag order drawCodewords wrote them
+    uint8_t codewords[MAX_CODEWORDS];
+    memset(codewords, 0, sizeof(codewords));
+    uint32_t bits = 0;
+    for (int16_t right = size - 1; right >= 1; right -= 2) {
+        if (right == 6) { right = 5; }
+
+        for (uint8_t vert = 0; vert < size; vert++) {
+            for (uint8_t j = 0; j < 2; j++) {
+                uint8_t x = right - j;
+                bool upwards = ((right & 2) == 0) ^ (x < 6);
+                uint8_t y = upwards ? size - 1 - vert : vert;
+                if (grid_getBit(isFunction, size, x, y)) { continue; }
+
+                if (grid_getBit(modules, size, x, y) ^ isMasked(mask, x, y)) {
+                    codewords[bits >> 3] |= 0x80 >> (bits & 7);
+                }
+                bits++;
+            }
+        }
+    }
+
+    // Remainder bits (0 to 7) do not belong to any codeword
+    uint16_t totalCodewords = bits / 8;
+    uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[eccFormatBits][version - 1];
+    uint8_t eccLength = NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1] / numBlocks;
+    uint8_t numShortBlocks = numBlocks - totalCodewords % numBlocks;
+    uint16_t shortDataLength = totalCodewords / numBlocks - eccLength;
+
+    // De-interleave: block b starts at b * shortBlockLength plus one per long block before it
+    uint8_t blocks[MAX_CODEWORDS];
+    uint16_t index = 0;
+    for (uint16_t i = 0; i <= shortDataLength; i++) {
+        for (uint8_t b = 0; b < numBlocks; b++) {
+            if (i == shortDataLength && b < numShortBlocks) { continue; }
+            uint16_t start = b * (shortDataLength + eccLength) + (b > numShortBlocks ? b - numShortBlocks : 0);
+            blocks[start + i] = codewords[index++];
+        }
+    }
+    for (uint8_t i = 0; i < eccLength; i++) {
+        for (uint8_t b = 0; b < numBlocks; b++) {
+            uint16_t start = b * (shortDataLength + eccLength) + (b > numShortBlocks ? b - numShortBlocks : 0);
+            uint16_t dataLength = shortDataLength + (b >= numShortBlocks ? 1 : 0);
+            blocks[start + dataLength + i] = codewords[index++];
+        }
+    }
+
+    // Verify every block, then gather the data codewords in order
+    GaloisField gf;
+    gf_init(&gf);
+    uint8_t data[MAX_CODEWORDS];
+    uint16_t dataBytes = 0;
+    for (uint8_t b = 0; b < numBlocks; b++) {
+        uint16_t start = b * (shortDataLength + eccLength) + (b > numShortBlocks ? b - numShortBlocks : 0);
+        uint16_t dataLength = shortDataLength + (b >= numShortBlocks ? 1 : 0);
+        if (!rs_checkSyndromes(&gf, &blocks[start], dataLength + eccLength, eccLength)) { return QRDECODE_ERR_ECC; }
+        memcpy(&data[dataBytes], &blocks[start], dataLength);
+        dataBytes += dataLength;
+    }
+
+    BitReader reader = { data, (uint32_t)dataBytes * 8, 0 };
+    return parseSegments(&reader, version, out, capacity, info);
+}
+
+
+typedef struct Bitmap {
+    const uint8_t *data;
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;
+    uint8_t bitOrder;
+} Bitmap;
+
+// Pixels outside the bitmap read as light
+static bool bitmap_get(const Bitmap *bitmap, int32_t x, int32_t y) {
+    if (x < 0 || y < 0 || x >= bitmap->width || y >= bitmap->height) { return false; }
+    uint8_t byte = bitmap->data[(uint32_t)y * bitmap->stride + x / 8];
+    return (bitmap->bitOrder == QR_RASTER_XBM) ? (byte >> (x & 7)) & 1 : (byte >> (7 - (x & 7))) & 1;
+}
+
+// Dark, light, dark, light, dark runs of 1:1:3:1:1 modules, within half a module each
+static bool isFinderRatio(const uint16_t *runs) {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < 5; i++) { total += runs[i]; }
+    if (total < 7) { return false; }
+
+    for (uint8_t i = 0; i < 5; i++) {
+        uint8_t expected = (i == 2) ? 3 : 1;
+        if (2 * abs((int32_t)(7 * runs[i]) - (int32_t)(expected * total)) >= (int32_t)(expected * total)) { return false; }
+    }
+    return true;
+}
+
+// Finds the next finder pattern crossing row y that starts at or after from
+static bool findFinderInRow(const Bitmap *bitmap, uint16_t y, uint16_t from, uint16_t *left, uint16_t *width) {
+    int32_t x = from;
+
+    // Do not start in the middle of a dark run
+    while (x > 0 && x < bitmap->width && bitmap_get(bitmap, x - 1, y) && bitmap_get(bitmap, x, y)) { x++; }
+
+    while (x < bitmap->width) {
+        while (x < bitmap->width && !bitmap_get(bitmap, x, y)) { x++; }
+        if (x >= bitmap->width) { return false; }
+
+        uint16_t runs[5];
+        int32_t end = x;
+        bool color = true;
+        uint8_t k;
+        for (k = 0; k < 5; k++, color = !color) {
+            int32_t start = end;
+            while (end < bitmap->width && bitmap_get(bitmap, end, y) == color) { end++; }
+            runs[k] = end - start;
+            if (runs[k] == 0) { break; }
+        }
+
+        if (k == 5 && isFinderRatio(runs)) {
+            *left = x;
+            *width = end - x;
+            return true;
+        }
+
+        x += runs[0];
+    }
+
+    return false;
+}
+
+// Measures the finder pattern vertically through (x, y), which must be on its center
+static bool findFinderInColumn(const Bitmap *bitmap, uint16_t x, uint16_t y, uint16_t *top, uint16_t *height) {
+    if (!bitmap_get(bitmap, x, y)) { return false; }
+
+    int32_t centerTop = y, ringTop, outerTop, centerBottom = y, ringBottom, outerBottom;
+    while (bitmap_get(bitmap, x, centerTop - 1)) { centerTop--; }
+    for (ringTop = centerTop; ringTop > 0 && !bitmap_get(bitmap, x, ringTop - 1); ringTop--) { }
+    for (outerTop = ringTop; bitmap_get(bitmap, x, outerTop - 1); outerTop--) { }
+    while (bitmap_get(bitmap, x, centerBottom + 1)) { centerBottom++; }
+    for (ringBottom = centerBottom; ringBottom + 1 < bitmap->height && !bitmap_get(bitmap, x, ringBottom + 1); ringBottom++) { }
+    for (outerBottom = ringBottom; bitmap_get(bitmap, x, outerBottom + 1); outerBottom++) { }
+
+    uint16_t runs[5] = {
+        ringTop - outerTop,
+        centerTop - ringTop,
+        centerBottom - centerTop + 1,
+        ringBottom - centerBottom,
+        outerBottom - ringBottom,
+    };
+    if (!isFinderRatio(runs)) { return false; }
+
+    *top = outerTop;
+    *height = outerBottom - outerTop + 1;
+    return true;
+}
+
+// With the top-left finder at (left, top), looks for a top-right finder of about the
+// same size on its center row and samples the square symbol the two span
+static int8_t decodeFromFinder(const Bitmap *bitmap, uint16_t left, uint16_t top, uint16_t finderWidth, uint16_t finderHeight, uint8_t *out, uint16_t capacity, QRDecodeInfo *info) {
+    uint16_t centerY = top + finderHeight / 2;
+    int8_t result = QRDECODE_ERR_LOCATE;
+
+    uint16_t otherLeft, otherWidth;
+    for (uint16_t from = left + finderWidth; findFinderInRow(bitmap, centerY, from, &otherLeft, &otherWidth); from = otherLeft + 1) {
+        if (2 * abs((int32_t)otherWidth - (int32_t)finderWidth) > finderWidth) { continue; }
+
+        // Seven modules per finder give the module pitch, and from it the version
+        uint32_t symbolWidth = otherLeft + otherWidth - left;
+        int32_t version = ((int32_t)(symbolWidth * 14 * 2) / (finderWidth + finderHeight) - 34 + 4) / 8;
+        if (version < 1 || version > MAX_VERSION) { continue; }
+
+        uint8_t size = 4 * version + 17;
+        if (top + symbolWidth > bitmap->height + symbolWidth / size / 2) { continue; }
+
+        uint8_t modules[MAX_GRID_BYTES];
+        memset(modules, 0, (size * size + 7) / 8);
+        for (uint8_t y = 0; y < size; y++) {
+            for (uint8_t x = 0; x < size; x++) {
+                int32_t px = left + (2 * x + 1) * symbolWidth / (2 * size);
+                int32_t py = top + (2 * y + 1) * symbolWidth / (2 * size);
+                if (bitmap_get(bitmap, px, py)) { grid_setBit(modules, size, x, y); }
+            }
+        }
+
+        QRCode qrcode = { version, size, 0, 0, 0, modules };
+        result = qrdecode_decode(&qrcode, out, capacity, info);
+        if (result == QRDECODE_OK) { return result; }
+    }
+
+    return result;
+}
+
+int8_t qrdecode_decodeBitmap(const uint8_t *bitmap, uint16_t width, uint16_t height, uint16_t stride, uint8_t bitOrder, uint8_t *out, uint16_t capacity, QRDecodeInfo *info) {
+    Bitmap image = { bitmap, width, height, stride, bitOrder };
+    int8_t result = QRDECODE_ERR_LOCATE;
+
+    memset(info, 0, sizeof(QRDecodeInfo));
+
+    // The first finder met scanning down is the top-left one of an upright symbol
+    for (uint16_t y = 0; y < height; y++) {
+        uint16_t left, finderWidth;
+        for (uint16_t from = 0; findFinderInRow(&image, y, from, &left, &finderWidth); from = left + 1) {
+            uint16_t top, finderHeight;
+            if (!findFinderInColumn(&image, left + finderWidth / 2, y, &top, &finderHeight)) { continue; }
+
+            result = decodeFromFinder(&image, left, top, finderWidth, finderHeight, out, capacity, info);
+            if (result == QRDECODE_OK) { return result; }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,57 @@
+/**
+ * Minimal QR code decoder for round-trip checks of the encoder in qrcode.c.
+ *
+ * It reads an unrotated symbol, either as a module grid or rendered into a 1bpp
+ * bitmap, checks the format (and version) bits, unmasks and de-interleaves the
+ * codewords, verifies every Reed-Solomon block by its syndromes and parses the
+ * numeric, alphanumeric, byte and ECI segments. Errors are detected, not corrected:
+ * anything but a clean symbol is reported as a failure.
+ */
+
+#ifndef __QRDECODE_H_
+#define __QRDECODE_H_
+
+#include <stdint.h>
+
+#include "qrcode.h"
+
+#define QRDECODE_OK              0
+#define QRDECODE_ERR_LOCATE     -1  // No finder patterns found in the bitmap
+#define QRDECODE_ERR_SIZE       -2  // Not 4 * version + 17 modules, or the version bits disagree
+#define QRDECODE_ERR_FORMAT     -3  // Neither copy of the format bits is a valid code word
+#define QRDECODE_ERR_ECC        -4  // A block has non-zero syndromes
+#define QRDECODE_ERR_DATA       -5  // Unsupported mode or a segment runs past the data
+#define QRDECODE_ERR_CAPACITY   -6  // The payload does not fit the output buffer
+
+typedef struct QRDecodeInfo {
+    uint8_t version;
+    uint8_t ecc;          // ECC_LOW ... ECC_HIGH
+    uint8_t mask;
+    uint8_t mode;         // Mode of the first segment
+    uint8_t segments;
+    uint16_t length;      // Payload bytes written to the output
+} QRDecodeInfo;
+
+
+#ifdef __cplusplus
+extern "C"{
+#endif  /* __cplusplus */
+
+// Decodes the symbol in qrcode->modules (qrcode->size modules wide); the other fields
+// are ignored, so they can be compared against info afterwards. The payload is not
+// NUL-terminated.
+int8_t qrdecode_decode(const QRCode *qrcode, uint8_t *out, uint16_t capacity, QRDecodeInfo *info);
+
+// Data codewords (payload bytes before segment headers) of a version at an ECC level
+uint16_t qrdecode_getDataCapacity(uint8_t version, uint8_t ecc);
+
+// Locates a symbol in a width * height bitmap of stride bytes per row (dark pixels set,
+// QR_RASTER_XBM or QR_RASTER_MSB bit order), samples it and decodes it
+int8_t qrdecode_decodeBitmap(const uint8_t *bitmap, uint16_t width, uint16_t height, uint16_t stride, uint8_t bitOrder, uint8_t *out, uint16_t capacity, QRDecodeInfo *info);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+
+#endif  /* __QRDECODE_H_ */
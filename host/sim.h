@@ -0,0 +1,75 @@
+#pragma once
+
+// Internal interface shared by the host simulator's stand-in modules
+
+#include <furi.h>
+#include <gui/canvas.h>
+#include <gui/view.h>
+#include <input/input.h>
+
+#define SIM_SCREEN_WIDTH 128
+#define SIM_SCREEN_HEIGHT 64
+#define SIM_MAX_SCENES 32
+#define SIM_MAX_STRINGS 32
+
+// Per-scene cost counters, attributed to the scene on top of the scene stack
+typedef struct {
+    uint32_t frames;
+    uint64_t draw_calls;
+    uint64_t pixels_drawn;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint32_t max_widget_elements;
+    uint32_t enters;
+} SimSceneStats;
+
+struct Canvas {
+    uint8_t pixels[SIM_SCREEN_HEIGHT][SIM_SCREEN_WIDTH];
+    char strings[SIM_MAX_STRINGS][64];
+    uint32_t string_count;
+    uint32_t draw_calls;
+    uint32_t pixels_drawn;
+    uint32_t bitmaps; // canvas_draw_xbm calls
+    Color color;
+    Font font;
+};
+
+typedef struct Canvas SimCanvas;
+
+// sim_furi.c
+void sim_furi_init(void);
+uint32_t sim_current_scene(void);
+void sim_set_current_scene(uint32_t scene_id);
+SimSceneStats* sim_scene_stats(uint32_t scene_id);
+void sim_count_allocation(size_t size);
+size_t sim_heap_in_use(void);
+
+// sim_gui.c
+void sim_canvas_reset(SimCanvas* canvas);
+void sim_view_draw(View* view, SimCanvas* canvas);
+bool sim_view_input(View* view, InputEvent* event);
+uint32_t sim_widget_element_count(View* view);
+bool sim_text_input_submit(View* view, const char* text);
+
+// sim_main.c: the scripted input source driving view_dispatcher_run
+typedef enum {
+    SimStepInput,
+    SimStepText,
+    SimStepWait,
+    SimStepEnd,
+} SimStepKind;
+
+typedef struct {
+    SimStepKind type;
+    InputKey key;
+    InputType input_type;
+    uint32_t wait_ms;
+    char text[128];
+    char line[160];
+} SimStep;
+
+bool sim_script_next(SimStep* step);
+void sim_frame_dump(const SimCanvas* canvas, const char* label);
+
+// sim_storage.c: "/ext" and "/int" are mapped below a host directory
+void sim_storage_set_root(const char* root);
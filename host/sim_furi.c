@@ -0,0 +1,387 @@
+// Host stand-ins for the furi core: records, time, threads, thread flags, mutexes
+// and the heap statistics. Allocations are counted through the linker's --wrap.
+
+#define _GNU_SOURCE
+#include "sim.h"
+
+#include <furi_hal.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define SIM_HEAP_SIZE (160 * 1024)
+#define SIM_STACK_SPACE (16 * 1024)
+
+struct FuriThread {
+    pthread_t pthread;
+    const char* name;
+    uint32_t stack_size;
+    FuriThreadCallback callback;
+    void* context;
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    uint32_t flags;
+    bool started;
+};
+
+struct FuriMutex {
+    pthread_mutex_t mutex;
+};
+
+static FuriThread sim_main_thread;
+static __thread FuriThread* sim_thread_self;
+static struct timespec sim_start_time;
+
+static atomic_size_t sim_heap_used;
+static atomic_size_t sim_heap_peak;
+static uint32_t sim_scene = 0;
+static SimSceneStats sim_stats[SIM_MAX_SCENES];
+
+void sim_furi_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &sim_start_time);
+    pthread_mutex_init(&sim_main_thread.lock, NULL);
+    pthread_cond_init(&sim_main_thread.signal, NULL);
+    sim_main_thread.name = "main";
+    sim_main_thread.pthread = pthread_self();
+    sim_thread_self = &sim_main_thread;
+}
+
+void sim_log(char level, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%6lu [%c][%s] ", (unsigned long)furi_get_tick(), level, tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// Scene attribution
+
+uint32_t sim_current_scene(void) {
+    return sim_scene;
+}
+
+void sim_set_current_scene(uint32_t scene_id) {
+    sim_scene = scene_id < SIM_MAX_SCENES ? scene_id : SIM_MAX_SCENES - 1;
+}
+
+SimSceneStats* sim_scene_stats(uint32_t scene_id) {
+    return &sim_stats[scene_id < SIM_MAX_SCENES ? scene_id : SIM_MAX_SCENES - 1];
+}
+
+void sim_count_allocation(size_t size) {
+    SimSceneStats* stats = sim_scene_stats(sim_scene);
+    stats->allocations++;
+    stats->allocated_bytes += size;
+}
+
+// Heap: every allocation made by the app and its libraries goes through these
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static void sim_heap_add(void* ptr) {
+    size_t used = atomic_fetch_add(&sim_heap_used, malloc_usable_size(ptr)) + malloc_usable_size(ptr);
+    size_t peak = atomic_load(&sim_heap_peak);
+    while(used > peak && !atomic_compare_exchange_weak(&sim_heap_peak, &peak, used)) {
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    if(ptr) {
+        sim_heap_add(ptr);
+        sim_count_allocation(size);
+    }
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    if(ptr) {
+        sim_heap_add(ptr);
+        sim_count_allocation(count * size);
+    }
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if(ptr) atomic_fetch_sub(&sim_heap_used, malloc_usable_size(ptr));
+    void* result = __real_realloc(ptr, size);
+    if(result) {
+        sim_heap_add(result);
+        sim_count_allocation(size);
+    } else if(ptr) {
+        sim_heap_add(ptr);
+    }
+    return result;
+}
+
+void __wrap_free(void* ptr) {
+    if(ptr) atomic_fetch_sub(&sim_heap_used, malloc_usable_size(ptr));
+    __real_free(ptr);
+}
+
+size_t sim_heap_in_use(void) {
+    return atomic_load(&sim_heap_used);
+}
+
+size_t memmgr_get_free_heap(void) {
+    return SIM_HEAP_SIZE - atomic_load(&sim_heap_used);
+}
+
+size_t memmgr_get_minimum_free_heap(void) {
+    return SIM_HEAP_SIZE - atomic_load(&sim_heap_peak);
+}
+
+size_t memmgr_heap_get_max_free_block(void) {
+    return memmgr_get_free_heap();
+}
+
+// Records
+
+static int sim_gui_record;
+static int sim_storage_record;
+
+void* furi_record_open(const char* name) {
+    if(strcmp(name, RECORD_GUI) == 0) return &sim_gui_record;
+    if(strcmp(name, RECORD_STORAGE) == 0) return &sim_storage_record;
+    return NULL;
+}
+
+void furi_record_close(const char* name) {
+    UNUSED(name);
+}
+
+// Time
+
+uint32_t furi_get_tick(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - sim_start_time.tv_sec) * 1000 +
+           (now.tv_nsec - sim_start_time.tv_nsec) / 1000000;
+}
+
+uint32_t furi_ms_to_ticks(uint32_t ms) {
+    return ms;
+}
+
+void furi_delay_ms(uint32_t ms) {
+    struct timespec delay = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+}
+
+void furi_hal_rtc_get_datetime(DateTime* datetime) {
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    datetime->year = local.tm_year + 1900;
+    datetime->month = local.tm_mon + 1;
+    datetime->day = local.tm_mday;
+    datetime->hour = local.tm_hour;
+    datetime->minute = local.tm_min;
+    datetime->second = local.tm_sec;
+    datetime->weekday = local.tm_wday == 0 ? 7 : local.tm_wday;
+}
+
+uint32_t furi_hal_rtc_get_timestamp(void) {
+    return (uint32_t)time(NULL);
+}
+
+uint32_t furi_hal_random_get(void) {
+    return (uint32_t)rand();
+}
+
+uint32_t furi_hal_cortex_instructions_per_microsecond(void) {
+    return 64;
+}
+
+// start reads a cycle counter running at the device's 64 MHz
+FuriHalCortexTimer furi_hal_cortex_timer_get(uint32_t timeout_us) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    FuriHalCortexTimer timer = {
+        .start = (uint32_t)(now.tv_sec * 64000000ull + now.tv_nsec * 64 / 1000),
+        .value = timeout_us * 64,
+    };
+    return timer;
+}
+
+// Threads
+
+static void* sim_thread_entry(void* arg) {
+    FuriThread* thread = arg;
+    sim_thread_self = thread;
+    thread->callback(thread->context);
+    return NULL;
+}
+
+FuriThread* furi_thread_alloc_ex(
+    const char* name,
+    uint32_t stack_size,
+    FuriThreadCallback callback,
+    void* context) {
+    FuriThread* thread = calloc(1, sizeof(FuriThread));
+    thread->name = name;
+    thread->stack_size = stack_size;
+    thread->callback = callback;
+    thread->context = context;
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->signal, NULL);
+    return thread;
+}
+
+void furi_thread_free(FuriThread* thread) {
+    pthread_mutex_destroy(&thread->lock);
+    pthread_cond_destroy(&thread->signal);
+    free(thread);
+}
+
+void furi_thread_start(FuriThread* thread) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // Host frames are larger than on the Cortex-M4; keep a generous floor
+    size_t stack_size = thread->stack_size * 8;
+    if(stack_size < (size_t)PTHREAD_STACK_MIN) stack_size = PTHREAD_STACK_MIN;
+    pthread_attr_setstacksize(&attr, stack_size);
+    thread->started = pthread_create(&thread->pthread, &attr, sim_thread_entry, thread) == 0;
+    pthread_attr_destroy(&attr);
+}
+
+bool furi_thread_join(FuriThread* thread) {
+    if(thread->started) pthread_join(thread->pthread, NULL);
+    thread->started = false;
+    return true;
+}
+
+FuriThreadId furi_thread_get_id(FuriThread* thread) {
+    return thread;
+}
+
+FuriThreadId furi_thread_get_current_id(void) {
+    return sim_thread_self;
+}
+
+void furi_thread_set_priority(FuriThread* thread, FuriThreadPriority priority) {
+    UNUSED(thread);
+    UNUSED(priority);
+}
+
+void furi_thread_set_current_priority(FuriThreadPriority priority) {
+    UNUSED(priority);
+}
+
+// Host stacks are megabytes and have no watermark: report the free stack below the
+// caller, capped, which is what stack painting needs to stay in bounds
+uint32_t furi_thread_get_stack_space(FuriThreadId thread_id) {
+    if(thread_id != sim_thread_self) return 0;
+    
+    pthread_attr_t attr;
+    void* stack_low;
+    size_t stack_size;
+    if(pthread_getattr_np(pthread_self(), &attr) != 0) return 0;
+    pthread_attr_getstack(&attr, &stack_low, &stack_size);
+    pthread_attr_destroy(&attr);
+    
+    uint8_t probe;
+    size_t space = (uintptr_t)&probe - (uintptr_t)stack_low;
+    return space < SIM_STACK_SPACE ? space : SIM_STACK_SPACE;
+}
+
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags) {
+    FuriThread* thread = thread_id;
+    pthread_mutex_lock(&thread->lock);
+    thread->flags |= flags;
+    uint32_t result = thread->flags;
+    pthread_cond_broadcast(&thread->signal);
+    pthread_mutex_unlock(&thread->lock);
+    return result;
+}
+
+uint32_t furi_thread_flags_get(void) {
+    FuriThread* thread = sim_thread_self;
+    pthread_mutex_lock(&thread->lock);
+    uint32_t result = thread->flags;
+    pthread_mutex_unlock(&thread->lock);
+    return result;
+}
+
+uint32_t furi_thread_flags_clear(uint32_t flags) {
+    FuriThread* thread = sim_thread_self;
+    pthread_mutex_lock(&thread->lock);
+    uint32_t result = thread->flags;
+    thread->flags &= ~flags;
+    pthread_mutex_unlock(&thread->lock);
+    return result;
+}
+
+uint32_t furi_thread_flags_wait(uint32_t flags, uint32_t options, uint32_t timeout) {
+    FuriThread* thread = sim_thread_self;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    
+    pthread_mutex_lock(&thread->lock);
+    uint32_t result = FuriFlagError | (uint32_t)FuriStatusErrorTimeout;
+    while(true) {
+        uint32_t pending = thread->flags & flags;
+        bool done = (options & FuriFlagWaitAll) ? (pending == flags) : (pending != 0);
+        if(done) {
+            result = pending;
+            if(!(options & FuriFlagNoClear)) thread->flags &= ~pending;
+            break;
+        }
+        if(timeout == 0) break;
+        if(timeout == FuriWaitForever) {
+            pthread_cond_wait(&thread->signal, &thread->lock);
+        } else if(pthread_cond_timedwait(&thread->signal, &thread->lock, &deadline) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&thread->lock);
+    
+    return result;
+}
+
+// Mutexes
+
+FuriMutex* furi_mutex_alloc(FuriMutexType type) {
+    FuriMutex* mutex = calloc(1, sizeof(FuriMutex));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if(type == FuriMutexTypeRecursive) pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return mutex;
+}
+
+void furi_mutex_free(FuriMutex* mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+FuriStatus furi_mutex_acquire(FuriMutex* mutex, uint32_t timeout) {
+    if(timeout == FuriWaitForever) {
+        return pthread_mutex_lock(&mutex->mutex) == 0 ? FuriStatusOk : FuriStatusError;
+    }
+    
+    uint32_t start = furi_get_tick();
+    while(pthread_mutex_trylock(&mutex->mutex) != 0) {
+        if(furi_get_tick() - start >= timeout) return FuriStatusErrorTimeout;
+        furi_delay_ms(1);
+    }
+    return FuriStatusOk;
+}
+
+FuriStatus furi_mutex_release(FuriMutex* mutex) {
+    return pthread_mutex_unlock(&mutex->mutex) == 0 ? FuriStatusOk : FuriStatusError;
+}
@@ -0,0 +1,1078 @@
+// Host stand-ins for the GUI stack: canvas, views, view dispatcher, scene manager
+// and the stock modules the app uses. Every draw call is counted so the cost of a
+// frame can be compared between scenes and between revisions.
+
+#include "sim.h"
+
+#include <gui/elements.h>
+#include <gui/gui.h>
+#include <gui/modules/popup.h>
+#include <gui/modules/submenu.h>
+#include <gui/modules/text_input.h>
+#include <gui/modules/widget.h>
+#include <gui/scene_manager.h>
+#include <gui/view_dispatcher.h>
+#include <pthread.h>
+
+// Canvas
+
+void sim_canvas_reset(SimCanvas* canvas) {
+    memset(canvas, 0, sizeof(SimCanvas));
+    canvas->color = ColorBlack;
+}
+
+static void sim_canvas_set(Canvas* canvas, int32_t x, int32_t y) {
+    if(x < 0 || y < 0 || x >= SIM_SCREEN_WIDTH || y >= SIM_SCREEN_HEIGHT) return;
+    uint8_t* pixel = &canvas->pixels[y][x];
+    switch(canvas->color) {
+    case ColorBlack:
+        *pixel = 1;
+        break;
+    case ColorWhite:
+        *pixel = 0;
+        break;
+    case ColorXOR:
+        *pixel ^= 1;
+        break;
+    }
+    canvas->pixels_drawn++;
+}
+
+void canvas_clear(Canvas* canvas) {
+    memset(canvas->pixels, 0, sizeof(canvas->pixels));
+    canvas->draw_calls++;
+}
+
+void canvas_set_color(Canvas* canvas, Color color) {
+    canvas->color = color;
+}
+
+void canvas_set_font(Canvas* canvas, Font font) {
+    canvas->font = font;
+}
+
+size_t canvas_width(const Canvas* canvas) {
+    UNUSED(canvas);
+    return SIM_SCREEN_WIDTH;
+}
+
+size_t canvas_height(const Canvas* canvas) {
+    UNUSED(canvas);
+    return SIM_SCREEN_HEIGHT;
+}
+
+uint16_t canvas_string_width(Canvas* canvas, const char* str) {
+    return strlen(str) * (canvas->font == FontPrimary ? 6 : 5);
+}
+
+// There are no fonts on the host; strings are recorded and listed with the frame
+void canvas_draw_str(Canvas* canvas, int32_t x, int32_t y, const char* str) {
+    canvas->draw_calls++;
+    if(canvas->string_count < SIM_MAX_STRINGS) {
+        snprintf(
+            canvas->strings[canvas->string_count++],
+            sizeof(canvas->strings[0]),
+            "(%ld,%ld) %s",
+            (long)x,
+            (long)y,
+            str);
+    }
+}
+
+void canvas_draw_str_aligned(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    Align horizontal,
+    Align vertical,
+    const char* str) {
+    UNUSED(horizontal);
+    UNUSED(vertical);
+    canvas_draw_str(canvas, x, y, str);
+}
+
+void canvas_draw_xbm(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t width,
+    size_t height,
+    const uint8_t* bitmap) {
+    canvas->draw_calls++;
+    canvas->bitmaps++;
+    size_t stride = (width + 7) / 8;
+    for(size_t row = 0; row < height; row++) {
+        for(size_t col = 0; col < width; col++) {
+            if(bitmap[row * stride + col / 8] & (1 << (col & 7))) {
+                sim_canvas_set(canvas, x + col, y + row);
+            }
+        }
+    }
+}
+
+void canvas_draw_dot(Canvas* canvas, int32_t x, int32_t y) {
+    canvas->draw_calls++;
+    sim_canvas_set(canvas, x, y);
+}
+
+void canvas_draw_box(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height) {
+    canvas->draw_calls++;
+    for(size_t row = 0; row < height; row++) {
+        for(size_t col = 0; col < width; col++) {
+            sim_canvas_set(canvas, x + col, y + row);
+        }
+    }
+}
+
+void canvas_draw_frame(Canvas* canvas, int32_t x, int32_t y, size_t width, size_t height) {
+    canvas->draw_calls++;
+    for(size_t col = 0; col < width; col++) {
+        sim_canvas_set(canvas, x + col, y);
+        sim_canvas_set(canvas, x + col, y + height - 1);
+    }
+    for(size_t row = 1; row + 1 < height; row++) {
+        sim_canvas_set(canvas, x, y + row);
+        sim_canvas_set(canvas, x + width - 1, y + row);
+    }
+}
+
+void canvas_draw_rframe(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    size_t width,
+    size_t height,
+    size_t radius) {
+    UNUSED(radius);
+    canvas_draw_frame(canvas, x, y, width, height);
+}
+
+void canvas_draw_line(Canvas* canvas, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    canvas->draw_calls++;
+    int32_t dx = abs(x2 - x1), dy = -abs(y2 - y1);
+    int32_t sx = x1 < x2 ? 1 : -1, sy = y1 < y2 ? 1 : -1;
+    int32_t error = dx + dy;
+    while(true) {
+        sim_canvas_set(canvas, x1, y1);
+        if(x1 == x2 && y1 == y2) break;
+        int32_t e2 = 2 * error;
+        if(e2 >= dy) {
+            error += dy;
+            x1 += sx;
+        }
+        if(e2 <= dx) {
+            error += dx;
+            y1 += sy;
+        }
+    }
+}
+
+// Elements
+
+static void sim_elements_button(Canvas* canvas, int32_t x, const char* label) {
+    canvas_draw_box(canvas, x, SIM_SCREEN_HEIGHT - 12, strlen(label) * 5 + 10, 12);
+    canvas_draw_str(canvas, x + 2, SIM_SCREEN_HEIGHT - 2, label);
+}
+
+void elements_button_left(Canvas* canvas, const char* str) {
+    sim_elements_button(canvas, 0, str);
+}
+
+void elements_button_right(Canvas* canvas, const char* str) {
+    sim_elements_button(canvas, SIM_SCREEN_WIDTH - (strlen(str) * 5 + 10), str);
+}
+
+void elements_button_center(Canvas* canvas, const char* str) {
+    sim_elements_button(canvas, (SIM_SCREEN_WIDTH - (strlen(str) * 5 + 10)) / 2, str);
+}
+
+void elements_progress_bar(Canvas* canvas, int32_t x, int32_t y, size_t width, float progress) {
+    canvas_draw_frame(canvas, x, y, width, 8);
+    canvas_draw_box(canvas, x + 1, y + 1, (width - 2) * progress, 6);
+}
+
+void elements_multiline_text_aligned(
+    Canvas* canvas,
+    int32_t x,
+    int32_t y,
+    Align horizontal,
+    Align vertical,
+    const char* text) {
+    canvas_draw_str_aligned(canvas, x, y, horizontal, vertical, text);
+}
+
+// View
+
+struct View {
+    ViewDrawCallback draw_callback;
+    ViewInputCallback input_callback;
+    void* context;
+    void* model;
+    pthread_mutex_t lock;
+    uint32_t (*element_count)(View* view);
+    bool (*submit_text)(View* view, const char* text);
+};
+
+View* view_alloc(void) {
+    View* view = calloc(1, sizeof(View));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&view->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return view;
+}
+
+void view_free(View* view) {
+    free(view->model);
+    pthread_mutex_destroy(&view->lock);
+    free(view);
+}
+
+void view_set_context(View* view, void* context) {
+    view->context = context;
+}
+
+void view_set_draw_callback(View* view, ViewDrawCallback callback) {
+    view->draw_callback = callback;
+}
+
+void view_set_input_callback(View* view, ViewInputCallback callback) {
+    view->input_callback = callback;
+}
+
+void view_allocate_model(View* view, ViewModelType type, size_t size) {
+    UNUSED(type);
+    view->model = calloc(1, size);
+}
+
+void* view_get_model(View* view) {
+    pthread_mutex_lock(&view->lock);
+    return view->model;
+}
+
+void view_commit_model(View* view, bool update) {
+    UNUSED(update);
+    pthread_mutex_unlock(&view->lock);
+}
+
+void sim_view_draw(View* view, SimCanvas* canvas) {
+    if(!view || !view->draw_callback) return;
+    pthread_mutex_lock(&view->lock);
+    view->draw_callback(canvas, view->model);
+    pthread_mutex_unlock(&view->lock);
+}
+
+bool sim_view_input(View* view, InputEvent* event) {
+    if(!view || !view->input_callback) return false;
+    return view->input_callback(event, view->context);
+}
+
+uint32_t sim_widget_element_count(View* view) {
+    return (view && view->element_count) ? view->element_count(view) : 0;
+}
+
+bool sim_text_input_submit(View* view, const char* text) {
+    return (view && view->submit_text) ? view->submit_text(view, text) : false;
+}
+
+// View dispatcher
+
+#define SIM_MAX_VIEWS 16
+#define SIM_EVENT_QUEUE 64
+
+struct ViewDispatcher {
+    View* views[SIM_MAX_VIEWS];
+    uint32_t current;
+    bool running;
+    void* context;
+    ViewDispatcherCustomEventCallback custom_callback;
+    ViewDispatcherNavigationEventCallback navigation_callback;
+    ViewDispatcherTickEventCallback tick_callback;
+    uint32_t tick_period;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    uint32_t events[SIM_EVENT_QUEUE];
+    uint32_t event_head;
+    uint32_t event_count;
+};
+
+ViewDispatcher* view_dispatcher_alloc(void) {
+    ViewDispatcher* dispatcher = calloc(1, sizeof(ViewDispatcher));
+    dispatcher->current = UINT32_MAX;
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->signal, NULL);
+    return dispatcher;
+}
+
+void view_dispatcher_free(ViewDispatcher* dispatcher) {
+    pthread_mutex_destroy(&dispatcher->lock);
+    pthread_cond_destroy(&dispatcher->signal);
+    free(dispatcher);
+}
+
+void view_dispatcher_enable_queue(ViewDispatcher* dispatcher) {
+    UNUSED(dispatcher);
+}
+
+void view_dispatcher_send_custom_event(ViewDispatcher* dispatcher, uint32_t event) {
+    pthread_mutex_lock(&dispatcher->lock);
+    if(dispatcher->event_count < SIM_EVENT_QUEUE) {
+        dispatcher->events[(dispatcher->event_head + dispatcher->event_count++) % SIM_EVENT_QUEUE] =
+            event;
+    } else {
+        sim_log('E', "sim", "custom event queue overflow, dropped %lu", (unsigned long)event);
+    }
+    pthread_cond_broadcast(&dispatcher->signal);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+void view_dispatcher_set_custom_event_callback(
+    ViewDispatcher* dispatcher,
+    ViewDispatcherCustomEventCallback callback) {
+    dispatcher->custom_callback = callback;
+}
+
+void view_dispatcher_set_navigation_event_callback(
+    ViewDispatcher* dispatcher,
+    ViewDispatcherNavigationEventCallback callback) {
+    dispatcher->navigation_callback = callback;
+}
+
+void view_dispatcher_set_tick_event_callback(
+    ViewDispatcher* dispatcher,
+    ViewDispatcherTickEventCallback callback,
+    uint32_t tick_period) {
+    dispatcher->tick_callback = callback;
+    dispatcher->tick_period = tick_period;
+}
+
+void view_dispatcher_set_event_callback_context(ViewDispatcher* dispatcher, void* context) {
+    dispatcher->context = context;
+}
+
+void view_dispatcher_add_view(ViewDispatcher* dispatcher, uint32_t view_id, View* view) {
+    if(view_id < SIM_MAX_VIEWS) dispatcher->views[view_id] = view;
+}
+
+void view_dispatcher_remove_view(ViewDispatcher* dispatcher, uint32_t view_id) {
+    if(view_id < SIM_MAX_VIEWS) dispatcher->views[view_id] = NULL;
+    if(dispatcher->current == view_id) dispatcher->current = UINT32_MAX;
+}
+
+void view_dispatcher_switch_to_view(ViewDispatcher* dispatcher, uint32_t view_id) {
+    dispatcher->current = view_id;
+}
+
+void view_dispatcher_attach_to_gui(ViewDispatcher* dispatcher, Gui* gui, ViewDispatcherType type) {
+    UNUSED(dispatcher);
+    UNUSED(gui);
+    UNUSED(type);
+}
+
+void view_dispatcher_stop(ViewDispatcher* dispatcher) {
+    dispatcher->running = false;
+}
+
+static View* sim_dispatcher_current_view(ViewDispatcher* dispatcher) {
+    return dispatcher->current < SIM_MAX_VIEWS ? dispatcher->views[dispatcher->current] : NULL;
+}
+
+// Delivers queued custom events; waits up to timeout_ms for the first one
+static void sim_dispatcher_drain(ViewDispatcher* dispatcher, uint32_t timeout_ms) {
+    uint32_t deadline = furi_get_tick() + timeout_ms;
+    uint32_t last_tick = furi_get_tick();
+    
+    while(dispatcher->running) {
+        pthread_mutex_lock(&dispatcher->lock);
+        while(dispatcher->event_count == 0) {
+            uint32_t now = furi_get_tick();
+            if(now >= deadline) break;
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += 1000000L;
+            if(until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&dispatcher->signal, &dispatcher->lock, &until);
+            if(dispatcher->tick_callback && dispatcher->tick_period &&
+               furi_get_tick() - last_tick >= dispatcher->tick_period) {
+                break;
+            }
+        }
+        bool has_event = dispatcher->event_count > 0;
+        uint32_t event = 0;
+        if(has_event) {
+            event = dispatcher->events[dispatcher->event_head];
+            dispatcher->event_head = (dispatcher->event_head + 1) % SIM_EVENT_QUEUE;
+            dispatcher->event_count--;
+        }
+        pthread_mutex_unlock(&dispatcher->lock);
+        
+        if(dispatcher->tick_callback && dispatcher->tick_period &&
+           furi_get_tick() - last_tick >= dispatcher->tick_period) {
+            last_tick = furi_get_tick();
+            dispatcher->tick_callback(dispatcher->context);
+        }
+        
+        if(has_event) {
+            if(dispatcher->custom_callback) {
+                dispatcher->custom_callback(dispatcher->context, event);
+            }
+        } else if(furi_get_tick() >= deadline) {
+            break;
+        }
+    }
+}
+
+static void sim_dispatcher_input(ViewDispatcher* dispatcher, InputKey key, InputType type) {
+    InputType sequence[4] = {InputTypePress, type, InputTypeRelease, InputTypeMAX};
+    if(type == InputTypeRepeat) {
+        sequence[1] = InputTypeLong;
+        sequence[2] = InputTypeRepeat;
+        sequence[3] = InputTypeRelease;
+    }
+    
+    for(size_t i = 0; i < COUNT_OF(sequence) && sequence[i] != InputTypeMAX; i++) {
+        InputEvent event = {.sequence = 1, .key = key, .type = sequence[i]};
+        bool consumed = sim_view_input(sim_dispatcher_current_view(dispatcher), &event);
+        if(!consumed && key == InputKeyBack && event.type == InputTypeShort) {
+            if(!dispatcher->navigation_callback ||
+               !dispatcher->navigation_callback(dispatcher->context)) {
+                view_dispatcher_stop(dispatcher);
+                return;
+            }
+        }
+        // Let the app react between press and release, like the firmware's queue does
+        sim_dispatcher_drain(dispatcher, 0);
+    }
+}
+
+static void sim_dispatcher_render(ViewDispatcher* dispatcher, const char* label) {
+    SimCanvas canvas;
+    sim_canvas_reset(&canvas);
+    View* view = sim_dispatcher_current_view(dispatcher);
+    sim_view_draw(view, &canvas);
+    
+    SimSceneStats* stats = sim_scene_stats(sim_current_scene());
+    stats->frames++;
+    stats->draw_calls += canvas.draw_calls;
+    stats->pixels_drawn += canvas.pixels_drawn;
+    uint32_t elements = sim_widget_element_count(view);
+    if(elements > stats->max_widget_elements) stats->max_widget_elements = elements;
+    
+    sim_frame_dump(&canvas, label);
+}
+
+void view_dispatcher_run(ViewDispatcher* dispatcher) {
+    dispatcher->running = true;
+    sim_dispatcher_drain(dispatcher, 0);
+    sim_dispatcher_render(dispatcher, "start");
+    
+    SimStep step;
+    while(dispatcher->running && sim_script_next(&step)) {
+        switch(step.type) {
+        case SimStepInput:
+            sim_dispatcher_input(dispatcher, step.key, step.input_type);
+            break;
+        case SimStepText:
+            if(!sim_text_input_submit(sim_dispatcher_current_view(dispatcher), step.text)) {
+                sim_log('W', "sim", "'%s': current view is not a text input", step.line);
+            }
+            break;
+        case SimStepWait:
+            sim_dispatcher_drain(dispatcher, step.wait_ms);
+            break;
+        case SimStepEnd:
+            dispatcher->running = false;
+            break;
+        }
+        sim_dispatcher_drain(dispatcher, 0);
+        if(dispatcher->running) sim_dispatcher_render(dispatcher, step.line);
+    }
+    
+    dispatcher->running = false;
+}
+
+// Scene manager
+
+struct SceneManager {
+    const SceneManagerHandlers* handlers;
+    void* context;
+    uint32_t stack[SIM_MAX_SCENES];
+    uint32_t depth;
+    uint32_t states[SIM_MAX_SCENES];
+};
+
+SceneManager* scene_manager_alloc(const SceneManagerHandlers* handlers, void* context) {
+    SceneManager* manager = calloc(1, sizeof(SceneManager));
+    manager->handlers = handlers;
+    manager->context = context;
+    return manager;
+}
+
+// Like the firmware, freeing does not run on_exit: the views may already be gone
+void scene_manager_free(SceneManager* manager) {
+    free(manager);
+}
+
+void scene_manager_set_scene_state(SceneManager* manager, uint32_t scene_id, uint32_t state) {
+    if(scene_id < SIM_MAX_SCENES) manager->states[scene_id] = state;
+}
+
+uint32_t scene_manager_get_scene_state(const SceneManager* manager, uint32_t scene_id) {
+    return scene_id < SIM_MAX_SCENES ? manager->states[scene_id] : 0;
+}
+
+static void sim_scene_enter(SceneManager* manager, uint32_t scene_id) {
+    sim_set_current_scene(scene_id);
+    sim_scene_stats(scene_id)->enters++;
+    manager->handlers->on_enter_handlers[scene_id](manager->context);
+}
+
+bool scene_manager_handle_custom_event(SceneManager* manager, uint32_t custom_event) {
+    if(manager->depth == 0) return false;
+    SceneManagerEvent event = {.type = SceneManagerEventTypeCustom, .event = custom_event};
+    return manager->handlers->on_event_handlers[manager->stack[manager->depth - 1]](
+        manager->context, event);
+}
+
+bool scene_manager_handle_back_event(SceneManager* manager) {
+    if(manager->depth == 0) return false;
+    SceneManagerEvent event = {.type = SceneManagerEventTypeBack, .event = 0};
+    bool consumed = manager->handlers->on_event_handlers[manager->stack[manager->depth - 1]](
+        manager->context, event);
+    if(!consumed) consumed = scene_manager_previous_scene(manager);
+    return consumed;
+}
+
+void scene_manager_handle_tick_event(SceneManager* manager) {
+    if(manager->depth == 0) return;
+    SceneManagerEvent event = {.type = SceneManagerEventTypeTick, .event = 0};
+    manager->handlers->on_event_handlers[manager->stack[manager->depth - 1]](
+        manager->context, event);
+}
+
+void scene_manager_next_scene(SceneManager* manager, uint32_t next_scene_id) {
+    if(manager->depth > 0) {
+        manager->handlers->on_exit_handlers[manager->stack[manager->depth - 1]](manager->context);
+    }
+    if(manager->depth < SIM_MAX_SCENES) manager->stack[manager->depth++] = next_scene_id;
+    sim_scene_enter(manager, next_scene_id);
+}
+
+bool scene_manager_previous_scene(SceneManager* manager) {
+    if(manager->depth == 0) return false;
+    manager->handlers->on_exit_handlers[manager->stack[--manager->depth]](manager->context);
+    if(manager->depth == 0) return false;
+    sim_scene_enter(manager, manager->stack[manager->depth - 1]);
+    return true;
+}
+
+bool scene_manager_has_previous_scene(const SceneManager* manager, uint32_t scene_id) {
+    for(uint32_t i = 0; i + 1 < manager->depth; i++) {
+        if(manager->stack[i] == scene_id) return true;
+    }
+    return false;
+}
+
+bool scene_manager_search_and_switch_to_previous_scene(SceneManager* manager, uint32_t scene_id) {
+    if(!scene_manager_has_previous_scene(manager, scene_id)) return false;
+    manager->handlers->on_exit_handlers[manager->stack[manager->depth - 1]](manager->context);
+    while(manager->stack[manager->depth - 1] != scene_id) manager->depth--;
+    sim_scene_enter(manager, scene_id);
+    return true;
+}
+
+bool scene_manager_search_and_switch_to_another_scene(SceneManager* manager, uint32_t scene_id) {
+    if(manager->depth == 0) return false;
+    manager->handlers->on_exit_handlers[manager->stack[manager->depth - 1]](manager->context);
+    manager->depth = 1;
+    manager->stack[manager->depth++] = scene_id;
+    sim_scene_enter(manager, scene_id);
+    return true;
+}
+
+void scene_manager_stop(SceneManager* manager) {
+    if(manager->depth > 0) {
+        manager->handlers->on_exit_handlers[manager->stack[manager->depth - 1]](manager->context);
+    }
+}
+
+// Submenu
+
+// libc's strdup allocates behind the heap accounting's back
+static char* sim_strdup(const char* text) {
+    size_t size = strlen(text) + 1;
+    return memcpy(malloc(size), text, size);
+}
+
+typedef struct {
+    char* label;
+    uint32_t index;
+    SubmenuItemCallback callback;
+    void* context;
+} SimSubmenuItem;
+
+struct Submenu {
+    View* view;
+    char header[64];
+    SimSubmenuItem* items;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t selected;
+};
+
+static void sim_submenu_draw(Canvas* canvas, void* model) {
+    Submenu* submenu = *(Submenu**)model;
+    canvas_clear(canvas);
+    if(submenu->header[0]) canvas_draw_str(canvas, 2, 9, submenu->header);
+    
+    // Four visible rows, scrolled to keep the selection in view
+    uint32_t first = submenu->selected > 2 ? submenu->selected - 2 : 0;
+    for(uint32_t i = first; i < submenu->count && i < first + 4; i++) {
+        int32_t y = 12 + (i - first) * 13;
+        if(i == submenu->selected) {
+            canvas_draw_box(canvas, 0, y, SIM_SCREEN_WIDTH - 5, 12);
+        }
+        canvas_draw_str(canvas, 6, y + 9, submenu->items[i].label);
+    }
+}
+
+static bool sim_submenu_input(InputEvent* event, void* context) {
+    Submenu* submenu = context;
+    if(event->type != InputTypeShort && event->type != InputTypeRepeat) return false;
+    if(submenu->count == 0) return false;
+    
+    switch(event->key) {
+    case InputKeyUp:
+        submenu->selected = (submenu->selected + submenu->count - 1) % submenu->count;
+        return true;
+    case InputKeyDown:
+        submenu->selected = (submenu->selected + 1) % submenu->count;
+        return true;
+    case InputKeyOk: {
+        if(event->type != InputTypeShort) return false;
+        SimSubmenuItem* item = &submenu->items[submenu->selected];
+        if(item->callback) item->callback(item->context, item->index);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+Submenu* submenu_alloc(void) {
+    Submenu* submenu = calloc(1, sizeof(Submenu));
+    submenu->view = view_alloc();
+    view_allocate_model(submenu->view, ViewModelTypeLocking, sizeof(Submenu*));
+    *(Submenu**)submenu->view->model = submenu;
+    view_set_context(submenu->view, submenu);
+    view_set_draw_callback(submenu->view, sim_submenu_draw);
+    view_set_input_callback(submenu->view, sim_submenu_input);
+    return submenu;
+}
+
+void submenu_reset(Submenu* submenu) {
+    for(uint32_t i = 0; i < submenu->count; i++) free(submenu->items[i].label);
+    submenu->count = 0;
+    submenu->selected = 0;
+    submenu->header[0] = '\0';
+}
+
+void submenu_free(Submenu* submenu) {
+    submenu_reset(submenu);
+    free(submenu->items);
+    view_free(submenu->view);
+    free(submenu);
+}
+
+View* submenu_get_view(Submenu* submenu) {
+    return submenu->view;
+}
+
+void submenu_add_item(
+    Submenu* submenu,
+    const char* label,
+    uint32_t index,
+    SubmenuItemCallback callback,
+    void* callback_context) {
+    if(submenu->count == submenu->capacity) {
+        submenu->capacity = submenu->capacity ? submenu->capacity * 2 : 8;
+        submenu->items = realloc(submenu->items, submenu->capacity * sizeof(SimSubmenuItem));
+    }
+    submenu->items[submenu->count++] = (SimSubmenuItem){
+        .label = sim_strdup(label),
+        .index = index,
+        .callback = callback,
+        .context = callback_context,
+    };
+}
+
+void submenu_set_selected_item(Submenu* submenu, uint32_t index) {
+    for(uint32_t i = 0; i < submenu->count; i++) {
+        if(submenu->items[i].index == index) submenu->selected = i;
+    }
+}
+
+void submenu_set_header(Submenu* submenu, const char* header) {
+    snprintf(submenu->header, sizeof(submenu->header), "%s", header);
+}
+
+// Text input: scripts submit whole strings with "type <text>"
+
+struct TextInput {
+    View* view;
+    char header[64];
+    TextInputCallback callback;
+    void* context;
+    char* buffer;
+    size_t buffer_size;
+};
+
+static void sim_text_input_draw(Canvas* canvas, void* model) {
+    TextInput* text_input = *(TextInput**)model;
+    canvas_clear(canvas);
+    canvas_draw_str(canvas, 2, 8, text_input->header);
+    canvas_draw_frame(canvas, 0, 12, SIM_SCREEN_WIDTH, 14);
+    if(text_input->buffer) canvas_draw_str(canvas, 4, 22, text_input->buffer);
+}
+
+static bool sim_text_input_submit_text(View* view, const char* text) {
+    TextInput* text_input = *(TextInput**)view->model;
+    if(!text_input->buffer) return false;
+    snprintf(text_input->buffer, text_input->buffer_size, "%s", text);
+    if(text_input->callback) text_input->callback(text_input->context);
+    return true;
+}
+
+TextInput* text_input_alloc(void) {
+    TextInput* text_input = calloc(1, sizeof(TextInput));
+    text_input->view = view_alloc();
+    view_allocate_model(text_input->view, ViewModelTypeLocking, sizeof(TextInput*));
+    *(TextInput**)text_input->view->model = text_input;
+    view_set_draw_callback(text_input->view, sim_text_input_draw);
+    text_input->view->submit_text = sim_text_input_submit_text;
+    return text_input;
+}
+
+void text_input_free(TextInput* text_input) {
+    view_free(text_input->view);
+    free(text_input);
+}
+
+void text_input_reset(TextInput* text_input) {
+    text_input->header[0] = '\0';
+    text_input->callback = NULL;
+    text_input->buffer = NULL;
+}
+
+View* text_input_get_view(TextInput* text_input) {
+    return text_input->view;
+}
+
+void text_input_set_result_callback(
+    TextInput* text_input,
+    TextInputCallback callback,
+    void* callback_context,
+    char* text_buffer,
+    size_t text_buffer_size,
+    bool clear_default_text) {
+    text_input->callback = callback;
+    text_input->context = callback_context;
+    text_input->buffer = text_buffer;
+    text_input->buffer_size = text_buffer_size;
+    if(clear_default_text && text_buffer_size > 0) text_buffer[0] = '\0';
+}
+
+void text_input_set_header_text(TextInput* text_input, const char* text) {
+    snprintf(text_input->header, sizeof(text_input->header), "%s", text);
+}
+
+// Popup
+
+struct Popup {
+    View* view;
+    char header[64];
+    char text[64];
+    PopupCallback callback;
+    void* context;
+};
+
+static void sim_popup_draw(Canvas* canvas, void* model) {
+    Popup* popup = *(Popup**)model;
+    canvas_clear(canvas);
+    if(popup->header[0]) canvas_draw_str(canvas, 64, 10, popup->header);
+    if(popup->text[0]) canvas_draw_str(canvas, 64, 32, popup->text);
+}
+
+static bool sim_popup_input(InputEvent* event, void* context) {
+    Popup* popup = context;
+    if(event->key == InputKeyBack || !popup->callback) return false;
+    if(event->type == InputTypeShort) popup->callback(popup->context);
+    return true;
+}
+
+Popup* popup_alloc(void) {
+    Popup* popup = calloc(1, sizeof(Popup));
+    popup->view = view_alloc();
+    view_allocate_model(popup->view, ViewModelTypeLocking, sizeof(Popup*));
+    *(Popup**)popup->view->model = popup;
+    view_set_context(popup->view, popup);
+    view_set_draw_callback(popup->view, sim_popup_draw);
+    view_set_input_callback(popup->view, sim_popup_input);
+    return popup;
+}
+
+void popup_free(Popup* popup) {
+    view_free(popup->view);
+    free(popup);
+}
+
+View* popup_get_view(Popup* popup) {
+    return popup->view;
+}
+
+void popup_set_callback(Popup* popup, PopupCallback callback) {
+    popup->callback = callback;
+}
+
+void popup_set_context(Popup* popup, void* context) {
+    popup->context = context;
+}
+
+void popup_set_header(Popup* popup, const char* text, uint8_t x, uint8_t y, Align h, Align v) {
+    UNUSED(x);
+    UNUSED(y);
+    UNUSED(h);
+    UNUSED(v);
+    snprintf(popup->header, sizeof(popup->header), "%s", text ? text : "");
+}
+
+void popup_set_text(Popup* popup, const char* text, uint8_t x, uint8_t y, Align h, Align v) {
+    UNUSED(x);
+    UNUSED(y);
+    UNUSED(h);
+    UNUSED(v);
+    snprintf(popup->text, sizeof(popup->text), "%s", text ? text : "");
+}
+
+// Timeouts are not simulated; scripts navigate away explicitly
+void popup_set_timeout(Popup* popup, uint32_t timeout_in_ms) {
+    UNUSED(popup);
+    UNUSED(timeout_in_ms);
+}
+
+void popup_enable_timeout(Popup* popup) {
+    UNUSED(popup);
+}
+
+void popup_disable_timeout(Popup* popup) {
+    UNUSED(popup);
+}
+
+void popup_reset(Popup* popup) {
+    popup->header[0] = '\0';
+    popup->text[0] = '\0';
+    popup->callback = NULL;
+}
+
+// Widget
+
+typedef enum {
+    SimWidgetString,
+    SimWidgetButton,
+    SimWidgetFrame,
+} SimWidgetType;
+
+typedef struct {
+    SimWidgetType type;
+    uint8_t x, y, width, height;
+    GuiButtonType button;
+    ButtonCallback callback;
+    void* context;
+    char text[96];
+} SimWidgetElement;
+
+struct Widget {
+    View* view;
+    SimWidgetElement* elements;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static void sim_widget_draw(Canvas* canvas, void* model) {
+    Widget* widget = *(Widget**)model;
+    canvas_clear(canvas);
+    for(uint32_t i = 0; i < widget->count; i++) {
+        SimWidgetElement* element = &widget->elements[i];
+        switch(element->type) {
+        case SimWidgetString:
+            canvas_draw_str(canvas, element->x, element->y, element->text);
+            break;
+        case SimWidgetButton:
+            if(element->button == GuiButtonTypeLeft) elements_button_left(canvas, element->text);
+            if(element->button == GuiButtonTypeCenter) elements_button_center(canvas, element->text);
+            if(element->button == GuiButtonTypeRight) elements_button_right(canvas, element->text);
+            break;
+        case SimWidgetFrame:
+            canvas_draw_frame(canvas, element->x, element->y, element->width, element->height);
+            break;
+        }
+    }
+}
+
+static bool sim_widget_input(InputEvent* event, void* context) {
+    Widget* widget = context;
+    GuiButtonType button;
+    switch(event->key) {
+    case InputKeyLeft:
+        button = GuiButtonTypeLeft;
+        break;
+    case InputKeyOk:
+        button = GuiButtonTypeCenter;
+        break;
+    case InputKeyRight:
+        button = GuiButtonTypeRight;
+        break;
+    default:
+        return false;
+    }
+    
+    bool consumed = false;
+    for(uint32_t i = 0; i < widget->count; i++) {
+        SimWidgetElement* element = &widget->elements[i];
+        if(element->type == SimWidgetButton && element->button == button && element->callback) {
+            element->callback(button, event->type, element->context);
+            consumed = true;
+        }
+    }
+    return consumed;
+}
+
+static uint32_t sim_widget_count(View* view) {
+    return (*(Widget**)view->model)->count;
+}
+
+static SimWidgetElement* sim_widget_add(Widget* widget, SimWidgetType type) {
+    if(widget->count == widget->capacity) {
+        widget->capacity = widget->capacity ? widget->capacity * 2 : 16;
+        widget->elements = realloc(widget->elements, widget->capacity * sizeof(SimWidgetElement));
+    }
+    SimWidgetElement* element = &widget->elements[widget->count++];
+    memset(element, 0, sizeof(SimWidgetElement));
+    element->type = type;
+    return element;
+}
+
+Widget* widget_alloc(void) {
+    Widget* widget = calloc(1, sizeof(Widget));
+    widget->view = view_alloc();
+    view_allocate_model(widget->view, ViewModelTypeLocking, sizeof(Widget*));
+    *(Widget**)widget->view->model = widget;
+    view_set_context(widget->view, widget);
+    view_set_draw_callback(widget->view, sim_widget_draw);
+    view_set_input_callback(widget->view, sim_widget_input);
+    widget->view->element_count = sim_widget_count;
+    return widget;
+}
+
+void widget_free(Widget* widget) {
+    free(widget->elements);
+    view_free(widget->view);
+    free(widget);
+}
+
+void widget_reset(Widget* widget) {
+    widget->count = 0;
+}
+
+View* widget_get_view(Widget* widget) {
+    return widget->view;
+}
+
+void widget_add_string_element(
+    Widget* widget,
+    uint8_t x,
+    uint8_t y,
+    Align horizontal,
+    Align vertical,
+    Font font,
+    const char* text) {
+    UNUSED(horizontal);
+    UNUSED(vertical);
+    UNUSED(font);
+    SimWidgetElement* element = sim_widget_add(widget, SimWidgetString);
+    element->x = x;
+    element->y = y;
+    snprintf(element->text, sizeof(element->text), "%s", text);
+}
+
+void widget_add_string_multiline_element(
+    Widget* widget,
+    uint8_t x,
+    uint8_t y,
+    Align horizontal,
+    Align vertical,
+    Font font,
+    const char* text) {
+    widget_add_string_element(widget, x, y, horizontal, vertical, font, text);
+}
+
+void widget_add_text_box_element(
+    Widget* widget,
+    uint8_t x,
+    uint8_t y,
+    uint8_t width,
+    uint8_t height,
+    Align horizontal,
+    Align vertical,
+    const char* text,
+    bool strip_to_dots) {
+    UNUSED(width);
+    UNUSED(height);
+    UNUSED(strip_to_dots);
+    widget_add_string_element(widget, x, y, horizontal, vertical, FontSecondary, text);
+}
+
+void widget_add_text_scroll_element(
+    Widget* widget,
+    uint8_t x,
+    uint8_t y,
+    uint8_t width,
+    uint8_t height,
+    const char* text) {
+    UNUSED(width);
+    UNUSED(height);
+    widget_add_string_element(widget, x, y, AlignLeft, AlignTop, FontSecondary, text);
+}
+
+void widget_add_button_element(
+    Widget* widget,
+    GuiButtonType button_type,
+    const char* text,
+    ButtonCallback callback,
+    void* context) {
+    SimWidgetElement* element = sim_widget_add(widget, SimWidgetButton);
+    element->button = button_type;
+    element->callback = callback;
+    element->context = context;
+    snprintf(element->text, sizeof(element->text), "%s", text);
+}
+
+void widget_add_frame_element(
+    Widget* widget,
+    uint8_t x,
+    uint8_t y,
+    uint8_t width,
+    uint8_t height,
+    uint8_t radius) {
+    UNUSED(radius);
+    SimWidgetElement* element = sim_widget_add(widget, SimWidgetFrame);
+    element->x = x;
+    element->y = y;
+    element->width = width;
+    element->height = height;
+}
@@ -0,0 +1,285 @@
+// Host simulator entry point: runs the app against a script of key presses and
+// prints every frame, then the per-scene cost counters and the heap balance.
+//
+//   upi_qr_sim [-s script] [-r sd_root] [-o frame_dir] [-q] [-v]
+//
+// With -v every frame is run through the QR decoder; a frame that draws a bitmap
+// with no decodable symbol in it fails the run.
+//
+// Script lines:
+//   press <up|down|left|right|ok|back>   short press
+//   long <key>                           long press
+//   repeat <key>                         long press that also repeats
+//   type <text>                          submit text to the current text input
+//   wait <ms>                            let the worker and timers run
+//   expect <name>=<value>                with -v, the last decoded link must carry
+//                                        the parameter once, percent-decoded to value
+//   end                                  leave the app loop
+// Blank lines and lines starting with '#' are ignored.
+
+#include "sim.h"
+#include "qrdecode.h"
+
+#include <ctype.h>
+#include <sys/stat.h>
+
+// Built with -DSIM_APP_ENTRY=upi_qr_static_app for the static app
+#ifndef SIM_APP_ENTRY
+#define SIM_APP_ENTRY upi_qr_app
+#endif
+
+int32_t SIM_APP_ENTRY(void* p);
+
+static FILE* sim_script;
+static const char* sim_frame_dir;
+static bool sim_quiet;
+static bool sim_verify;
+static bool sim_verify_failed;
+static uint32_t sim_frame_index;
+static char sim_last_payload[512];
+
+static bool sim_parse_key(const char* name, InputKey* key) {
+    static const char* const names[] = {"up", "down", "right", "left", "ok", "back"};
+    for(size_t i = 0; i < COUNT_OF(names); i++) {
+        if(strcmp(name, names[i]) == 0) {
+            *key = (InputKey)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint8_t sim_hex_value(char c) {
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Checks an "expect" line against the payload of the last decoded QR code: the
+// query must hold the parameter exactly once, and its value, with %XX and '+'
+// decoded, must equal the expected text
+static void sim_expect(const char* argument) {
+    if(!sim_verify) return;
+    
+    const char* equals = strchr(argument, '=');
+    size_t name_length = equals ? (size_t)(equals - argument) : strlen(argument);
+    const char* query = strchr(sim_last_payload, '?');
+    uint32_t found = 0;
+    char value[sizeof(sim_last_payload)] = "";
+    
+    while(equals && query) {
+        const char* parameter = query + 1;
+        query = strchr(parameter, '&');
+        if(strncmp(parameter, argument, name_length + 1) != 0) continue;
+        
+        found++;
+        const char* end = query ? query : parameter + strlen(parameter);
+        size_t j = 0;
+        for(const char* c = parameter + name_length + 1; c < end; c++) {
+            if(*c == '%' && end - c > 2 && isxdigit((unsigned char)c[1]) &&
+               isxdigit((unsigned char)c[2])) {
+                value[j++] = sim_hex_value(c[1]) << 4 | sim_hex_value(c[2]);
+                c += 2;
+            } else {
+                value[j++] = *c == '+' ? ' ' : *c;
+            }
+        }
+        value[j] = '\0';
+    }
+    
+    if(!equals || found != 1 || strcmp(value, equals + 1) != 0) {
+        printf("   expect %s failed: found %lu, value '%s'\n", argument, (unsigned long)found, value);
+        sim_verify_failed = true;
+    } else {
+        printf("   expect %s\n", argument);
+    }
+}
+
+bool sim_script_next(SimStep* step) {
+    char line[sizeof(step->line)];
+    while(sim_script && fgets(line, sizeof(line), sim_script)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* command = line;
+        while(isspace((unsigned char)*command)) command++;
+        if(*command == '\0' || *command == '#') continue;
+        
+        memset(step, 0, sizeof(SimStep));
+        snprintf(step->line, sizeof(step->line), "%s", command);
+        char* argument = command + strcspn(command, " \t");
+        if(*argument) *argument++ = '\0';
+        while(isspace((unsigned char)*argument)) argument++;
+        
+        if(strcmp(command, "press") == 0 || strcmp(command, "long") == 0 ||
+           strcmp(command, "repeat") == 0) {
+            if(!sim_parse_key(argument, &step->key)) {
+                sim_log('E', "script", "unknown key '%s'", argument);
+                continue;
+            }
+            step->type = SimStepInput;
+            step->input_type = command[0] == 'p' ? InputTypeShort :
+                               command[0] == 'l' ? InputTypeLong :
+                                                   InputTypeRepeat;
+        } else if(strcmp(command, "type") == 0) {
+            step->type = SimStepText;
+            snprintf(step->text, sizeof(step->text), "%s", argument);
+        } else if(strcmp(command, "wait") == 0) {
+            step->type = SimStepWait;
+            step->wait_ms = strtoul(argument, NULL, 10);
+        } else if(strcmp(command, "expect") == 0) {
+            sim_expect(argument);
+            continue;
+        } else if(strcmp(command, "end") == 0) {
+            step->type = SimStepEnd;
+        } else {
+            sim_log('E', "script", "unknown command '%s'", command);
+            continue;
+        }
+        return true;
+    }
+    
+    // Running out of script is an implicit "end"
+    memset(step, 0, sizeof(SimStep));
+    step->type = SimStepEnd;
+    snprintf(step->line, sizeof(step->line), "end");
+    return true;
+}
+
+// Decodes the QR code on screen, if there is one, and prints its payload
+static void sim_frame_verify(const SimCanvas* canvas) {
+    uint8_t bitmap[SIM_SCREEN_HEIGHT][SIM_SCREEN_WIDTH / 8] = {0};
+    for(int y = 0; y < SIM_SCREEN_HEIGHT; y++) {
+        for(int x = 0; x < SIM_SCREEN_WIDTH; x++) {
+            if(canvas->pixels[y][x]) bitmap[y][x / 8] |= 0x80 >> (x & 7);
+        }
+    }
+    
+    uint8_t payload[512];
+    QRDecodeInfo info;
+    int8_t result = qrdecode_decodeBitmap(
+        &bitmap[0][0],
+        SIM_SCREEN_WIDTH,
+        SIM_SCREEN_HEIGHT,
+        sizeof(bitmap[0]),
+        QR_RASTER_MSB,
+        payload,
+        sizeof(payload),
+        &info);
+    
+    if(result == QRDECODE_OK) {
+        snprintf(sim_last_payload, sizeof(sim_last_payload), "%.*s", (int)info.length, (const char*)payload);
+        printf(
+            "   qr version %u ecc %u mask %u: %.*s\n",
+            info.version,
+            info.ecc,
+            info.mask,
+            (int)info.length,
+            (const char*)payload);
+    } else if(canvas->bitmaps > 0) {
+        printf("   qr decode failed (%d)\n", result);
+        sim_verify_failed = true;
+    }
+}
+
+void sim_frame_dump(const SimCanvas* canvas, const char* label) {
+    uint32_t index = sim_frame_index++;
+    
+    if(sim_frame_dir) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/frame_%04lu.pbm", sim_frame_dir, (unsigned long)index);
+        FILE* file = fopen(path, "w");
+        if(file) {
+            fprintf(file, "P1\n# %s\n%d %d\n", label, SIM_SCREEN_WIDTH, SIM_SCREEN_HEIGHT);
+            for(int y = 0; y < SIM_SCREEN_HEIGHT; y++) {
+                for(int x = 0; x < SIM_SCREEN_WIDTH; x++) {
+                    fputc(canvas->pixels[y][x] ? '1' : '0', file);
+                }
+                fputc('\n', file);
+            }
+            fclose(file);
+        }
+    }
+    
+    printf(
+        "== frame %lu: %s (scene %lu, %lu draw calls)\n",
+        (unsigned long)index,
+        label,
+        (unsigned long)sim_current_scene(),
+        (unsigned long)canvas->draw_calls);
+    for(uint32_t i = 0; i < canvas->string_count; i++) {
+        printf("   text %s\n", canvas->strings[i]);
+    }
+    if(sim_verify) sim_frame_verify(canvas);
+    if(sim_quiet) return;
+    
+    // Two pixel rows per text line keeps a frame readable in a terminal
+    for(int y = 0; y < SIM_SCREEN_HEIGHT; y += 2) {
+        char row[SIM_SCREEN_WIDTH + 1];
+        for(int x = 0; x < SIM_SCREEN_WIDTH; x++) {
+            uint8_t top = canvas->pixels[y][x];
+            uint8_t bottom = canvas->pixels[y + 1][x];
+            row[x] = top && bottom ? '#' : top ? '"' : bottom ? '.' : ' ';
+        }
+        row[SIM_SCREEN_WIDTH] = '\0';
+        printf("   |%s|\n", row);
+    }
+}
+
+static void sim_print_stats(size_t heap_before) {
+    printf("\nscene  enters  frames  draw calls  pixels  allocs  alloc bytes  widget elems\n");
+    for(uint32_t scene = 0; scene < SIM_MAX_SCENES; scene++) {
+        SimSceneStats* stats = sim_scene_stats(scene);
+        if(!stats->enters && !stats->frames && !stats->allocations) continue;
+        printf(
+            "%5lu  %6lu  %6lu  %10llu  %6llu  %6llu  %11llu  %12lu\n",
+            (unsigned long)scene,
+            (unsigned long)stats->enters,
+            (unsigned long)stats->frames,
+            (unsigned long long)stats->draw_calls,
+            (unsigned long long)stats->pixels_drawn,
+            (unsigned long long)stats->allocations,
+            (unsigned long long)stats->allocated_bytes,
+            (unsigned long)stats->max_widget_elements);
+    }
+    printf(
+        "heap: peak %lu bytes, %lu bytes still allocated after exit\n",
+        (unsigned long)(memmgr_get_free_heap() + sim_heap_in_use() -
+                        memmgr_get_minimum_free_heap()),
+        (unsigned long)(sim_heap_in_use() - heap_before));
+}
+
+int main(int argc, char** argv) {
+    const char* script_path = NULL;
+    const char* root = ".";
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            script_path = argv[++i];
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            root = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            sim_frame_dir = argv[++i];
+        } else if(strcmp(argv[i], "-q") == 0) {
+            sim_quiet = true;
+        } else if(strcmp(argv[i], "-v") == 0) {
+            sim_verify = true;
+        } else {
+            fprintf(stderr, "usage: %s [-s script] [-r sd_root] [-o frame_dir] [-q] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    sim_script = script_path ? fopen(script_path, "r") : stdin;
+    if(!sim_script) {
+        perror(script_path);
+        return 1;
+    }
+    if(sim_frame_dir) mkdir(sim_frame_dir, 0755);
+    
+    sim_furi_init();
+    sim_storage_set_root(root);
+    size_t heap_before = sim_heap_in_use();
+    
+    int32_t result = SIM_APP_ENTRY(NULL);
+    
+    sim_print_stats(heap_before);
+    if(sim_script != stdin) fclose(sim_script);
+    return result == 0 && sim_heap_in_use() == heap_before && !sim_verify_failed ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+// Host stand-in for the storage record. Firmware paths ("/ext/...", "/int/...") are
+// mapped below a host directory so each run can start from a prepared SD card image.
+
+#include "sim.h"
+
+#include <errno.h>
+#include <storage/storage.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct File {
+    FILE* stream;
+};
+
+static char sim_storage_root[512] = ".";
+
+void sim_storage_set_root(const char* root) {
+    snprintf(sim_storage_root, sizeof(sim_storage_root), "%s", root);
+}
+
+static void sim_storage_path(char* out, size_t size, const char* path) {
+    snprintf(out, size, "%s%s", sim_storage_root, path);
+}
+
+static FS_Error sim_storage_error(void) {
+    switch(errno) {
+    case ENOENT:
+        return FSE_NOT_EXIST;
+    case EEXIST:
+        return FSE_EXIST;
+    case EACCES:
+        return FSE_DENIED;
+    default:
+        return FSE_INTERNAL;
+    }
+}
+
+File* storage_file_alloc(Storage* storage) {
+    UNUSED(storage);
+    return calloc(1, sizeof(File));
+}
+
+void storage_file_free(File* file) {
+    if(file->stream) fclose(file->stream);
+    free(file);
+}
+
+bool storage_file_open(
+    File* file,
+    const char* path,
+    FS_AccessMode access_mode,
+    FS_OpenMode open_mode) {
+    char host_path[768];
+    sim_storage_path(host_path, sizeof(host_path), path);
+    
+    bool exists = access(host_path, F_OK) == 0;
+    const char* mode = NULL;
+    switch(open_mode) {
+    case FSOM_OPEN_EXISTING:
+        if(!exists) return false;
+        mode = (access_mode & FSAM_WRITE) ? "r+b" : "rb";
+        break;
+    case FSOM_OPEN_ALWAYS:
+        mode = exists ? ((access_mode & FSAM_WRITE) ? "r+b" : "rb") : "w+b";
+        break;
+    case FSOM_OPEN_APPEND:
+        mode = (access_mode & FSAM_READ) ? "a+b" : "ab";
+        break;
+    case FSOM_CREATE_NEW:
+        if(exists) return false;
+        mode = "w+b";
+        break;
+    case FSOM_CREATE_ALWAYS:
+        mode = "w+b";
+        break;
+    }
+    
+    file->stream = fopen(host_path, mode);
+    return file->stream != NULL;
+}
+
+bool storage_file_close(File* file) {
+    if(!file->stream) return false;
+    fclose(file->stream);
+    file->stream = NULL;
+    return true;
+}
+
+size_t storage_file_read(File* file, void* buff, size_t bytes_to_read) {
+    return file->stream ? fread(buff, 1, bytes_to_read, file->stream) : 0;
+}
+
+size_t storage_file_write(File* file, const void* buff, size_t bytes_to_write) {
+    return file->stream ? fwrite(buff, 1, bytes_to_write, file->stream) : 0;
+}
+
+bool storage_file_seek(File* file, uint32_t offset, bool from_start) {
+    return file->stream && fseek(file->stream, offset, from_start ? SEEK_SET : SEEK_CUR) == 0;
+}
+
+uint64_t storage_file_tell(File* file) {
+    return file->stream ? (uint64_t)ftell(file->stream) : 0;
+}
+
+uint64_t storage_file_size(File* file) {
+    if(!file->stream) return 0;
+    struct stat info;
+    fflush(file->stream);
+    return fstat(fileno(file->stream), &info) == 0 ? (uint64_t)info.st_size : 0;
+}
+
+bool storage_file_eof(File* file) {
+    if(!file->stream) return true;
+    int c = fgetc(file->stream);
+    if(c == EOF) return true;
+    ungetc(c, file->stream);
+    return false;
+}
+
+bool storage_file_sync(File* file) {
+    return file->stream && fflush(file->stream) == 0;
+}
+
+FS_Error storage_common_stat(Storage* storage, const char* path, FileInfo* fileinfo) {
+    UNUSED(storage);
+    char host_path[768];
+    sim_storage_path(host_path, sizeof(host_path), path);
+    struct stat info;
+    if(stat(host_path, &info) != 0) return sim_storage_error();
+    if(fileinfo) {
+        fileinfo->flags = S_ISDIR(info.st_mode) ? FSF_DIRECTORY : 0;
+        fileinfo->size = info.st_size;
+    }
+    return FSE_OK;
+}
+
+FS_Error storage_common_timestamp(Storage* storage, const char* path, uint32_t* timestamp) {
+    UNUSED(storage);
+    char host_path[768];
+    sim_storage_path(host_path, sizeof(host_path), path);
+    struct stat info;
+    if(stat(host_path, &info) != 0) return sim_storage_error();
+    *timestamp = (uint32_t)info.st_mtime;
+    return FSE_OK;
+}
+
+FS_Error storage_common_remove(Storage* storage, const char* path) {
+    UNUSED(storage);
+    char host_path[768];
+    sim_storage_path(host_path, sizeof(host_path), path);
+    return remove(host_path) == 0 ? FSE_OK : sim_storage_error();
+}
+
+FS_Error storage_common_rename(Storage* storage, const char* old_path, const char* new_path) {
+    UNUSED(storage);
+    char host_old[768], host_new[768];
+    sim_storage_path(host_old, sizeof(host_old), old_path);
+    sim_storage_path(host_new, sizeof(host_new), new_path);
+    return rename(host_old, host_new) == 0 ? FSE_OK : sim_storage_error();
+}
+
+bool storage_common_exists(Storage* storage, const char* path) {
+    return storage_common_stat(storage, path, NULL) == FSE_OK;
+}
+
+bool storage_simply_mkdir(Storage* storage, const char* path) {
+    UNUSED(storage);
+    char host_path[768];
+    sim_storage_path(host_path, sizeof(host_path), path);
+    
+    // Create parents too, so a fresh root does not need an "ext" directory
+    for(char* slash = strchr(host_path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(host_path, 0755);
+        *slash = '/';
+    }
+    return mkdir(host_path, 0755) == 0 || errno == EEXIST;
+}
@@ -38,6 +38,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if QR_VECTOR_RS
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif
+
+#if QR_THREADS
+#if LOCK_VERSION != 0
+#error QR_THREADS needs the tables of every version (LOCK_VERSION 0)
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+
 #if LOCK_VERSION == 0
 
 static const uint16_t NUM_ERROR_CORRECTION_CODEWORDS[4][40] = {
@@ -86,6 +104,38 @@ static const uint16_t NUM_RAW_DATA_MODULES = 567;
 #endif
 
 
+
+#if QR_PROFILE
+
+static QRProfile *activeProfile = NULL;
+
+void qrcode_setProfile(QRProfile *profile) {
+    activeProfile = profile;
+}
+
+// A lap timer bound to the profile active when it starts; each lap adds the ticks
+// since the previous one to a counter of that profile
+#define PROFILE_START(timer) \
+    QRProfile *const timer##Profile = activeProfile; \
+    uint32_t timer = timer##Profile ? timer##Profile->clock(timer##Profile->context) : 0
+#define PROFILE_LAP(timer, counter) do { \
+    if (timer##Profile) { \
+        uint32_t now = timer##Profile->clock(timer##Profile->context); \
+        timer##Profile->counter += (uint32_t)(now - timer); \
+        timer = now; \
+    } \
+} while (0)
+#define PROFILE_DO(timer, statement) do { if (timer##Profile) { timer##Profile->statement; } } while (0)
+
+#else
+
+#define PROFILE_START(timer)
+#define PROFILE_LAP(timer, counter)
+#define PROFILE_DO(timer, statement)
+
+#endif
+
+
 static int max(int a, int b) {
     if (a > b) { return a; }
     return b;
@@ -469,6 +519,18 @@ static void drawCodewords(BitBucket *modules, BitBucket *isFunction, BitBucket *
 #define PENALTY_N3     40
 #define PENALTY_N4     10
 
+// Penalty for the balance of black and white modules
+static uint32_t getBalancePenalty(uint16_t black, uint16_t total) {
+    uint32_t result = 0;
+    
+    // Find smallest k such that (45-5k)% <= dark/total <= (55+5k)%
+    for (uint16_t k = 0; black * 20 < (9 - k) * total || black * 20 > (11 + k) * total; k++) {
+        result += PENALTY_N4;
+    }
+    
+    return result;
+}
+
 // Calculates and returns the penalty score based on state of this QR Code's current modules.
 // This is used by the automatic mask choice algorithm to find the mask pattern that yields the lowest score.
 // @TODO: This can be optimized by working with the bytes instead of bits.
@@ -552,10 +614,56 @@ static uint32_t getPenaltyScore(BitBucket *modules) {
         }
     }
 
-    // Find smallest k such that (45-5k)% <= dark/total <= (55+5k)%
-    uint16_t total = size * size;
-    for (uint16_t k = 0; black * 20 < (9 - k) * total || black * 20 > (11 + k) * total; k++) {
-        result += PENALTY_N4;
+    result += getBalancePenalty(black, size * size);
+    
+    return result;
+}
+
+// Rules 1 and 3 of getPenaltyScore for a single row or column; together with the
+// 2*2 blocks and the balance they add up to its score
+static uint16_t getLinePenalty(BitBucket *modules, uint8_t index, bool column) {
+    uint16_t result = 0;
+    
+    uint8_t size = modules->bitOffsetOrWidth;
+    
+    bool color = column ? bb_getBit(modules, index, 0) : bb_getBit(modules, 0, index);
+    uint16_t bits = color;
+    for (uint8_t i = 1, run = 1; i < size; i++) {
+        bool c = column ? bb_getBit(modules, index, i) : bb_getBit(modules, i, index);
+        if (c != color) {
+            color = c;
+            run = 1;
+        } else {
+            run++;
+            if (run == 5) {
+                result += PENALTY_N1;
+            } else if (run > 5) {
+                result++;
+            }
+        }
+        
+        bits = ((bits << 1) & 0x7FF) | c;
+        if (i >= 10 && (bits == 0x05D || bits == 0x5D0)) {
+            result += PENALTY_N3;
+        }
+    }
+    
+    return result;
+}
+
+// 2*2 blocks of one color among the (up to) four that contain the module at (x, y)
+static uint8_t getBlocksAround(BitBucket *modules, uint8_t x, uint8_t y) {
+    uint8_t result = 0;
+    
+    uint8_t size = modules->bitOffsetOrWidth;
+    
+    for (uint8_t by = (y > 0) ? y : 1; by <= y + 1 && by < size; by++) {
+        for (uint8_t bx = (x > 0) ? x : 1; bx <= x + 1 && bx < size; bx++) {
+            bool color = bb_getBit(modules, bx, by);
+            if (color == bb_getBit(modules, bx - 1, by - 1) && color == bb_getBit(modules, bx, by - 1) && color == bb_getBit(modules, bx - 1, by)) {
+                result++;
+            }
+        }
     }
     
     return result;
@@ -612,9 +720,130 @@ static void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8
     }
 }
 
+// Remainders of all blocks, one block at a time, into result[j * numBlocks + b]. Each
+// block starts at its first byte past the first skip bytes of the data: with the
+// register still zero, dividing leading zeros changes nothing, so those bytes count
+// as zero.
+static void rs_getRemaindersFrom(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8_t numBlocks, uint8_t numShortBlocks, uint8_t shortDataBlockLen, uint16_t skip, uint8_t *result) {
+    uint8_t blockSize = shortDataBlockLen;
+    uint16_t blockStart = 0;
+    for (uint8_t blockNum = 0; blockNum < numBlocks; blockNum++) {
+        
+#if LOCK_VERSION == 0 || LOCK_VERSION >= 5
+        if (blockNum == numShortBlocks) { blockSize++; }
+#endif
+        uint8_t first = 0;
+        if (skip > blockStart) { first = (skip - blockStart < blockSize) ? skip - blockStart : blockSize; }
+        rs_getRemainder(degree, coeff, data + blockStart + first, blockSize - first, &result[blockNum], numBlocks);
+        blockStart += blockSize;
+    }
+}
+
+
+#if QR_VECTOR_RS
+
+// Split-nibble multiply tables: coeff * n == low[n & 0x0F] ^ high[n >> 4]. Sixteen
+// entries per half is exactly one PSHUFB/TBL lookup, so a single coefficient can be
+// multiplied against a whole vector of factors at once.
+typedef struct RsNibbleTable {
+    uint8_t low[16];
+    uint8_t high[16];
+} RsNibbleTable;
+
+static void rs_initNibbleTables(uint8_t degree, const uint8_t *coeff, RsNibbleTable *tables) {
+    for (uint8_t j = 0; j < degree; j++) {
+        for (uint8_t n = 0; n < 16; n++) {
+            tables[j].low[n] = rs_multiply(coeff[j], n);
+            tables[j].high[n] = rs_multiply(coeff[j], n << 4);
+        }
+    }
+}
+
+// row[b] ^= coeff * factors[b] for b in [0, count)
+static void rs_multiplyAccumulate(const RsNibbleTable *table, const uint8_t *factors, uint8_t *row, uint8_t count) {
+    uint8_t b = 0;
+    
+#if defined(__SSSE3__)
+    const __m128i low = _mm_loadu_si128((const __m128i *)table->low);
+    const __m128i high = _mm_loadu_si128((const __m128i *)table->high);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; b + 16 <= count; b += 16) {
+        __m128i f = _mm_loadu_si128((const __m128i *)&factors[b]);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(f, nibble)),
+                                  _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(f, 4), nibble)));
+        __m128i r = _mm_loadu_si128((const __m128i *)&row[b]);
+        _mm_storeu_si128((__m128i *)&row[b], _mm_xor_si128(r, p));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t low = vld1q_u8(table->low);
+    const uint8x16_t high = vld1q_u8(table->high);
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    for (; b + 16 <= count; b += 16) {
+        uint8x16_t f = vld1q_u8(&factors[b]);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(low, vandq_u8(f, nibble)), vqtbl1q_u8(high, vshrq_n_u8(f, 4)));
+        vst1q_u8(&row[b], veorq_u8(vld1q_u8(&row[b]), p));
+    }
+#endif
+    
+    // Scalar fallback and tail; same tables, so results are bit-exact
+    for (; b < count; b++) {
+        row[b] ^= table->low[factors[b] & 0x0F] ^ table->high[factors[b] >> 4];
+    }
+}
+
+// Computes the remainders of all blocks at once. Block b of the data is stepped in
+// lane b; result receives the remainders already interleaved (result[j * numBlocks + b]),
+// which is the layout performErrorCorrection writes them out in anyway. scratch holds
+// degree * (sizeof(RsNibbleTable) + numBlocks) bytes.
+static void rs_getRemaindersInterleaved(uint8_t degree, const uint8_t *coeff, const uint8_t *data, uint8_t numBlocks, uint8_t numShortBlocks, uint8_t shortDataBlockLen, uint8_t *result, uint8_t *scratch) {
+    RsNibbleTable *tables = (RsNibbleTable *)scratch;
+    rs_initNibbleTables(degree, coeff, tables);
+    
+    // The remainder registers, one row per coefficient, rotated instead of shifted
+    uint8_t (*registers)[numBlocks] = (uint8_t (*)[numBlocks])(scratch + degree * sizeof(RsNibbleTable));
+    memset(registers, 0, degree * numBlocks);
+    uint8_t head = 0;
+    
+    const uint8_t *blockData[numBlocks];
+    for (uint8_t b = 0; b < numBlocks; b++) {
+        blockData[b] = data + b * shortDataBlockLen + (b > numShortBlocks ? b - numShortBlocks : 0);
+    }
+    
+    uint8_t factors[numBlocks];
+    
+    // Long blocks carry one extra leading byte; step them alone first (short lanes get a
+    // zero factor, and shifting their still-empty registers changes nothing) so every
+    // lane then has exactly shortDataBlockLen bytes left
+    int16_t i = (numShortBlocks < numBlocks) ? -1 : 0;
+    for (; i < shortDataBlockLen; i++) {
+        uint8_t *first = registers[head];
+        for (uint8_t b = 0; b < numBlocks; b++) {
+            if (i < 0) {
+                factors[b] = (b < numShortBlocks) ? 0 : *blockData[b]++ ^ first[b];
+            } else {
+                factors[b] = blockData[b][i] ^ first[b];
+            }
+        }
+        
+        // Shift the register by one coefficient: the old first row becomes the new last
+        memset(first, 0, numBlocks);
+        head = (head + 1) % degree;
+        
+        for (uint8_t j = 0; j < degree; j++) {
+            rs_multiplyAccumulate(&tables[j], factors, registers[(head + j) % degree], numBlocks);
+        }
+    }
+    
+    for (uint8_t j = 0; j < degree; j++) {
+        memcpy(&result[j * numBlocks], registers[(head + j) % degree], numBlocks);
+    }
+}
+
+#endif
 
 
-static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text, uint16_t length, int8_t mode, uint8_t version) {
+// Appends one segment: mode indicator, character count and the packed characters
+static void appendSegment(BitBucket *dataCodewords, const uint8_t *text, uint16_t length, int8_t mode, uint8_t version) {
     if (mode == MODE_NUMERIC) {
         bb_appendBits(dataCodewords, 1 << MODE_NUMERIC, 4);
         bb_appendBits(dataCodewords, length, getModeBits(version, MODE_NUMERIC));
@@ -666,11 +895,142 @@ static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text,
     }
     
     //bb_setBits(dataCodewords, length, 4, getModeBits(version, mode));
+}
+
+// Bits of one segment of length characters
+static uint32_t getSegmentBitLength(int8_t mode, uint8_t version, uint16_t length) {
+    uint32_t bits = 4 + getModeBits(version, mode);
+    if (mode == MODE_NUMERIC) {
+        bits += 10 * (length / 3) + ((length % 3) ? 3 * (length % 3) + 1 : 0);
+    } else if (mode == MODE_ALPHANUMERIC) {
+        bits += 11 * (length / 2) + 6 * (length % 2);
+    } else {
+        bits += 8 * (uint32_t)length;
+    }
+    return bits;
+}
+
+// Modes a character can be encoded in, as a set of (1 << MODE_*)
+static uint8_t getCharModes(uint8_t c) {
+    if (c >= '0' && c <= '9') { return (1 << MODE_NUMERIC) | (1 << MODE_ALPHANUMERIC) | (1 << MODE_BYTE); }
+    if (getAlphanumeric((char)c) >= 0) { return (1 << MODE_ALPHANUMERIC) | (1 << MODE_BYTE); }
+    return 1 << MODE_BYTE;
+}
+
+// Cheapest split of text into numeric, alphanumeric and byte segments, found as a
+// shortest path over the three modes (after Nayuki's segment optimizer). Costs are
+// kept in sixths of a bit so that digits (10 bits per 3) and alphanumerics (11 per 2)
+// cost whole numbers; rounding up where a segment ends makes the total exact.
+// Returns the bit length; when modes is not NULL it receives each character's mode.
+static uint32_t segmentText(const uint8_t *text, uint16_t length, uint8_t version, uint8_t *modes) {
+    static const uint8_t CHAR_COST[3] = { 20, 33, 48 };
+    
+    if (length == 0) { return getSegmentBitLength(MODE_BYTE, version, 0); }
+    
+    uint32_t headCost[3];
+    uint32_t cost[3];
+    for (uint8_t m = 0; m < 3; m++) {
+        headCost[m] = (4 + getModeBits(version, m)) * 6;
+        cost[m] = headCost[m];
+    }
+    
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t allowed = getCharModes(text[i]);
+        
+        // from packs, per mode m the character ends in, the mode it was encoded in
+        uint32_t next[3];
+        uint32_t ended[3];
+        uint8_t from = 0;
+        for (uint8_t m = 0; m < 3; m++) {
+            next[m] = (allowed & (1 << m)) ? cost[m] + CHAR_COST[m] : UINT32_MAX;
+            ended[m] = (next[m] == UINT32_MAX) ? UINT32_MAX : (next[m] + 5) / 6 * 6;
+            from |= m << (2 * m);
+        }
+        
+        // Or close the segment after this character and open one in another mode
+        for (uint8_t m = 0; m < 3; m++) {
+            for (uint8_t k = 0; k < 3; k++) {
+                if (k == m || ended[k] == UINT32_MAX || ended[k] + headCost[m] >= next[m]) { continue; }
+                next[m] = ended[k] + headCost[m];
+                from = (from & ~(3 << (2 * m))) | (k << (2 * m));
+            }
+        }
+        
+        if (modes) { modes[i] = from; }
+        memcpy(cost, next, sizeof(cost));
+    }
+    
+    uint8_t best = 0;
+    for (uint8_t m = 1; m < 3; m++) {
+        if ((cost[m] + 5) / 6 < (cost[best] + 5) / 6) { best = m; }
+    }
+    
+    // Walk back: the mode a character ends in is the mode the next one starts in
+    if (modes) {
+        uint8_t mode = best;
+        for (uint16_t i = length; i-- > 0; ) {
+            mode = (modes[i] >> (2 * mode)) & 0x03;
+            modes[i] = mode;
+        }
+    }
+    
+    return (cost[best] + 5) / 6;
+}
+
+// Characters no version's data capacity can exceed in any mode: digits are the
+// densest at 10 bits per 3
+static uint16_t getMaxCharacters(uint16_t dataCapacity) {
+    return (uint32_t)dataCapacity * 12 / 5 + 1;
+}
+
+// With MODE_MIXED, modes holds each character's mode from segmentText
+static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text, uint16_t length, int8_t mode, uint8_t version, const uint8_t *modes) {
+    if (mode != MODE_MIXED || length == 0) {
+        appendSegment(dataCodewords, text, length, mode == MODE_MIXED ? MODE_BYTE : mode, version);
+        return mode;
+    }
+    
+    for (uint16_t start = 0; start < length; ) {
+        uint16_t end = start + 1;
+        while (end < length && modes[end] == modes[start]) { end++; }
+        appendSegment(dataCodewords, text + start, end - start, modes[start], version);
+        start = end;
+    }
     
     return mode;
 }
 
-static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data) {
+// Bytes of scratch performErrorCorrection needs: the interleaving buffer, plus the
+// multiply tables and registers of the interleaved RS kernel
+static uint16_t getErrorCorrectionScratchSize(uint8_t version, uint8_t ecc) {
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+#else
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+#endif
+    uint16_t size = bb_getBufferSizeBytes(moduleCount);
+    
+#if QR_VECTOR_RS
+#if LOCK_VERSION == 0
+    uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[ecc][version - 1];
+    uint16_t totalEcc = NUM_ERROR_CORRECTION_CODEWORDS[ecc][version - 1];
+#else
+    uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[ecc];
+    uint16_t totalEcc = NUM_ERROR_CORRECTION_CODEWORDS[ecc];
+#endif
+    size += totalEcc / numBlocks * sizeof(RsNibbleTable) + totalEcc;
+#else
+    (void)ecc;
+#endif
+    
+    return size;
+}
+
+// scratch must hold getErrorCorrectionScratchSize() bytes. With parity, the first
+// fixedBytes data codewords are a prefix whose ECC codewords, computed with all later
+// data taken as zero, are given in parity; RS is linear, so only the bytes after the
+// prefix are divided here and the two parts are XORed.
+static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data, uint8_t *scratch, const uint8_t *parity, uint16_t fixedBytes) {
     
     // See: http://www.thonky.com/qr-code-tutorial/structure-final-message
     
@@ -690,8 +1050,8 @@ static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data
     
     uint8_t shortDataBlockLen = shortBlockLen - blockEccLen;
     
-    uint8_t result[data->capacityBytes];
-    memset(result, 0, sizeof(result));
+    uint8_t *result = scratch;
+    memset(result, 0, data->capacityBytes);
     
     uint8_t coeff[blockEccLen];
     rs_init(blockEccLen, coeff);
@@ -729,15 +1089,20 @@ static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data
     }
 #endif
     
-    // Add all ecc blocks, interleaved
-    uint8_t blockSize = shortDataBlockLen;
-    for (uint8_t blockNum = 0; blockNum < numBlocks; blockNum++) {
-        
-#if LOCK_VERSION == 0 || LOCK_VERSION >= 5
-        if (blockNum == numShortBlocks) { blockSize++; }
+    // Add all ecc blocks, interleaved. The interleaved kernel steps every block in
+    // lockstep, so it cannot skip a prefix; the blocks of a tail go one by one.
+#if QR_VECTOR_RS
+    if (!parity) {
+        rs_getRemaindersInterleaved(blockEccLen, coeff, dataBytes, numBlocks, numShortBlocks, shortDataBlockLen, &result[offset], scratch + data->capacityBytes);
+    } else {
+        rs_getRemaindersFrom(blockEccLen, coeff, dataBytes, numBlocks, numShortBlocks, shortDataBlockLen, fixedBytes, &result[offset]);
+    }
+#else
+    rs_getRemaindersFrom(blockEccLen, coeff, dataBytes, numBlocks, numShortBlocks, shortDataBlockLen, parity ? fixedBytes : 0, &result[offset]);
 #endif
-        rs_getRemainder(blockEccLen, coeff, dataBytes, blockSize, &result[offset + blockNum], numBlocks);
-        dataBytes += blockSize;
+    
+    if (parity) {
+        for (uint16_t i = 0; i < totalEcc; i++) { result[offset + i] ^= parity[i]; }
     }
     
     memcpy(data->data, result, data->capacityBytes);
@@ -753,70 +1118,110 @@ uint16_t qrcode_getBufferSize(uint8_t version) {
     return bb_getGridSizeBytes(4 * version + 17);
 }
 
-// @TODO: Return error if data is too big.
-int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
-    uint8_t size = version * 4 + 17;
-    qrcode->version = version;
-    qrcode->size = size;
-    qrcode->ecc = ecc;
-    qrcode->modules = modules;
-    
+uint16_t qrcode_getDataCapacity(uint8_t version, uint8_t ecc) {
     uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
     
 #if LOCK_VERSION == 0
-    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
-    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+    return NUM_RAW_DATA_MODULES[version - 1] / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
 #else
-    version = LOCK_VERSION;
-    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
-    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+    (void)version;
+    return NUM_RAW_DATA_MODULES / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
 #endif
-    
-    struct BitBucket codewords;
-    uint8_t codewordBytes[bb_getBufferSizeBytes(moduleCount)];
-    bb_initBuffer(&codewords, codewordBytes, (int32_t)sizeof(codewordBytes));
-    
-    // Place the data code words into the buffer
-    mode = encodeDataCodewords(&codewords, data, length, mode, version);
-    
-    if (mode < 0) { return -1; }
-    qrcode->mode = mode;
-    
+}
+
+uint32_t qrcode_getBitLength(int8_t mode, uint8_t version, const uint8_t *data, uint16_t length) {
+    if (mode == MODE_MIXED) { return segmentText(data, length, version, NULL); }
+    return getSegmentBitLength(mode, version, length);
+}
+
+uint8_t qrcode_getMinVersion(int8_t mode, uint8_t ecc, const uint8_t *data, uint16_t length, uint8_t maxVersion) {
+#if LOCK_VERSION == 0
+    uint32_t bits = 0;
+    for (uint8_t version = 1; version <= maxVersion && version <= 40; version++) {
+        // Character count fields only widen at versions 10 and 27
+        if (version == 1 || version == 10 || version == 27) { bits = qrcode_getBitLength(mode, version, data, length); }
+        if (bits <= (uint32_t)qrcode_getDataCapacity(version, ecc) * 8) { return version; }
+    }
+    return 0;
+#else
+    if (maxVersion < LOCK_VERSION) { return 0; }
+    return qrcode_getBitLength(mode, LOCK_VERSION, data, length) <= (uint32_t)qrcode_getDataCapacity(LOCK_VERSION, ecc) * 8 ? LOCK_VERSION : 0;
+#endif
+}
+
+// Adds the terminator and pads the data codewords up to the data capacity
+static void padCodewords(BitBucket *codewords, uint16_t dataCapacity) {
     // Add terminator and pad up to a byte if applicable
-    uint32_t padding = (dataCapacity * 8) - codewords.bitOffsetOrWidth;
+    uint32_t padding = (dataCapacity * 8) - codewords->bitOffsetOrWidth;
     if (padding > 4) { padding = 4; }
-    bb_appendBits(&codewords, 0, padding);
-    bb_appendBits(&codewords, 0, (8 - codewords.bitOffsetOrWidth % 8) % 8);
+    bb_appendBits(codewords, 0, padding);
+    bb_appendBits(codewords, 0, (8 - codewords->bitOffsetOrWidth % 8) % 8);
 
     // Pad with alternate bytes until data capacity is reached
-    for (uint8_t padByte = 0xEC; codewords.bitOffsetOrWidth < (dataCapacity * 8); padByte ^= 0xEC ^ 0x11) {
-        bb_appendBits(&codewords, padByte, 8);
+    for (uint8_t padByte = 0xEC; codewords->bitOffsetOrWidth < (dataCapacity * 8); padByte ^= 0xEC ^ 0x11) {
+        bb_appendBits(codewords, padByte, 8);
     }
+}
+
+// Encodes the payload, pads it to the data capacity and appends the interleaved error
+// correction codewords; codewords must have room for the raw data modules of the version,
+// modes for getMaxCharacters(dataCapacity) bytes. Fails when the payload does not fit.
+static int8_t buildCodewords(BitBucket *codewords, uint8_t *data, uint16_t length, int8_t mode, uint8_t version, uint8_t eccFormatBits, uint16_t dataCapacity, uint8_t *scratch, uint8_t *modes) {
+    if (mode < MODE_NUMERIC || mode > MODE_MIXED || length > getMaxCharacters(dataCapacity)) { return -1; }
+    
+    // Segmenting belongs to the data stage; for MODE_MIXED it is most of it
+    PROFILE_START(timer);
+    
+    uint32_t bits = (mode == MODE_MIXED) ? segmentText(data, length, version, modes) : getSegmentBitLength(mode, version, length);
+    if (bits > (uint32_t)dataCapacity * 8) { return -1; }
+    
+    // Place the data code words into the buffer
+    mode = encodeDataCodewords(codewords, data, length, mode, version, modes);
+    padCodewords(codewords, dataCapacity);
+    PROFILE_LAP(timer, ticks[QR_STAGE_DATA]);
+    
+    performErrorCorrection(version, eccFormatBits, codewords, scratch, NULL, 0);
+    PROFILE_LAP(timer, ticks[QR_STAGE_ECC]);
+    
+    return mode;
+}
 
+// Draws the function patterns and the codewords into qrcode's modules and applies
+// the mask with the lowest penalty; isFunctionGridBytes is scratch for the grid
+static void drawSymbol(QRCode *qrcode, uint8_t version, uint8_t eccFormatBits, BitBucket *codewords, uint8_t *isFunctionGridBytes) {
     BitBucket modulesGrid;
-    bb_initGrid(&modulesGrid, modules, size);
+    bb_initGrid(&modulesGrid, qrcode->modules, qrcode->size);
     
     BitBucket isFunctionGrid;
-    uint8_t isFunctionGridBytes[bb_getGridSizeBytes(size)];
-    bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
+    bb_initGrid(&isFunctionGrid, isFunctionGridBytes, qrcode->size);
+    
+    PROFILE_START(timer);
+    PROFILE_DO(timer, encodes++);
     
     // Draw function patterns, draw all codewords, do masking
     drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version, eccFormatBits);
-    performErrorCorrection(version, eccFormatBits, &codewords);
-    drawCodewords(&modulesGrid, &isFunctionGrid, &codewords);
+    PROFILE_LAP(timer, ticks[QR_STAGE_FUNCTION]);
+    drawCodewords(&modulesGrid, &isFunctionGrid, codewords);
+    PROFILE_LAP(timer, ticks[QR_STAGE_CODEWORDS]);
     
     // Find the best (lowest penalty) mask
     uint8_t mask = 0;
     int32_t minPenalty = INT32_MAX;
     for (uint8_t i = 0; i < 8; i++) {
+        PROFILE_START(trial);
         drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, i);
         applyMask(&modulesGrid, &isFunctionGrid, i);
+        PROFILE_LAP(timer, ticks[QR_STAGE_MASK]);
         int penalty = getPenaltyScore(&modulesGrid);
+        PROFILE_LAP(timer, ticks[QR_STAGE_PENALTY]);
+        PROFILE_DO(timer, penalty[i] = penalty);
         if (penalty < minPenalty) {
             mask = i;
             minPenalty = penalty;
         }
         applyMask(&modulesGrid, &isFunctionGrid, i);  // Undoes the mask due to XOR
+        PROFILE_LAP(timer, ticks[QR_STAGE_MASK]);
+        PROFILE_LAP(trial, maskTicks[i]);
     }
     
     qrcode->mask = mask;
@@ -826,23 +1231,1164 @@ int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t v
     
     // Apply the final choice of mask
     applyMask(&modulesGrid, &isFunctionGrid, mask);
+    PROFILE_LAP(timer, ticks[QR_STAGE_FORMAT]);
+}
+
+uint32_t qrcode_getWorkspaceSize(uint8_t version, uint8_t ecc) {
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+#else
+    version = LOCK_VERSION;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+#endif
+    
+    // Codewords, the function-module grid, the error correction scratch, then the
+    // character modes of MODE_MIXED
+    return bb_getBufferSizeBytes(moduleCount) + bb_getGridSizeBytes(4 * version + 17) + getErrorCorrectionScratchSize(version, eccFormatBits) + getMaxCharacters(qrcode_getDataCapacity(version, ecc));
+}
+
+int8_t qrcode_initBytesWorkspace(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, uint8_t *workspace) {
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->modules = modules;
+    
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+#else
+    version = LOCK_VERSION;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+#endif
+    
+    uint8_t *codewordBytes = workspace;
+    uint8_t *isFunctionGridBytes = codewordBytes + bb_getBufferSizeBytes(moduleCount);
+    uint8_t *scratch = isFunctionGridBytes + bb_getGridSizeBytes(size);
+    uint8_t *modes = scratch + getErrorCorrectionScratchSize(version, eccFormatBits);
+    
+    struct BitBucket codewords;
+    bb_initBuffer(&codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
+    
+    // Place the data code words into the buffer, padded and followed by the ECC
+    mode = buildCodewords(&codewords, data, length, mode, version, eccFormatBits, dataCapacity, scratch, modes);
+    
+    if (mode < 0) { return -1; }
+    qrcode->mode = mode;
 
+    drawSymbol(qrcode, version, eccFormatBits, &codewords, isFunctionGridBytes);
+    
     return 0;
 }
 
-/* int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data) { */
-/*     return qrcode_initBytes(qrcode, modules, version, ecc, (uint8_t*)data, strlen(data)); */
-/* } */
+int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
+    uint8_t workspace[qrcode_getWorkspaceSize(version, ecc)];
+    return qrcode_initBytesWorkspace(qrcode, modules, mode, version, ecc, data, length, workspace);
+}
 
-bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y) {
-    if (x >= qrcode->size || y >= qrcode->size) {
-        return false;
+int8_t qrcode_initBytesEx(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, const QRAllocator *allocator) {
+    uint32_t size = qrcode_getWorkspaceSize(version, ecc);
+    uint8_t *workspace = allocator ? (uint8_t *)allocator->alloc(allocator->context, size) : (uint8_t *)QR_MALLOC(size);
+    if (!workspace) { return -1; }
+    
+    int8_t result = qrcode_initBytesWorkspace(qrcode, modules, mode, version, ecc, data, length, workspace);
+    
+    if (allocator) {
+        allocator->free(allocator->context, workspace);
+    } else {
+        QR_FREE(workspace);
     }
+    
+    return result;
+}
 
-    uint32_t offset = y * qrcode->size + x;
-    return (qrcode->modules[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0;
+uint16_t qrcode_getPrefixCacheSize(uint8_t version, uint8_t ecc) {
+    (void)ecc;
+#if LOCK_VERSION == 0
+    return NUM_RAW_DATA_MODULES[version - 1] / 8;
+#else
+    (void)version;
+    return NUM_RAW_DATA_MODULES / 8;
+#endif
 }
 
+int8_t qrcode_initPrefix(QRPrefix *prefix, uint8_t *cache, uint8_t version, uint8_t ecc, const uint8_t *data, uint16_t length, uint8_t *workspace) {
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+#else
+    version = LOCK_VERSION;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+#endif
+    
+    prefix->version = version;
+    prefix->ecc = ecc;
+    prefix->bits = 0;
+    prefix->cache = cache;
+    
+    uint8_t *codewordBytes = workspace;
+    uint8_t *scratch = codewordBytes + bb_getBufferSizeBytes(moduleCount) + bb_getGridSizeBytes(4 * version + 17);
+    uint8_t *modes = scratch + getErrorCorrectionScratchSize(version, eccFormatBits);
+    
+    if (length > getMaxCharacters(dataCapacity)) { return -1; }
+    uint32_t bits = (length > 0) ? segmentText(data, length, version, modes) : 0;
+    if (bits > (uint32_t)dataCapacity * 8) { return -1; }
+    
+    BitBucket codewords;
+    bb_initBuffer(&codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
+    if (length > 0) { encodeDataCodewords(&codewords, data, length, MODE_MIXED, version, modes); }
+    
+    // The prefix's bits, then the ECC codewords of its whole bytes; a byte the prefix
+    // only starts is divided again with every tail
+    uint16_t fixedBytes = bits / 8;
+    memcpy(cache, codewordBytes, bb_getBufferSizeBytes(bits));
+    memset(codewordBytes + fixedBytes, 0, codewords.capacityBytes - fixedBytes);
+    performErrorCorrection(version, eccFormatBits, &codewords, scratch, NULL, 0);
+    memcpy(cache + dataCapacity, codewordBytes + dataCapacity, moduleCount / 8 - dataCapacity);
+    
+    prefix->bits = bits;
+    return 0;
+}
+
+// Builds the prefix's cached bits followed by the tail into codewords, padded and with
+// the combined ECC codewords; codewords is initialized here. Fails when they do not fit.
+static int8_t buildPrefixedCodewords(BitBucket *codewords, uint8_t *codewordBytes, const QRPrefix *prefix, const uint8_t *data, uint16_t length, uint8_t eccFormatBits, uint16_t moduleCount, uint16_t dataCapacity, uint8_t *scratch, uint8_t *modes) {
+    uint8_t version = prefix->version;
+    
+    if (length > getMaxCharacters(dataCapacity)) { return -1; }
+    
+    PROFILE_START(timer);
+    
+    uint32_t bits = prefix->bits + ((length > 0) ? segmentText(data, length, version, modes) : 0);
+    if (bits > (uint32_t)dataCapacity * 8) { return -1; }
+    
+    // The tail's segments continue right after the prefix's bits
+    bb_initBuffer(codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
+    memcpy(codewordBytes, prefix->cache, bb_getBufferSizeBytes(prefix->bits));
+    codewords->bitOffsetOrWidth = prefix->bits;
+    if (length > 0 || prefix->bits == 0) { encodeDataCodewords(codewords, data, length, MODE_MIXED, version, modes); }
+    padCodewords(codewords, dataCapacity);
+    PROFILE_LAP(timer, ticks[QR_STAGE_DATA]);
+    
+    performErrorCorrection(version, eccFormatBits, codewords, scratch, prefix->cache + dataCapacity, prefix->bits / 8);
+    PROFILE_LAP(timer, ticks[QR_STAGE_ECC]);
+    
+    return MODE_MIXED;
+}
+
+int8_t qrcode_initBytesPrefixed(QRCode *qrcode, uint8_t *modules, const QRPrefix *prefix, const uint8_t *data, uint16_t length, uint8_t *workspace) {
+    uint8_t version = prefix->version;
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = prefix->ecc;
+    qrcode->mode = MODE_MIXED;
+    qrcode->modules = modules;
+    
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * prefix->ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+#else
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+#endif
+    
+    uint8_t *codewordBytes = workspace;
+    uint8_t *isFunctionGridBytes = codewordBytes + bb_getBufferSizeBytes(moduleCount);
+    uint8_t *scratch = isFunctionGridBytes + bb_getGridSizeBytes(size);
+    uint8_t *modes = scratch + getErrorCorrectionScratchSize(version, eccFormatBits);
+    
+    BitBucket codewords;
+    if (buildPrefixedCodewords(&codewords, codewordBytes, prefix, data, length, eccFormatBits, moduleCount, dataCapacity, scratch, modes) < 0) { return -1; }
+    
+    drawSymbol(qrcode, version, eccFormatBits, &codewords, isFunctionGridBytes);
+    
+    return 0;
+}
+
+// Wraps grid bytes that already hold modules, unlike bb_initGrid which clears them
+static void bb_wrapGrid(BitBucket *bitGrid, uint8_t *data, uint8_t size) {
+    bitGrid->bitOffsetOrWidth = size;
+    bitGrid->capacityBytes = bb_getGridSizeBytes(size);
+    bitGrid->data = data;
+}
+
+uint32_t qrcode_getIncrementalSize(uint8_t version) {
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+#else
+    version = LOCK_VERSION;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+#endif
+    uint8_t size = 4 * version + 17;
+    
+    // Per mask the penalty of each row and column, then the previous codewords, the
+    // function-module grid and per mask the symbol with its format bits and mask
+    return 8 * 2 * size * sizeof(uint16_t) + bb_getBufferSizeBytes(moduleCount) + 9 * bb_getGridSizeBytes(size);
+}
+
+void qrcode_initIncremental(QRIncremental *incremental, uint8_t *state, uint8_t version, uint8_t ecc) {
+#if LOCK_VERSION != 0
+    version = LOCK_VERSION;
+#endif
+    incremental->version = version;
+    incremental->ecc = ecc;
+    incremental->ready = false;
+    incremental->state = state;
+}
+
+// drawSymbol, keeping every mask's grid and penalty terms in the incremental state.
+// Once the state holds a symbol, only modules whose codeword bit changed are flipped,
+// the 2*2 blocks around them and the dark count adjusted, and the rows and columns
+// they lie on scored again.
+static void drawSymbolIncremental(QRCode *qrcode, QRIncremental *incremental, uint8_t eccFormatBits, BitBucket *codewords) {
+    uint8_t version = qrcode->version;
+    uint8_t size = qrcode->size;
+    uint16_t gridBytes = bb_getGridSizeBytes(size);
+    
+    uint16_t *lines = (uint16_t *)incremental->state;
+    uint8_t *previous = incremental->state + 8 * 2 * size * sizeof(uint16_t);
+    uint8_t *isFunctionGridBytes = previous + codewords->capacityBytes;
+    uint8_t *grids = isFunctionGridBytes + gridBytes;
+    
+    BitBucket isFunctionGrid;
+    BitBucket grid;
+    
+    PROFILE_START(timer);
+    PROFILE_DO(timer, encodes++);
+    
+    if (!incremental->ready) {
+        BitBucket modulesGrid;
+        bb_initGrid(&modulesGrid, qrcode->modules, size);
+        bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
+        
+        drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version, eccFormatBits);
+        PROFILE_LAP(timer, ticks[QR_STAGE_FUNCTION]);
+        drawCodewords(&modulesGrid, &isFunctionGrid, codewords);
+        PROFILE_LAP(timer, ticks[QR_STAGE_CODEWORDS]);
+        
+        for (uint8_t mask = 0; mask < 8; mask++) {
+            uint8_t *gridBytesOfMask = grids + mask * gridBytes;
+            memcpy(gridBytesOfMask, qrcode->modules, gridBytes);
+            bb_wrapGrid(&grid, gridBytesOfMask, size);
+            drawFormatBits(&grid, &isFunctionGrid, eccFormatBits, mask);
+            applyMask(&grid, &isFunctionGrid, mask);
+            PROFILE_LAP(timer, ticks[QR_STAGE_MASK]);
+            
+            uint16_t *maskLines = lines + mask * 2 * size;
+            incremental->lines[mask] = 0;
+            for (uint8_t i = 0; i < size; i++) {
+                maskLines[i] = getLinePenalty(&grid, i, false);
+                maskLines[size + i] = getLinePenalty(&grid, i, true);
+                incremental->lines[mask] += maskLines[i] + maskLines[size + i];
+            }
+            
+            uint16_t blocks = 0, black = 0;
+            for (uint8_t y = 0; y < size; y++) {
+                for (uint8_t x = 0; x < size; x++) {
+                    bool color = bb_getBit(&grid, x, y);
+                    if (x > 0 && y > 0 && color == bb_getBit(&grid, x - 1, y - 1) && color == bb_getBit(&grid, x, y - 1) && color == bb_getBit(&grid, x - 1, y)) {
+                        blocks++;
+                    }
+                    if (color) { black++; }
+                }
+            }
+            incremental->blocks[mask] = blocks;
+            incremental->black[mask] = black;
+            PROFILE_LAP(timer, ticks[QR_STAGE_PENALTY]);
+        }
+        
+        incremental->ready = true;
+        
+    } else {
+        bb_wrapGrid(&isFunctionGrid, isFunctionGridBytes, size);
+        
+        // Rows, then columns, that hold a flipped module
+        uint8_t dirty[(2 * 177 + 7) / 8];
+        memset(dirty, 0, sizeof(dirty));
+        
+        // Walk the zigzag of drawCodewords, flipping the modules of changed bits
+        uint32_t bitLength = codewords->bitOffsetOrWidth;
+        uint8_t *data = codewords->data;
+        uint32_t i = 0;
+        for (int16_t right = size - 1; right >= 1; right -= 2) {
+            if (right == 6) { right = 5; }
+            
+            for (uint8_t vert = 0; vert < size; vert++) {
+                for (int j = 0; j < 2; j++) {
+                    uint8_t x = right - j;
+                    bool upwards = ((right & 2) == 0) ^ (x < 6);
+                    uint8_t y = upwards ? size - 1 - vert : vert;
+                    if (bb_getBit(&isFunctionGrid, x, y) || i >= bitLength) { continue; }
+                    
+                    bool changed = (((data[i >> 3] ^ previous[i >> 3]) >> (7 - (i & 7))) & 1) != 0;
+                    i++;
+                    if (!changed) { continue; }
+                    
+                    for (uint8_t mask = 0; mask < 8; mask++) {
+                        bb_wrapGrid(&grid, grids + mask * gridBytes, size);
+                        incremental->blocks[mask] -= getBlocksAround(&grid, x, y);
+                        bb_invertBit(&grid, x, y, true);
+                        incremental->blocks[mask] += getBlocksAround(&grid, x, y);
+                        if (bb_getBit(&grid, x, y)) {
+                            incremental->black[mask]++;
+                        } else {
+                            incremental->black[mask]--;
+                        }
+                    }
+                    dirty[y >> 3] |= 1 << (y & 7);
+                    dirty[(size + x) >> 3] |= 1 << ((size + x) & 7);
+                }
+            }
+        }
+        PROFILE_LAP(timer, ticks[QR_STAGE_CODEWORDS]);
+        
+        for (uint16_t line = 0; line < 2 * size; line++) {
+            if (!(dirty[line >> 3] & (1 << (line & 7)))) { continue; }
+            
+            bool column = line >= size;
+            uint8_t index = column ? line - size : line;
+            for (uint8_t mask = 0; mask < 8; mask++) {
+                bb_wrapGrid(&grid, grids + mask * gridBytes, size);
+                uint16_t *penalty = &lines[mask * 2 * size + line];
+                incremental->lines[mask] -= *penalty;
+                *penalty = getLinePenalty(&grid, index, column);
+                incremental->lines[mask] += *penalty;
+            }
+        }
+        PROFILE_LAP(timer, ticks[QR_STAGE_PENALTY]);
+    }
+    
+    memcpy(previous, codewords->data, codewords->capacityBytes);
+    
+    // Lowest penalty, the first of equals as in drawSymbol
+    uint8_t best = 0;
+    uint32_t minPenalty = UINT32_MAX;
+    for (uint8_t mask = 0; mask < 8; mask++) {
+        uint32_t penalty = incremental->lines[mask] + incremental->blocks[mask] * PENALTY_N2 + getBalancePenalty(incremental->black[mask], size * size);
+        PROFILE_DO(timer, penalty[mask] = penalty);
+        if (penalty < minPenalty) {
+            best = mask;
+            minPenalty = penalty;
+        }
+    }
+    
+    qrcode->mask = best;
+    memcpy(qrcode->modules, grids + best * gridBytes, gridBytes);
+    PROFILE_LAP(timer, ticks[QR_STAGE_FORMAT]);
+}
+
+int8_t qrcode_initBytesIncremental(QRCode *qrcode, uint8_t *modules, QRIncremental *incremental, const QRPrefix *prefix, const uint8_t *data, uint16_t length, uint8_t *workspace) {
+    uint8_t version = incremental->version;
+    uint8_t ecc = incremental->ecc;
+    if (prefix && (prefix->version != version || prefix->ecc != ecc)) { return -1; }
+    
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->mode = MODE_MIXED;
+    qrcode->modules = modules;
+    
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+#else
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+#endif
+    
+    uint8_t *codewordBytes = workspace;
+    uint8_t *scratch = codewordBytes + bb_getBufferSizeBytes(moduleCount) + bb_getGridSizeBytes(size);
+    uint8_t *modes = scratch + getErrorCorrectionScratchSize(version, eccFormatBits);
+    
+    BitBucket codewords;
+    int8_t mode;
+    if (prefix) {
+        mode = buildPrefixedCodewords(&codewords, codewordBytes, prefix, data, length, eccFormatBits, moduleCount, dataCapacity, scratch, modes);
+    } else {
+        bb_initBuffer(&codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
+        mode = buildCodewords(&codewords, (uint8_t *)data, length, MODE_MIXED, version, eccFormatBits, dataCapacity, scratch, modes);
+    }
+    if (mode < 0) { return -1; }
+    
+    drawSymbolIncremental(qrcode, incremental, eccFormatBits, &codewords);
+    
+    return 0;
+}
+
+/* int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data) { */
+/*     return qrcode_initBytes(qrcode, modules, version, ecc, (uint8_t*)data, strlen(data)); */
+/* } */
+
+bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y) {
+    if (x >= qrcode->size || y >= qrcode->size) {
+        return false;
+    }
+
+    uint32_t offset = y * qrcode->size + x;
+    return (qrcode->modules[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0;
+}
+
+
+// Byte-expansion tables for the common integer scales: each entry is one source
+// nibble (MSB = leftmost module) stretched to 2, 3 or 4 pixels per module
+static const uint8_t RASTER_EXPAND_2X[16] = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F, 0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
+};
+
+static const uint16_t RASTER_EXPAND_3X[16] = {
+    0x000, 0x007, 0x038, 0x03F, 0x1C0, 0x1C7, 0x1F8, 0x1FF, 0xE00, 0xE07, 0xE38, 0xE3F, 0xFC0, 0xFC7, 0xFF8, 0xFFF
+};
+
+static const uint16_t RASTER_EXPAND_4X[16] = {
+    0x0000, 0x000F, 0x00F0, 0x00FF, 0x0F00, 0x0F0F, 0x0FF0, 0x0FFF,
+    0xF000, 0xF00F, 0xF0F0, 0xF0FF, 0xFF00, 0xFF0F, 0xFFF0, 0xFFFF
+};
+
+static const uint8_t RASTER_REVERSE_NIBBLE[16] = {
+    0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+};
+
+static uint8_t raster_reverseByte(uint8_t value) {
+    return (RASTER_REVERSE_NIBBLE[value & 0x0F] << 4) | RASTER_REVERSE_NIBBLE[value >> 4];
+}
+
+// Appends the low length bits of val (MSB first) to an MSB-first line
+static void raster_appendBits(uint8_t *line, uint32_t *offset, uint32_t val, uint8_t length) {
+    while (length > 0) {
+        uint8_t room = 8 - (*offset & 7);
+        uint8_t take = length < room ? length : room;
+        uint8_t bits = (val >> (length - take)) & ((1 << take) - 1);
+        line[*offset >> 3] |= bits << (room - take);
+        *offset += take;
+        length -= take;
+    }
+}
+
+static void raster_appendRun(uint8_t *line, uint32_t *offset, bool on, uint32_t length) {
+    for (; length >= 16; length -= 16) {
+        raster_appendBits(line, offset, on ? 0xFFFF : 0, 16);
+    }
+    raster_appendBits(line, offset, on ? 0xFFFF : 0, length);
+}
+
+uint16_t qrcode_getRasterSize(QRCode *qrcode, uint8_t scale, uint8_t quietZone) {
+    return (qrcode->size + 2 * quietZone) * scale;
+}
+
+void qrcode_rasterizeRow(QRCode *qrcode, uint8_t *line, uint16_t row, uint8_t scale, uint8_t quietZone, uint8_t bitOrder) {
+    uint8_t size = qrcode->size;
+    uint16_t width = qrcode_getRasterSize(qrcode, scale, quietZone);
+    memset(line, 0, (width + 7) / 8);
+    if (scale == 0) { return; }
+    
+    uint32_t offset = (uint32_t)quietZone * scale;
+    int16_t y = row / scale - quietZone;
+    
+    if (y >= 0 && y < size) {
+        // Gather the module row into whole bytes first; grid rows are not byte aligned
+        uint8_t modules[(size + 7) / 8];
+        memset(modules, 0, sizeof(modules));
+        uint32_t bit = (uint32_t)y * size;
+        for (uint8_t x = 0; x < size; x++, bit++) {
+            if (qrcode->modules[bit >> 3] & (1 << (7 - (bit & 7)))) {
+                modules[x >> 3] |= 1 << (7 - (x & 7));
+            }
+        }
+        
+        for (uint8_t x = 0; x < size; x += 4) {
+            uint8_t nibble = (modules[x >> 3] >> ((x & 4) ? 0 : 4)) & 0x0F;
+            uint8_t count = (size - x < 4) ? size - x : 4;
+            uint8_t drop = 4 - count;  // Unused low bits of the last nibble
+            
+            switch (scale) {
+                case 1:  raster_appendBits(line, &offset, nibble >> drop, count);                             break;
+                case 2:  raster_appendBits(line, &offset, RASTER_EXPAND_2X[nibble] >> (2 * drop), 2 * count); break;
+                case 3:  raster_appendBits(line, &offset, RASTER_EXPAND_3X[nibble] >> (3 * drop), 3 * count); break;
+                case 4:  raster_appendBits(line, &offset, RASTER_EXPAND_4X[nibble] >> (4 * drop), 4 * count); break;
+                default:
+                    for (int8_t i = 3; i >= drop; i--) {
+                        raster_appendRun(line, &offset, (nibble >> i) & 1, scale);
+                    }
+                    break;
+            }
+        }
+    }
+    
+    if (bitOrder == QR_RASTER_XBM) {
+        for (uint16_t i = 0; i < (width + 7) / 8; i++) {
+            line[i] = raster_reverseByte(line[i]);
+        }
+    }
+}
+
+void qrcode_rasterize(QRCode *qrcode, const QRRaster *raster) {
+    if (raster->scale == 0) { return; }
+    
+    uint16_t width = qrcode_getRasterSize(qrcode, raster->scale, raster->quietZone);
+    uint16_t lineBytes = (width + 7) / 8;
+    uint8_t shift = raster->x & 7;
+    uint8_t line[lineBytes + 1];
+    
+    // Edge masks of the destination bytes that belong to this raster
+    uint8_t headMask = raster->bitOrder == QR_RASTER_XBM ? (0xFF << shift) : (0xFF >> shift);
+    uint8_t tailBits = (shift + width) & 7;
+    uint8_t tailMask = tailBits == 0 ? 0xFF : (raster->bitOrder == QR_RASTER_XBM ? (0xFF >> (8 - tailBits)) : (0xFF << (8 - tailBits)));
+    uint16_t spanBytes = (shift + width + 7) / 8;
+    
+    for (uint16_t row = 0; row < width; row += raster->scale) {
+        qrcode_rasterizeRow(qrcode, line, row, raster->scale, raster->quietZone, raster->bitOrder);
+        line[lineBytes] = 0;
+        
+        // Move the line to the destination bit offset
+        if (shift) {
+            for (int16_t i = lineBytes; i >= 0; i--) {
+                uint8_t prev = i > 0 ? line[i - 1] : 0;
+                if (raster->bitOrder == QR_RASTER_XBM) {
+                    line[i] = (line[i] << shift) | (prev >> (8 - shift));
+                } else {
+                    line[i] = (line[i] >> shift) | (prev << (8 - shift));
+                }
+            }
+        }
+        
+        // Every module row becomes scale identical pixel rows
+        for (uint8_t dy = 0; dy < raster->scale; dy++) {
+            uint8_t *dest = raster->buffer + (uint32_t)(raster->y + row + dy) * raster->stride + raster->x / 8;
+            if (spanBytes == 1) {
+                uint8_t mask = headMask & tailMask;
+                dest[0] = (dest[0] & ~mask) | (line[0] & mask);
+                continue;
+            }
+            dest[0] = (dest[0] & ~headMask) | (line[0] & headMask);
+            memcpy(&dest[1], &line[1], spanBytes - 2);
+            dest[spanBytes - 1] = (dest[spanBytes - 1] & ~tailMask) | (line[spanBytes - 1] & tailMask);
+        }
+    }
+}
+
+int8_t qrcode_initBytesRaster(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, const QRRaster *raster) {
+    int8_t result = qrcode_initBytes(qrcode, modules, mode, version, ecc, data, length);
+    if (result < 0) { return result; }
+    
+    qrcode_rasterize(qrcode, raster);
+    return result;
+}
+
+// The run of dark modules [x, end) of row y, with light modules or the edge on both
+// sides, exists exactly as given
+static bool rects_isRun(QRCode *qrcode, uint8_t x, uint8_t end, uint8_t y) {
+    if ((x > 0 && qrcode_getModule(qrcode, x - 1, y)) || qrcode_getModule(qrcode, end, y)) { return false; }
+    for (uint8_t i = x; i < end; i++) {
+        if (!qrcode_getModule(qrcode, i, y)) { return false; }
+    }
+    return true;
+}
+
+uint16_t qrcode_getRects(QRCode *qrcode, bool merge, QRRectCallback callback, void *context) {
+    uint8_t size = qrcode->size;
+    uint16_t count = 0;
+    
+    for (uint8_t y = 0; y < size; y++) {
+        for (uint8_t x = 0; x < size; ) {
+            if (!qrcode_getModule(qrcode, x, y)) {
+                x++;
+                continue;
+            }
+            
+            uint8_t end = x + 1;
+            while (end < size && qrcode_getModule(qrcode, end, y)) { end++; }
+            
+            // The same run one row up already opened a rectangle that reaches down here;
+            // otherwise this one grows down over every row that repeats the run
+            if (!merge || y == 0 || !rects_isRun(qrcode, x, end, y - 1)) {
+                QRRect rect = { x, y, (uint8_t)(end - x), 1 };
+                while (merge && y + rect.height < size && rects_isRun(qrcode, x, end, y + rect.height)) {
+                    rect.height++;
+                }
+                callback(context, &rect);
+                count++;
+            }
+            
+            x = end;
+        }
+    }
+    
+    return count;
+}
+
+#if QR_BATCH_LANES
+
+// Bit-sliced batch encoding: every module position holds one qr_lane_t whose bit i
+// belongs to the symbol in lane i, so placement, masking and penalty scoring run for
+// all lanes with plain word operations. Only the codeword generation is per lane.
+
+#define LANES_ALL   ((qr_lane_t)~(qr_lane_t)0)
+
+// Bit-sliced 16-bit counters; bit b of the per-lane count lives in counter[b]
+#define BS_COUNTER_BITS 16
+
+static void bs_count(qr_lane_t *counter, qr_lane_t bits) {
+    for (uint8_t b = 0; bits && b < BS_COUNTER_BITS; b++) {
+        qr_lane_t carry = counter[b] & bits;
+        counter[b] ^= bits;
+        bits = carry;
+    }
+}
+
+static uint16_t bs_getCount(const qr_lane_t *counter, uint8_t lane) {
+    uint16_t result = 0;
+    for (uint8_t b = 0; b < BS_COUNTER_BITS; b++) {
+        result |= (uint16_t)((counter[b] >> lane) & 1) << b;
+    }
+    return result;
+}
+
+static bool getMaskBit(uint8_t mask, uint8_t x, uint8_t y) {
+    switch (mask) {
+        case 0:  return (x + y) % 2 == 0;
+        case 1:  return y % 2 == 0;
+        case 2:  return x % 3 == 0;
+        case 3:  return (x + y) % 3 == 0;
+        case 4:  return (x / 3 + y / 2) % 2 == 0;
+        case 5:  return x * y % 2 + x * y % 3 == 0;
+        case 6:  return (x * y % 2 + x * y % 3) % 2 == 0;
+        case 7:  return ((x + y) % 2 + x * y % 3) % 2 == 0;
+    }
+    return false;
+}
+
+// Same zigzag scan as drawCodewords, reading one word of lanes per data bit
+static void bs_drawCodewords(qr_lane_t *modules, BitBucket *isFunction, const qr_lane_t *stream, uint32_t bitLength) {
+    uint8_t size = isFunction->bitOffsetOrWidth;
+    uint32_t i = 0;
+    
+    for (int16_t right = size - 1; right >= 1; right -= 2) {
+        if (right == 6) { right = 5; }
+        
+        for (uint8_t vert = 0; vert < size; vert++) {
+            for (int j = 0; j < 2; j++) {
+                uint8_t x = right - j;
+                bool upwards = ((right & 2) == 0) ^ (x < 6);
+                uint8_t y = upwards ? size - 1 - vert : vert;
+                if (!bb_getBit(isFunction, x, y) && i < bitLength) {
+                    modules[y * size + x] = stream[i++];
+                }
+            }
+        }
+    }
+}
+
+static void bs_applyMask(qr_lane_t *modules, BitBucket *isFunction, uint8_t mask, qr_lane_t lanes) {
+    uint8_t size = isFunction->bitOffsetOrWidth;
+    
+    for (uint8_t y = 0; y < size; y++) {
+        for (uint8_t x = 0; x < size; x++) {
+            if (bb_getBit(isFunction, x, y) || !getMaskBit(mask, x, y)) { continue; }
+            modules[y * size + x] ^= lanes;
+        }
+    }
+}
+
+// Writes the format bits of the given mask into the lanes selected by lanes. The
+// format modules all live in row 8 and column 8, so those are copied from the
+// scalar function grid after drawFormatBits has updated it.
+static void bs_drawFormatBits(qr_lane_t *modules, BitBucket *functionGrid, BitBucket *isFunction, uint8_t ecc, uint8_t mask, qr_lane_t lanes) {
+    uint8_t size = isFunction->bitOffsetOrWidth;
+    
+    drawFormatBits(functionGrid, isFunction, ecc, mask);
+    
+    for (uint8_t i = 0; i < size; i++) {
+        qr_lane_t *row = &modules[8 * size + i];
+        qr_lane_t *col = &modules[i * size + 8];
+        if (bb_getBit(isFunction, i, 8)) {
+            *row = (*row & ~lanes) | (bb_getBit(functionGrid, i, 8) ? lanes : 0);
+        }
+        if (bb_getBit(isFunction, 8, i)) {
+            *col = (*col & ~lanes) | (bb_getBit(functionGrid, 8, i) ? lanes : 0);
+        }
+    }
+}
+
+// Per-lane event counts; the penalty is recombined from them in bs_getPenaltyScore
+typedef struct PenaltyCounters {
+    qr_lane_t run5[BS_COUNTER_BITS];     // a same-color run reached exactly 5
+    qr_lane_t runLong[BS_COUNTER_BITS];  // a same-color run grew past 5
+    qr_lane_t block[BS_COUNTER_BITS];    // 2*2 blocks of the same color
+    qr_lane_t finder[BS_COUNTER_BITS];   // finder-like patterns
+    qr_lane_t black[BS_COUNTER_BITS];    // dark modules
+} PenaltyCounters;
+
+// Counts runs along one line (row or column); step is the distance between modules
+static void bs_countLine(PenaltyCounters *counters, const qr_lane_t *line, uint8_t size, uint16_t step) {
+    qr_lane_t same[5] = { 0 };  // same[k]: module i-k equals module i-k-1
+    
+    for (uint8_t i = 1; i < size; i++) {
+        for (uint8_t k = 4; k > 0; k--) { same[k] = same[k - 1]; }
+        same[0] = ~(line[i * step] ^ line[(i - 1) * step]);
+        
+        // The run ending here is at least 5 long once the last 4 steps stayed the same
+        if (i >= 4) {
+            qr_lane_t atLeast5 = same[0] & same[1] & same[2] & same[3];
+            qr_lane_t longer = (i >= 5) ? (atLeast5 & same[4]) : 0;
+            bs_count(counters->run5, atLeast5 & ~longer);
+            bs_count(counters->runLong, longer);
+        }
+        
+        // Finder-like pattern 1:1:3:1:1 with 4 light modules on either side
+        if (i >= 10) {
+            qr_lane_t match05D = LANES_ALL, match5D0 = LANES_ALL;
+            for (uint8_t k = 0; k < 11; k++) {
+                qr_lane_t c = line[(i - k) * step];
+                match05D &= ((0x05D >> k) & 1) ? c : ~c;
+                match5D0 &= ((0x5D0 >> k) & 1) ? c : ~c;
+            }
+            bs_count(counters->finder, match05D | match5D0);
+        }
+    }
+}
+
+// Computes getPenaltyScore for every lane at once
+static void bs_getPenaltyScore(const qr_lane_t *modules, uint8_t size, uint8_t count, uint32_t *penalties) {
+    PenaltyCounters counters;
+    memset(&counters, 0, sizeof(counters));
+    
+    for (uint8_t i = 0; i < size; i++) {
+        bs_countLine(&counters, &modules[i * size], size, 1);
+        bs_countLine(&counters, &modules[i], size, size);
+    }
+    
+    for (uint8_t y = 0; y < size; y++) {
+        for (uint8_t x = 0; x < size; x++) {
+            qr_lane_t color = modules[y * size + x];
+            if (x > 0 && y > 0) {
+                qr_lane_t colorUL = modules[(y - 1) * size + x - 1];
+                qr_lane_t colorUR = modules[(y - 1) * size + x];
+                qr_lane_t colorL = modules[y * size + x - 1];
+                bs_count(counters.block, ~(color ^ colorUL) & ~(color ^ colorUR) & ~(color ^ colorL));
+            }
+            bs_count(counters.black, color);
+        }
+    }
+    
+    for (uint8_t lane = 0; lane < count; lane++) {
+        penalties[lane] = PENALTY_N1 * bs_getCount(counters.run5, lane)
+                        + bs_getCount(counters.runLong, lane)
+                        + PENALTY_N2 * bs_getCount(counters.block, lane)
+                        + PENALTY_N3 * bs_getCount(counters.finder, lane)
+                        + getBalancePenalty(bs_getCount(counters.black, lane), size * size);
+    }
+}
+
+uint32_t qrcode_getBatchBufferSize(uint8_t version) {
+    uint8_t size = 4 * version + 17;
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+#else
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+#endif
+    return (uint32_t)size * size + moduleCount;
+}
+
+int8_t qrcode_initBytesBatch(QRCodeBatch *batch, qr_lane_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t **data, const uint16_t *lengths, uint8_t count) {
+    if (count == 0 || count > QR_BATCH_LANES) { return -1; }
+    
+    uint8_t size = version * 4 + 17;
+    batch->version = version;
+    batch->size = size;
+    batch->ecc = ecc;
+    batch->count = count;
+    batch->modules = modules;
+    
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    
+#if LOCK_VERSION == 0
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+#else
+    version = LOCK_VERSION;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+#endif
+    
+    qr_lane_t lanes = (count == QR_BATCH_LANES) ? LANES_ALL : (((qr_lane_t)1 << count) - 1);
+    
+    // The codeword bit streams are transposed behind the module grid, one word per bit
+    qr_lane_t *stream = &modules[size * size];
+    memset(stream, 0, moduleCount * sizeof(qr_lane_t));
+    
+    struct BitBucket codewords;
+    uint8_t codewordBytes[bb_getBufferSizeBytes(moduleCount)];
+    uint8_t scratch[getErrorCorrectionScratchSize(version, eccFormatBits)];
+    uint8_t modes[getMaxCharacters(dataCapacity)];
+    
+    for (uint8_t lane = 0; lane < count; lane++) {
+        bb_initBuffer(&codewords, codewordBytes, (int32_t)sizeof(codewordBytes));
+        int8_t laneMode = buildCodewords(&codewords, data[lane], lengths[lane], mode, version, eccFormatBits, dataCapacity, scratch, modes);
+        if (laneMode < 0) { return -1; }
+        batch->modes[lane] = laneMode;
+        
+        for (uint32_t i = 0; i < codewords.bitOffsetOrWidth; i++) {
+            stream[i] |= (qr_lane_t)((codewordBytes[i >> 3] >> (7 - (i & 7))) & 1) << lane;
+        }
+    }
+    
+    PROFILE_START(timer);
+    PROFILE_DO(timer, encodes++);
+    
+    // Function patterns are identical in every lane; draw them once and broadcast
+    BitBucket functionGrid;
+    uint8_t functionGridBytes[bb_getGridSizeBytes(size)];
+    bb_initGrid(&functionGrid, functionGridBytes, size);
+    
+    BitBucket isFunctionGrid;
+    uint8_t isFunctionGridBytes[bb_getGridSizeBytes(size)];
+    bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
+    
+    drawFunctionPatterns(&functionGrid, &isFunctionGrid, version, eccFormatBits);
+    
+    for (uint8_t y = 0; y < size; y++) {
+        for (uint8_t x = 0; x < size; x++) {
+            modules[y * size + x] = bb_getBit(&functionGrid, x, y) ? lanes : 0;
+        }
+    }
+    
+    PROFILE_LAP(timer, ticks[QR_STAGE_FUNCTION]);
+    
+    bs_drawCodewords(modules, &isFunctionGrid, stream, moduleCount);
+    PROFILE_LAP(timer, ticks[QR_STAGE_CODEWORDS]);
+    
+    // Find the best (lowest penalty) mask, separately for each lane
+    uint32_t minPenalty[QR_BATCH_LANES];
+    uint32_t penalties[QR_BATCH_LANES];
+    qr_lane_t selected[8] = { 0 };
+    for (uint8_t i = 0; i < 8; i++) {
+        PROFILE_START(trial);
+        bs_drawFormatBits(modules, &functionGrid, &isFunctionGrid, eccFormatBits, i, lanes);
+        bs_applyMask(modules, &isFunctionGrid, i, lanes);
+        PROFILE_LAP(timer, ticks[QR_STAGE_MASK]);
+        bs_getPenaltyScore(modules, size, count, penalties);
+        PROFILE_LAP(timer, ticks[QR_STAGE_PENALTY]);
+        PROFILE_DO(timer, penalty[i] = penalties[0]);
+        for (uint8_t lane = 0; lane < count; lane++) {
+            if (i == 0 || penalties[lane] < minPenalty[lane]) {
+                batch->mask[lane] = i;
+                minPenalty[lane] = penalties[lane];
+            }
+        }
+        bs_applyMask(modules, &isFunctionGrid, i, lanes);  // Undoes the mask due to XOR
+        PROFILE_LAP(timer, ticks[QR_STAGE_MASK]);
+        PROFILE_LAP(trial, maskTicks[i]);
+    }
+    
+    for (uint8_t lane = 0; lane < count; lane++) {
+        selected[batch->mask[lane]] |= (qr_lane_t)1 << lane;
+    }
+    
+    // Overwrite old format bits and apply each lane's final choice of mask
+    for (uint8_t i = 0; i < 8; i++) {
+        if (!selected[i]) { continue; }
+        bs_drawFormatBits(modules, &functionGrid, &isFunctionGrid, eccFormatBits, i, selected[i]);
+        bs_applyMask(modules, &isFunctionGrid, i, selected[i]);
+    }
+    PROFILE_LAP(timer, ticks[QR_STAGE_FORMAT]);
+    
+    return 0;
+}
+
+bool qrcode_getBatchModule(QRCodeBatch *batch, uint8_t lane, uint8_t x, uint8_t y) {
+    if (lane >= batch->count || x >= batch->size || y >= batch->size) {
+        return false;
+    }
+    
+    return ((batch->modules[y * batch->size + x] >> lane) & 1) != 0;
+}
+
+void qrcode_getBatchSymbol(QRCodeBatch *batch, uint8_t lane, QRCode *qrcode, uint8_t *modules) {
+    uint8_t size = batch->size;
+    qrcode->version = batch->version;
+    qrcode->size = size;
+    qrcode->ecc = batch->ecc;
+    qrcode->mode = batch->modes[lane];
+    qrcode->mask = batch->mask[lane];
+    qrcode->modules = modules;
+    
+    BitBucket modulesGrid;
+    bb_initGrid(&modulesGrid, modules, size);
+    
+    for (uint8_t y = 0; y < size; y++) {
+        for (uint8_t x = 0; x < size; x++) {
+            bb_setBit(&modulesGrid, x, y, qrcode_getBatchModule(batch, lane, x, y));
+        }
+    }
+}
+
+#endif
+
+
+#if QR_THREADS
+
+// Items not yet taken by a thread, [begin, end) packed as begin << 32 | end. The
+// owner takes from the front; a thief takes the back half in one compare-exchange.
+typedef _Atomic uint64_t QRRange;
+
+#define RANGE_PACK(begin, end)  (((uint64_t)(begin) << 32) | (uint32_t)(end))
+#define RANGE_BEGIN(range)      ((uint32_t)((range) >> 32))
+#define RANGE_END(range)        ((uint32_t)(range))
+
+// A symbol of one thread whose mask trials any idle thread may run. next stays at 8
+// or above while there is none; the owner fills in the grids, then resets done and
+// finally next, so a thread that claims a trial also sees the grids it belongs to.
+typedef struct QRSplit {
+    BitBucket modules;
+    BitBucket isFunction;
+    uint8_t eccFormatBits;
+    atomic_uint next;
+    atomic_uint done;
+    uint32_t penalty[8];
+} QRSplit;
+
+typedef struct QRPool {
+    QRBatchItem *items;
+    uint8_t threads;
+    atomic_uint pending;  // Items not yet finished
+    QRRange *ranges;
+    QRSplit *splits;
+} QRPool;
+
+typedef struct QRPoolThread {
+    QRPool *pool;
+    uint8_t index;
+    uint8_t *workspace;
+    uint8_t *trial;       // Copies of both grids for one mask trial
+} QRPoolThread;
+
+static bool pool_take(QRRange *range, uint32_t *index) {
+    uint64_t current = atomic_load(range);
+    while (RANGE_BEGIN(current) < RANGE_END(current)) {
+        uint64_t next = RANGE_PACK(RANGE_BEGIN(current) + 1, RANGE_END(current));
+        if (atomic_compare_exchange_weak(range, &current, next)) {
+            *index = RANGE_BEGIN(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves the back half of another thread's items into the thief's own, empty, range
+static bool pool_steal(QRPool *pool, uint8_t thief) {
+    for (uint8_t i = 1; i < pool->threads; i++) {
+        QRRange *victim = &pool->ranges[(thief + i) % pool->threads];
+        uint64_t current = atomic_load(victim);
+        while (RANGE_BEGIN(current) < RANGE_END(current)) {
+            uint32_t half = (RANGE_END(current) - RANGE_BEGIN(current) + 1) / 2;
+            uint32_t split = RANGE_END(current) - half;
+            if (atomic_compare_exchange_weak(victim, &current, RANGE_PACK(RANGE_BEGIN(current), split))) {
+                atomic_store(&pool->ranges[thief], RANGE_PACK(split, split + half));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// One mask trial of drawSymbol, on copies of the grids so that trials of a symbol
+// can run side by side
+static void pool_tryMask(QRSplit *split, uint8_t mask, uint8_t *trial) {
+    uint16_t gridBytes = split->modules.capacityBytes;
+    
+    BitBucket modulesGrid = split->modules;
+    BitBucket isFunctionGrid = split->isFunction;
+    modulesGrid.data = trial;
+    isFunctionGrid.data = trial + gridBytes;
+    memcpy(modulesGrid.data, split->modules.data, gridBytes);
+    memcpy(isFunctionGrid.data, split->isFunction.data, gridBytes);
+    
+    drawFormatBits(&modulesGrid, &isFunctionGrid, split->eccFormatBits, mask);
+    applyMask(&modulesGrid, &isFunctionGrid, mask);
+    split->penalty[mask] = getPenaltyScore(&modulesGrid);
+    
+    atomic_fetch_add_explicit(&split->done, 1, memory_order_release);
+}
+
+// Runs one pending mask trial of another thread's symbol, if there is any
+static bool pool_help(QRPool *pool, QRPoolThread *thread) {
+    for (uint8_t i = 1; i < pool->threads; i++) {
+        QRSplit *split = &pool->splits[(thread->index + i) % pool->threads];
+        if (atomic_load_explicit(&split->next, memory_order_relaxed) >= 8) { continue; }
+        
+        unsigned mask = atomic_fetch_add_explicit(&split->next, 1, memory_order_acquire);
+        if (mask >= 8) { continue; }
+        
+        pool_tryMask(split, mask, thread->trial);
+        return true;
+    }
+    return false;
+}
+
+// qrcode_initBytesWorkspace with the mask trials offered to idle threads
+static int8_t pool_encodeSplit(QRPoolThread *thread, QRBatchItem *item) {
+    QRSplit *split = &thread->pool->splits[thread->index];
+    QRCode *qrcode = &item->qrcode;
+    uint8_t version = item->version;
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = item->ecc;
+    qrcode->modules = item->modules;
+    
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * item->ecc)) & 0x03;
+    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+    
+    uint8_t *codewordBytes = thread->workspace;
+    uint8_t *isFunctionGridBytes = codewordBytes + bb_getBufferSizeBytes(moduleCount);
+    uint8_t *scratch = isFunctionGridBytes + bb_getGridSizeBytes(size);
+    uint8_t *modes = scratch + getErrorCorrectionScratchSize(version, eccFormatBits);
+    
+    BitBucket codewords;
+    bb_initBuffer(&codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
+    int8_t mode = buildCodewords(&codewords, (uint8_t *)item->data, item->length, item->mode, version, eccFormatBits, dataCapacity, scratch, modes);
+    if (mode < 0) { return -1; }
+    qrcode->mode = mode;
+    
+    bb_initGrid(&split->modules, item->modules, size);
+    bb_initGrid(&split->isFunction, isFunctionGridBytes, size);
+    drawFunctionPatterns(&split->modules, &split->isFunction, version, eccFormatBits);
+    drawCodewords(&split->modules, &split->isFunction, &codewords);
+    split->eccFormatBits = eccFormatBits;
+    atomic_store_explicit(&split->done, 0, memory_order_relaxed);
+    atomic_store_explicit(&split->next, 0, memory_order_release);
+    
+    // Take trials like any helper, then wait for the ones others took; they are a few
+    // hundred microseconds each, so a yield loop is cheaper than a sleep and wake-up
+    unsigned mask;
+    while ((mask = atomic_fetch_add_explicit(&split->next, 1, memory_order_acquire)) < 8) {
+        pool_tryMask(split, mask, thread->trial);
+    }
+    while (atomic_load_explicit(&split->done, memory_order_acquire) < 8) { sched_yield(); }
+    
+    // Lowest penalty, the first of equals as in drawSymbol
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < 8; i++) {
+        if (split->penalty[i] < split->penalty[best]) { best = i; }
+    }
+    qrcode->mask = best;
+    drawFormatBits(&split->modules, &split->isFunction, eccFormatBits, best);
+    applyMask(&split->modules, &split->isFunction, best);
+    
+    return 0;
+}
+
+static void pool_encode(QRPoolThread *thread, QRBatchItem *item) {
+    if (item->version < 1 || item->version > 40 || item->ecc > ECC_HIGH) {
+        item->result = -1;
+    } else if (item->version >= QR_THREADS_SPLIT_VERSION && thread->pool->threads > 1) {
+        item->result = pool_encodeSplit(thread, item);
+    } else {
+        item->result = qrcode_initBytesWorkspace(&item->qrcode, item->modules, item->mode, item->version, item->ecc, (uint8_t *)item->data, item->length, thread->workspace);
+    }
+    atomic_fetch_sub(&thread->pool->pending, 1);
+}
+
+static void *pool_run(void *context) {
+    QRPoolThread *thread = context;
+    QRPool *pool = thread->pool;
+    
+    while (atomic_load(&pool->pending) > 0) {
+        uint32_t index;
+        if (pool_take(&pool->ranges[thread->index], &index)) {
+            pool_encode(thread, &pool->items[index]);
+        } else if (!pool_steal(pool, thread->index) && !pool_help(pool, thread)) {
+            // Nothing left to take; stay around for the mask trials of the last symbols.
+            // This busy-waits, which suits host tools with a core per thread
+            sched_yield();
+        }
+    }
+    
+    return NULL;
+}
+
+int8_t qrcode_encodeBatch(QRBatchItem *items, uint32_t count, uint8_t threads) {
+    if (count == 0) { return 0; }
+    if (threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cores < 1) ? 1 : (cores > 255) ? 255 : cores;
+    }
+    
+    // Every thread's workspace fits the largest item; items that cannot be encoded
+    // fail here and do not count
+    uint32_t workspaceSize = 0;
+    uint16_t gridBytes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        items[i].result = -1;
+        if (items[i].version < 1 || items[i].version > 40 || items[i].ecc > ECC_HIGH) { continue; }
+        uint32_t size = qrcode_getWorkspaceSize(items[i].version, items[i].ecc);
+        if (size > workspaceSize) { workspaceSize = size; }
+        if (bb_getGridSizeBytes(items[i].version * 4 + 17) > gridBytes) { gridBytes = bb_getGridSizeBytes(items[i].version * 4 + 17); }
+    }
+    if (workspaceSize == 0) { return 0; }
+    
+    QRPool pool;
+    pool.items = items;
+    pool.threads = threads;
+    atomic_init(&pool.pending, count);
+    pool.ranges = (QRRange *)QR_MALLOC(threads * sizeof(QRRange));
+    pool.splits = (QRSplit *)QR_MALLOC(threads * sizeof(QRSplit));
+    QRPoolThread *poolThreads = (QRPoolThread *)QR_MALLOC(threads * sizeof(QRPoolThread));
+    uint8_t *buffers = (uint8_t *)QR_MALLOC(threads * (workspaceSize + 2 * gridBytes));
+    pthread_t *handles = (pthread_t *)QR_MALLOC(threads * (sizeof(pthread_t) + sizeof(bool)));
+    
+    int8_t result = -1;
+    if (pool.ranges && pool.splits && poolThreads && buffers && handles) {
+        // Contiguous shares to begin with, so threads mostly steal near the end
+        for (uint8_t t = 0; t < threads; t++) {
+            atomic_init(&pool.ranges[t], RANGE_PACK((uint64_t)count * t / threads, (uint64_t)count * (t + 1) / threads));
+            atomic_init(&pool.splits[t].next, 8);
+            atomic_init(&pool.splits[t].done, 8);
+            poolThreads[t].pool = &pool;
+            poolThreads[t].index = t;
+            poolThreads[t].workspace = buffers + t * (workspaceSize + 2 * gridBytes);
+            poolThreads[t].trial = poolThreads[t].workspace + workspaceSize;
+        }
+        
+        // The calling thread is thread 0; a thread that fails to start leaves its
+        // share to be stolen
+        bool *started = (bool *)(handles + threads);
+        for (uint8_t t = 1; t < threads; t++) {
+            started[t] = pthread_create(&handles[t], NULL, pool_run, &poolThreads[t]) == 0;
+        }
+        pool_run(&poolThreads[0]);
+        for (uint8_t t = 1; t < threads; t++) {
+            if (started[t]) { pthread_join(handles[t], NULL); }
+        }
+        result = 0;
+    }
+    
+    QR_FREE(handles);
+    QR_FREE(buffers);
+    QR_FREE(poolThreads);
+    QR_FREE(pool.splits);
+    QR_FREE(pool.ranges);
+    
+    return result;
+}
+
+#endif
+
 /*
 uint8_t qrcode_getHexLength(QRCode *qrcode) {
     return ((qrcode->size * qrcode->size) + 7) / 4;
@@ -44,6 +44,7 @@
 // #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -51,6 +52,12 @@
 #define MODE_NUMERIC        0
 #define MODE_ALPHANUMERIC   1
 #define MODE_BYTE           2
+#define MODE_MIXED          3   // Cheapest mix of the three, split per character run
+
+
+// Raster bit orders for 1bpp output
+#define QR_RASTER_XBM       0   // LSB is the leftmost pixel (XBM, Flipper canvas)
+#define QR_RASTER_MSB       1   // MSB is the leftmost pixel (BMP and most displays)
 
 
 // Error Correction Code Levels
@@ -66,6 +73,42 @@
 #define LOCK_VERSION       0
 #endif
 
+// If set to non-zero, the Reed-Solomon remainders of all blocks are computed together
+// with split-nibble multiply tables (PSHUFB on SSSE3, TBL on AArch64, scalar otherwise).
+// Results are identical; it costs about 32 bytes of workspace per ECC codeword of a block.
+#ifndef QR_VECTOR_RS
+#define QR_VECTOR_RS       0
+#endif
+
+// Allocator used by qrcode_initBytesEx when no QRAllocator is passed
+#ifndef QR_MALLOC
+#define QR_MALLOC(size)    malloc(size)
+#define QR_FREE(ptr)       free(ptr)
+#endif
+
+// If set to 32 or 64, the bit-sliced batch encoder is compiled in; it encodes up
+// to that many same-version/same-ECC symbols at once, one machine word per module
+#ifndef QR_BATCH_LANES
+#define QR_BATCH_LANES     0
+#endif
+
+// If set to non-zero, qrcode_encodeBatch is compiled in: a pthread pool for host
+// tools that encodes many symbols across all cores. Symbols of at least
+// QR_THREADS_SPLIT_VERSION also share their eight mask trials with idle threads.
+#ifndef QR_THREADS
+#define QR_THREADS         0
+#endif
+
+#ifndef QR_THREADS_SPLIT_VERSION
+#define QR_THREADS_SPLIT_VERSION 20
+#endif
+
+// If set to non-zero, every encode times its stages with the clock of the QRProfile
+// given to qrcode_setProfile and records the penalty of each mask it tries
+#ifndef QR_PROFILE
+#define QR_PROFILE         0
+#endif
+
 
 typedef struct QRCode {
     uint8_t version;
@@ -76,6 +119,127 @@ typedef struct QRCode {
     uint8_t *modules;
 } QRCode;
 
+// Destination of qrcode_rasterize: a 1bpp buffer of stride bytes per pixel row. The
+// symbol plus quietZone light modules on every side is written at pixel (x, y), each
+// module scale*scale pixels; pixels outside that square are left untouched. A scale of
+// 0 is an empty raster: nothing is written.
+typedef struct QRRaster {
+    uint8_t *buffer;
+    uint16_t stride;
+    uint16_t x;
+    uint16_t y;
+    uint8_t scale;
+    uint8_t quietZone;
+    uint8_t bitOrder;
+} QRRaster;
+
+// A rectangle of dark modules from qrcode_getRects
+typedef struct QRRect {
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+} QRRect;
+
+typedef void (*QRRectCallback)(void *context, const QRRect *rect);
+
+// Where qrcode_initBytesEx takes its workspace from. alloc may return NULL, which
+// fails the encode; every block is released with free before the call returns, in
+// reverse order, so a bump arena can simply rewind.
+typedef struct QRAllocator {
+    void *(*alloc)(void *context, size_t size);
+    void (*free)(void *context, void *ptr);
+    void *context;
+} QRAllocator;
+
+// A payload prefix many encodes share, e.g. a UPI link up to its amount. RS is linear
+// over GF(256), so the ECC codewords of prefix and tail are the XOR of those of the
+// prefix with the tail taken as zero and those of the tail with the prefix taken as
+// zero. qrcode_initPrefix keeps the first part; qrcode_initBytesPrefixed then only
+// divides the tail's bytes. Prefix and tail are segmented separately (MODE_MIXED),
+// which can cost a segment header over segmenting the whole payload at once.
+typedef struct QRPrefix {
+    uint8_t version;
+    uint8_t ecc;
+    uint32_t bits;      // Data bits of the prefix's segments
+    uint8_t *cache;     // Its data codewords, then the parity of its whole bytes
+} QRPrefix;
+
+// Placement state kept between encodes at one version and ECC level: the previous
+// codewords and, for every mask, the masked symbol and its penalty split into rows,
+// columns, 2*2 blocks and dark modules. When few codewords change, an encode only
+// flips their modules and rescores the rows and columns they touch.
+typedef struct QRIncremental {
+    uint8_t version;
+    uint8_t ecc;
+    bool ready;         // The state holds the previous symbol
+    uint8_t *state;     // qrcode_getIncrementalSize() bytes
+    uint32_t lines[8];  // Per mask: rules 1 and 3 summed over rows and columns
+    uint16_t blocks[8]; // Per mask: 2*2 blocks of one color
+    uint16_t black[8];  // Per mask: dark modules
+} QRIncremental;
+
+#if QR_THREADS
+// One symbol of qrcode_encodeBatch: the payload and options as for qrcode_initBytes,
+// and the output slot it is encoded into
+typedef struct QRBatchItem {
+    const uint8_t *data;
+    uint16_t length;
+    int8_t mode;
+    uint8_t version;
+    uint8_t ecc;
+    uint8_t *modules;   // qrcode_getBufferSize(version) bytes
+    QRCode qrcode;      // Output; its modules point at the slot above
+    int8_t result;      // Output: what qrcode_initBytes would have returned
+} QRBatchItem;
+#endif
+
+#if QR_BATCH_LANES == 64
+typedef uint64_t qr_lane_t;
+#elif QR_BATCH_LANES == 32
+typedef uint32_t qr_lane_t;
+#elif QR_BATCH_LANES != 0
+#error Unsupported QR_BATCH_LANES (use 32 or 64)
+#endif
+
+#if QR_BATCH_LANES
+// Bit i of modules[y * size + x] is the module at (x, y) of the symbol in lane i
+typedef struct QRCodeBatch {
+    uint8_t version;
+    uint8_t size;
+    uint8_t ecc;
+    uint8_t count;
+    uint8_t modes[QR_BATCH_LANES];  // Per lane, as qrcode_initBytes would report it
+    uint8_t mask[QR_BATCH_LANES];
+    qr_lane_t *modules;
+} QRCodeBatch;
+#endif
+
+#if QR_PROFILE
+// Stages of an encode, in the order they run
+#define QR_STAGE_DATA       0   // Segmenting, data codewords and padding
+#define QR_STAGE_ECC        1   // Reed-Solomon blocks and interleaving
+#define QR_STAGE_FUNCTION   2   // Finder, timing, alignment and version patterns
+#define QR_STAGE_CODEWORDS  3   // Zigzag placement of the codewords
+#define QR_STAGE_MASK       4   // Format bits and applyMask (and its undo) of the trial masks
+#define QR_STAGE_PENALTY    5   // getPenaltyScore of the trial masks
+#define QR_STAGE_FORMAT     6   // Format bits and applyMask of the chosen mask
+#define QR_STAGE_COUNT      7
+
+// Ticks are differences of clock() readings, so any free-running counter that wraps
+// at 2^32 works (DWT->CYCCNT, a nanosecond timer) as long as one stage takes less than
+// a full turn. They add up over encodes until the caller clears them; penalty is
+// overwritten by each encode. The batch encoder records the penalties of lane 0.
+typedef struct QRProfile {
+    uint32_t (*clock)(void *context);
+    void *context;
+    uint32_t encodes;
+    uint64_t ticks[QR_STAGE_COUNT];
+    uint64_t maskTicks[8];  // Whole trial of each mask: format bits, mask, score, undo
+    uint32_t penalty[8];
+} QRProfile;
+#endif
+
 
 #ifdef __cplusplus
 extern "C"{
@@ -88,8 +252,99 @@ uint16_t qrcode_getBufferSize(uint8_t version);
 /* int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data); */
 int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length);
 
+// Data codewords (bytes) a version holds at an ECC level
+uint16_t qrcode_getDataCapacity(uint8_t version, uint8_t ecc);
+
+// Bits the payload encodes to at a version, before padding; for MODE_MIXED, those of
+// its cheapest segmentation. Encoding fails beyond qrcode_getDataCapacity() * 8.
+uint32_t qrcode_getBitLength(int8_t mode, uint8_t version, const uint8_t *data, uint16_t length);
+
+// Smallest version up to maxVersion the payload fits at the ECC level, 0 if none does
+uint8_t qrcode_getMinVersion(int8_t mode, uint8_t ecc, const uint8_t *data, uint16_t length, uint8_t maxVersion);
+
+// Bytes of scratch an encode needs; qrcode_initBytes keeps it on the stack
+uint32_t qrcode_getWorkspaceSize(uint8_t version, uint8_t ecc);
+
+// qrcode_initBytes with caller-provided scratch of qrcode_getWorkspaceSize() bytes
+int8_t qrcode_initBytesWorkspace(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, uint8_t *workspace);
+
+// qrcode_initBytes with the scratch taken from allocator, or from QR_MALLOC when it is NULL
+int8_t qrcode_initBytesEx(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, const QRAllocator *allocator);
+
+// Bytes of cache a QRPrefix needs at the version and ECC level
+uint16_t qrcode_getPrefixCacheSize(uint8_t version, uint8_t ecc);
+
+// Segments data as the prefix of later encodes at the version and ECC level and
+// computes its parity into cache; workspace holds qrcode_getWorkspaceSize() bytes and
+// is only used during the call. Fails when the prefix alone does not fit.
+int8_t qrcode_initPrefix(QRPrefix *prefix, uint8_t *cache, uint8_t version, uint8_t ecc, const uint8_t *data, uint16_t length, uint8_t *workspace);
+
+// Encodes the prefix followed by data, which alone goes through Reed-Solomon. Fails
+// when both together do not fit the prefix's version.
+int8_t qrcode_initBytesPrefixed(QRCode *qrcode, uint8_t *modules, const QRPrefix *prefix, const uint8_t *data, uint16_t length, uint8_t *workspace);
+
+// Bytes of state a QRIncremental needs at the version
+uint32_t qrcode_getIncrementalSize(uint8_t version);
+
+// Starts incremental encoding at the version and ECC level; the first encode through
+// it places and scores the whole symbol
+void qrcode_initIncremental(QRIncremental *incremental, uint8_t *state, uint8_t version, uint8_t ecc);
+
+// Encodes data (MODE_MIXED) after prefix, or on its own when prefix is NULL, at the
+// incremental state's version and ECC level. The symbol is bit-identical to a full
+// encode, mask choice included. workspace holds qrcode_getWorkspaceSize() bytes.
+int8_t qrcode_initBytesIncremental(QRCode *qrcode, uint8_t *modules, QRIncremental *incremental, const QRPrefix *prefix, const uint8_t *data, uint16_t length, uint8_t *workspace);
+
 bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y);
 
+// Width and height in pixels of the rasterized symbol, quiet zone included
+uint16_t qrcode_getRasterSize(QRCode *qrcode, uint8_t scale, uint8_t quietZone);
+
+void qrcode_rasterize(QRCode *qrcode, const QRRaster *raster);
+
+// Writes one pixel row of the raster to line, starting at bit 0; line must hold
+// (qrcode_getRasterSize() + 7) / 8 bytes
+void qrcode_rasterizeRow(QRCode *qrcode, uint8_t *line, uint16_t row, uint8_t scale, uint8_t quietZone, uint8_t bitOrder);
+
+// qrcode_initBytes followed by qrcode_rasterize
+int8_t qrcode_initBytesRaster(QRCode *qrcode, uint8_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length, const QRRaster *raster);
+
+// Covers the dark modules with rectangles, each module exactly once, and passes them
+// to callback from the top row down, left to right. Without merge they are the
+// horizontal runs of each row; with merge, a run repeated exactly on the rows below
+// becomes one taller rectangle. Returns how many there were.
+uint16_t qrcode_getRects(QRCode *qrcode, bool merge, QRRectCallback callback, void *context);
+
+#if QR_BATCH_LANES
+// Number of qr_lane_t words the modules buffer passed to qrcode_initBytesBatch must hold
+uint32_t qrcode_getBatchBufferSize(uint8_t version);
+
+int8_t qrcode_initBytesBatch(QRCodeBatch *batch, qr_lane_t *modules, int8_t mode, uint8_t version, uint8_t ecc, uint8_t **data, const uint16_t *lengths, uint8_t count);
+
+bool qrcode_getBatchModule(QRCodeBatch *batch, uint8_t lane, uint8_t x, uint8_t y);
+
+// Copies one lane out into a regular QRCode; modules must hold qrcode_getBufferSize(version) bytes
+void qrcode_getBatchSymbol(QRCodeBatch *batch, uint8_t lane, QRCode *qrcode, uint8_t *modules);
+#endif
+
+#if QR_THREADS
+// Encodes count items on threads threads (0: one per online core), the calling one
+// included. Each thread has its own workspace and starts on a contiguous share of the
+// items; one that runs out steals half of what another has left, then helps with the
+// mask trials of large symbols. Symbols are identical to qrcode_initBytes; an item
+// with an invalid version or ECC level gets result -1. Fails only when the workspaces
+// cannot be allocated, and then every item's result is -1. Idle threads spin on
+// sched_yield until the last symbol is done, so this is for host tools, not for
+// threads that share their cores. Leave profiling off while it runs.
+int8_t qrcode_encodeBatch(QRBatchItem *items, uint32_t count, uint8_t threads);
+#endif
+
+#if QR_PROFILE
+// Encodes that start from here on record into profile; NULL stops recording. The
+// pointer is global, so set it from the thread that encodes, or before it starts.
+void qrcode_setProfile(QRProfile *profile);
+#endif
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,207 @@
+/**
+ * C++ front end to qrcode.h for host-side services.
+ *
+ * qr::Symbol<Version, Ecc> keeps its modules in a std::array and encodes through a
+ * workspace std::array on the stack, both sized at compile time, so an encode never
+ * touches the heap and one binary can hold symbols of any number of versions. The
+ * sizes and capacities are constexpr mirrors of qrcode.c's tables and formulas;
+ * host/qr_cpp.cpp checks them against the C library for every version and level.
+ *
+ * Needs C++17; with C++20 encode() also takes a std::span.
+ */
+
+#ifndef __QRCODE_HPP_
+#define __QRCODE_HPP_
+
+#include "qrcode.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define QR_HAVE_SPAN 1
+#endif
+
+
+namespace qr {
+
+enum class Ecc : uint8_t {
+    Low = ECC_LOW,
+    Medium = ECC_MEDIUM,
+    Quartile = ECC_QUARTILE,
+    High = ECC_HIGH,
+};
+
+enum class Mode : int8_t {
+    Numeric = MODE_NUMERIC,
+    Alphanumeric = MODE_ALPHANUMERIC,
+    Byte = MODE_BYTE,
+    Mixed = MODE_MIXED,
+};
+
+namespace detail {
+
+// Indexed [ecc][version - 1], rows in Ecc order
+inline constexpr uint16_t eccCodewords[4][40] = {
+    {  7, 10, 15, 20, 26,  36,  40,  48,  60,  72,  80,  96, 104, 120, 132, 144, 168, 180, 196, 224, 224, 252, 270, 300,  312,  336,  360,  390,  420,  450,  480,  510,  540,  570,  570,  600,  630,  660,  720,  750},  // Low
+    { 10, 16, 26, 36, 48,  64,  72,  88, 110, 130, 150, 176, 198, 216, 240, 280, 308, 338, 364, 416, 442, 476, 504, 560,  588,  644,  700,  728,  784,  812,  868,  924,  980, 1036, 1064, 1120, 1204, 1260, 1316, 1372},  // Medium
+    { 13, 22, 36, 52, 72,  96, 108, 132, 160, 192, 224, 260, 288, 320, 360, 408, 448, 504, 546, 600, 644, 690, 750, 810,  870,  952, 1020, 1050, 1140, 1200, 1290, 1350, 1440, 1530, 1590, 1680, 1770, 1860, 1950, 2040},  // Quartile
+    { 17, 28, 44, 64, 88, 112, 130, 156, 192, 224, 264, 308, 352, 384, 432, 480, 532, 588, 650, 700, 750, 816, 900, 960, 1050, 1110, 1200, 1260, 1350, 1440, 1530, 1620, 1710, 1800, 1890, 1980, 2100, 2220, 2310, 2430},  // High
+};
+
+inline constexpr uint8_t eccBlocks[4][40] = {
+    {  1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
+    {  1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
+    {  1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
+    {  1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
+};
+
+// Modules left for codewords once the function patterns are drawn
+constexpr uint16_t rawDataModules(uint8_t version) {
+    uint32_t result = (16u * version + 128) * version + 64;
+    if (version >= 2) {
+        uint32_t numAlign = version / 7 + 2;
+        result -= (25 * numAlign - 10) * numAlign - 55;
+        if (version >= 7) { result -= 36; }
+    }
+    return static_cast<uint16_t>(result);
+}
+
+constexpr uint8_t countBits(uint8_t version, Mode mode) {
+    constexpr uint8_t bits[3][3] = {{10, 12, 14}, {9, 11, 13}, {8, 16, 16}};
+    return bits[static_cast<uint8_t>(mode)][version <= 9 ? 0 : version <= 26 ? 1 : 2];
+}
+
+}  // namespace detail
+
+
+constexpr uint8_t symbolSize(uint8_t version) {
+    return 4 * version + 17;
+}
+
+// qrcode_getBufferSize
+constexpr uint16_t bufferSize(uint8_t version) {
+    return (symbolSize(version) * symbolSize(version) + 7) / 8;
+}
+
+// qrcode_getDataCapacity
+constexpr uint16_t dataCapacity(uint8_t version, Ecc ecc) {
+    return detail::rawDataModules(version) / 8 - detail::eccCodewords[static_cast<uint8_t>(ecc)][version - 1];
+}
+
+// Longest payload of a single-mode segment that fits; for Mode::Mixed, of a byte segment
+constexpr uint16_t maxLength(uint8_t version, Ecc ecc, Mode mode) {
+    if (mode == Mode::Mixed) { mode = Mode::Byte; }
+    uint32_t bits = dataCapacity(version, ecc) * 8u - 4 - detail::countBits(version, mode);
+    uint32_t length = 0;
+    switch (mode) {
+        case Mode::Numeric:
+            length = bits / 10 * 3 + (bits % 10 >= 7 ? 2 : bits % 10 >= 4 ? 1 : 0);
+            break;
+        case Mode::Alphanumeric:
+            length = bits / 11 * 2 + (bits % 11 >= 6 ? 1 : 0);
+            break;
+        default:
+            length = bits / 8;
+            break;
+    }
+    uint32_t limit = (1u << detail::countBits(version, mode)) - 1;
+    return static_cast<uint16_t>(length < limit ? length : limit);
+}
+
+// qrcode_getWorkspaceSize, for the QR_VECTOR_RS setting in effect
+constexpr uint32_t workspaceSize(uint8_t version, Ecc ecc) {
+    uint32_t codewords = (detail::rawDataModules(version) + 7) / 8;
+    uint32_t scratch = codewords;
+#if QR_VECTOR_RS
+    uint32_t totalEcc = detail::eccCodewords[static_cast<uint8_t>(ecc)][version - 1];
+    scratch += totalEcc / detail::eccBlocks[static_cast<uint8_t>(ecc)][version - 1] * 32 + totalEcc;
+#endif
+    uint32_t maxCharacters = dataCapacity(version, ecc) * 12u / 5 + 1;
+    return codewords + bufferSize(version) + scratch + maxCharacters;
+}
+
+
+template <uint8_t Version, Ecc Level = Ecc::Low>
+class Symbol {
+    static_assert(Version >= 1 && Version <= 40, "QR versions run from 1 to 40");
+#if LOCK_VERSION
+    static_assert(Version == LOCK_VERSION, "qrcode.c is built for LOCK_VERSION only");
+#endif
+
+public:
+    Symbol() { qrcode_.modules = modules_.data(); }
+
+    // Copies point at their own modules, not the original's
+    Symbol(const Symbol &other) : qrcode_(other.qrcode_), modules_(other.modules_), valid_(other.valid_) {
+        qrcode_.modules = modules_.data();
+    }
+
+    Symbol &operator=(const Symbol &other) {
+        qrcode_ = other.qrcode_;
+        modules_ = other.modules_;
+        valid_ = other.valid_;
+        qrcode_.modules = modules_.data();
+        return *this;
+    }
+
+    static constexpr uint8_t version = Version;
+    static constexpr Ecc ecc = Level;
+    static constexpr uint8_t size = symbolSize(Version);
+    static constexpr uint16_t dataCapacity = qr::dataCapacity(Version, Level);
+    static constexpr uint32_t workspaceSize = qr::workspaceSize(Version, Level);
+
+    static constexpr uint16_t maxLength(Mode mode) {
+        return qr::maxLength(Version, Level, mode);
+    }
+
+    // False when the payload does not fit; the previous symbol is then invalid too.
+    // Also false when qrcode.c was built with other settings than this file sees.
+    bool encode(const uint8_t *data, size_t length, Mode mode = Mode::Mixed) {
+        std::array<uint8_t, workspaceSize> workspace;
+        valid_ = length <= UINT16_MAX && qrcode_getWorkspaceSize(Version, static_cast<uint8_t>(Level)) <= workspaceSize &&
+                 qrcode_initBytesWorkspace(&qrcode_, modules_.data(), static_cast<int8_t>(mode), Version, static_cast<uint8_t>(Level),
+                                           const_cast<uint8_t *>(data), static_cast<uint16_t>(length), workspace.data()) == 0;
+        return valid_;
+    }
+
+    bool encode(std::string_view text, Mode mode = Mode::Mixed) {
+        return encode(reinterpret_cast<const uint8_t *>(text.data()), text.size(), mode);
+    }
+
+#ifdef QR_HAVE_SPAN
+    bool encode(std::span<const uint8_t> data, Mode mode = Mode::Mixed) {
+        return encode(data.data(), data.size(), mode);
+    }
+#endif
+
+    bool valid() const { return valid_; }
+
+    bool module(uint8_t x, uint8_t y) const {
+        return qrcode_getModule(const_cast<QRCode *>(&qrcode_), x, y);
+    }
+
+    void rasterize(const QRRaster &raster) const {
+        qrcode_rasterize(const_cast<QRCode *>(&qrcode_), &raster);
+    }
+
+    uint8_t mask() const { return qrcode_.mask; }
+
+    // For the rest of the C API; modules point into this object
+    const QRCode &code() const { return qrcode_; }
+
+    const std::array<uint8_t, bufferSize(Version)> &modules() const { return modules_; }
+
+private:
+    QRCode qrcode_ = {Version, size, static_cast<uint8_t>(Level), 0, 0, nullptr};
+    std::array<uint8_t, bufferSize(Version)> modules_ = {};
+    bool valid_ = false;
+};
+
+}  // namespace qr
+
+
+#endif  /* __QRCODE_HPP_ */
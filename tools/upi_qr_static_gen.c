@@ -0,0 +1,133 @@
+// Build-time encoder for the upi_qr_static app: reads a payload, encodes it with the
+// app's own qrcode.c and writes the symbol as a C header holding a 64 x 64 XBM, laid
+// out exactly like the main app's fullscreen view (QUIET_ZONE light modules at least,
+// fractional scale from 1.5 px per module up). The app then only blits the array.
+//
+//   upi_qr_static_gen <payload file> <header>
+//
+// The payload is the first line of the file, e.g. upi://pay?pa=shop@okaxis&pn=Shop.
+// It is encoded at the smallest version that fits, then at the highest ECC level
+// that still fits that version, since a larger symbol would only get smaller modules.
+// A payload that needs more than MAX_VERSION fails the build rather than ship a code
+// too fine to scan.
+
+#include "qrcode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAYLOAD_MAX 512
+#define BITMAP_SIZE 64
+#define QUIET_ZONE 2 // As QR_QUIET_ZONE in upi_qr.c
+#define MAX_VERSION 6 // As UPI_QR_MAX_VERSION in upi_qr_worker.h, the largest the main app shows
+
+static const char* const ecc_names[] = {"L", "M", "Q", "H"};
+
+// Pixel edges of the symbol's modules; upi_qr_bitmap_map_edges in upi_qr.c
+static void static_map_edges(uint8_t* edges, uint8_t symbol_size, uint8_t size) {
+    uint8_t modules = symbol_size + 2 * QUIET_ZONE;
+
+    if(2 * size >= 3 * modules) {
+        for(uint16_t i = 0; i <= symbol_size; i++) {
+            edges[i] = (2 * (i + QUIET_ZONE) * size + modules) / (2 * modules);
+        }
+    } else {
+        uint8_t module_size = size / modules;
+        uint8_t offset = (size - symbol_size * module_size) / 2;
+        for(uint16_t i = 0; i <= symbol_size; i++) {
+            edges[i] = offset + i * module_size;
+        }
+    }
+}
+
+static bool static_read_payload(const char* path, char* payload, size_t size) {
+    FILE* file = fopen(path, "r");
+    if(!file) {
+        perror(path);
+        return false;
+    }
+
+    bool ok = fgets(payload, size, file) != NULL;
+    fclose(file);
+    if(!ok) {
+        fprintf(stderr, "%s: no payload\n", path);
+        return false;
+    }
+
+    payload[strcspn(payload, "\r\n")] = '\0';
+    if(payload[0] == '\0') {
+        fprintf(stderr, "%s: empty payload\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s <payload file> <header>\n", argv[0]);
+        return 2;
+    }
+
+    char payload[PAYLOAD_MAX];
+    if(!static_read_payload(argv[1], payload, sizeof(payload))) return 1;
+    uint16_t length = strlen(payload);
+
+    uint8_t version = qrcode_getMinVersion(MODE_MIXED, ECC_LOW, (uint8_t*)payload, length, MAX_VERSION);
+    if(version == 0) {
+        fprintf(stderr, "payload of %u bytes needs more than version %u, the largest the app shows\n", length, MAX_VERSION);
+        return 1;
+    }
+    uint8_t ecc = ECC_HIGH;
+    while(qrcode_getMinVersion(MODE_MIXED, ecc, (uint8_t*)payload, length, version) == 0) {
+        ecc--;
+    }
+
+    QRCode qrcode;
+    uint8_t modules[qrcode_getBufferSize(version)];
+    if(qrcode_initBytes(&qrcode, modules, MODE_MIXED, version, ecc, (uint8_t*)payload, length) != 0) {
+        fprintf(stderr, "encode failed\n");
+        return 1;
+    }
+
+    uint8_t edges[BITMAP_SIZE + 1];
+    static_map_edges(edges, qrcode.size, BITMAP_SIZE);
+
+    uint8_t bitmap[BITMAP_SIZE][BITMAP_SIZE / 8];
+    memset(bitmap, 0, sizeof(bitmap));
+    for(uint8_t y = 0; y < qrcode.size; y++) {
+        for(uint8_t x = 0; x < qrcode.size; x++) {
+            if(!qrcode_getModule(&qrcode, x, y)) continue;
+            for(uint8_t row = edges[y]; row < edges[y + 1]; row++) {
+                for(uint8_t pixel = edges[x]; pixel < edges[x + 1]; pixel++) {
+                    bitmap[row][pixel / 8] |= 1 << (pixel % 8);
+                }
+            }
+        }
+    }
+
+    FILE* out = fopen(argv[2], "w");
+    if(!out) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by tools/upi_qr_static_gen; edit tools/static_payload.txt instead.\n");
+    fprintf(out, "// Version %u-%s, mask %u: %s\n\n", version, ecc_names[ecc], qrcode.mask, payload);
+    fprintf(out, "#pragma once\n\n#include <stdint.h>\n\n");
+    fprintf(out, "#define UPI_QR_STATIC_SIZE %u\n\n", BITMAP_SIZE);
+    fprintf(out, "static const uint8_t upi_qr_static_bits[] = {");
+    for(size_t i = 0; i < sizeof(bitmap); i++) {
+        fprintf(out, "%s0x%02x,", i % 12 ? " " : "\n    ", ((uint8_t*)bitmap)[i]);
+    }
+    fprintf(out, "\n};\n");
+
+    if(fclose(out) != 0) {
+        perror(argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+
+    printf("%s: version %u-%s, %u x %u px\n", argv[2], version, ecc_names[ecc], BITMAP_SIZE, BITMAP_SIZE);
+    return 0;
+}
@@ -7,23 +7,134 @@
 #include <gui/modules/submenu.h>
 #include <gui/modules/dialog_ex.h>
 #include <gui/modules/popup.h>
-#include <gui/modules/widget.h>
+#include <gui/view.h>
+#include <gui/elements.h>
 #include <storage/storage.h>
 #include <stdlib.h>
 #include <string.h>
 #include <input/input.h>
 #include "qrcode.h"
+#include "upi_qr_worker.h"
+#include "upi_qr_entries.h"
+#include "upi_qr_stats.h"
+#include "upi_qr_emv.h"
+#include "upi_qr_export.h"
+#include "upi_qr_import.h"
 
 #define APP_NAME "UPI_QR"
 #define SAVE_PATH "/ext/upi_qr"
 #define SAVE_FILE "/ext/upi_qr/saved_upi.txt"
+#define STATS_FILE "/ext/upi_qr/stats.log"
+#define IMPORT_FILE "/ext/upi_qr/import.csv"
+#define SAVE_WRITE_SIZE 1024 // Bytes per write when the saved file is rewritten
 #define MAX_UPI_LENGTH 64
-#define MAX_SAVED_ENTRIES 20
+#define SAVED_LIST_PAGE 32
+#define QR_VERSION UPI_QR_MAX_VERSION // Largest allowed; the worker picks the smallest that fits
+#define EMV_MERCHANT_CITY "NA" // Not collected; the object is mandatory
+#define QR_BITMAP_MAX_SIZE 64
+#define QR_QUIET_ZONE 2 // Light modules around the symbol, inside its bitmap
+#define QR_CAROUSEL_BUDGET 4096 // Bytes of fullscreen slides rendered ahead, about 7
+#define AMOUNT_DIGITS 5 // Rupees, up to 99999
+#define AMOUNT_DECIMALS 2
+#define AMOUNT_MAX_LENGTH (AMOUNT_DIGITS + 1 + AMOUNT_DECIMALS)
+#define AMOUNT_WORST_CASE "99999.99" // Sizes the amount scene's symbol
+#define KEYPAD_COLUMNS 3
+#define KEYPAD_ROWS 4
 
+// A symbol pre-rendered as an XBM, drawn with a single blit
 typedef struct {
-    char upi_id[MAX_UPI_LENGTH];
-    char name[32];
-} UpiEntry;
+    uint8_t data[QR_BITMAP_MAX_SIZE * QR_BITMAP_MAX_SIZE / 8];
+    uint8_t x;
+    uint8_t y;
+    uint8_t size;
+    const char* message; // Shown instead of the bitmap when rendering failed
+} UpiQrBitmap;
+
+// Model of the QR view. It draws whatever bitmap points at: its own symbol, or a
+// carousel slide, so flipping slides is a pointer swap.
+typedef struct {
+    UpiQrBitmap symbol;
+    const UpiQrBitmap* bitmap;
+    uint8_t slide; // Position shown as "slide/slides" when slides > 1
+    uint8_t slides;
+    bool show_buttons;
+} UpiQrViewModel;
+
+// Model of the amount view: the transaction's symbol at the left, the amount and
+// a keypad at the right
+typedef struct {
+    UpiQrBitmap symbol;
+    char amount[AMOUNT_MAX_LENGTH + 1];
+    uint8_t key; // Keypad cursor
+} UpiQrAmountViewModel;
+
+static const char upi_qr_keypad_keys[KEYPAD_COLUMNS * KEYPAD_ROWS] = "123456789.0<";
+
+// A saved entry of the fullscreen carousel
+typedef struct {
+    size_t entry;
+    bool ready;
+    UpiQrBitmap bitmap;
+} UpiQrSlide;
+
+typedef enum {
+    UpiQrFormatUri, // upi://pay?pa=...&pn=...&cu=INR
+    UpiQrFormatCompact, // UPI://PAY?pa=...&pn=..., minimal escaping
+    UpiQrFormatBharatQr, // EMVCo merchant-presented TLV with the VPA in tag 26
+    UpiQrFormatCount,
+} UpiQrFormat;
+
+static const char* const upi_qr_format_names[UpiQrFormatCount] = {
+    [UpiQrFormatUri] = "Format: UPI link",
+    [UpiQrFormatCompact] = "Format: Compact link",
+    [UpiQrFormatBharatQr] = "Format: BharatQR",
+};
+
+// Per-transaction parameters of a payload; empty strings are left out
+typedef struct {
+    const char* amount;
+    const char* note;
+    const char* reference;
+} UpiQrPayment;
+
+typedef struct {
+    bool exists;
+    uint64_t size;
+    uint32_t timestamp;
+} UpiQrSavedStamp;
+
+typedef enum {
+    UpiQrSceneMenu,
+    UpiQrSceneUsernameInput,
+    UpiQrSceneBankInput,
+    UpiQrSceneNameInput,
+    UpiQrSceneQrDisplay,
+    UpiQrSceneQrFullscreen,
+    UpiQrSceneSavedList,
+    UpiQrSceneConfirmDelete,
+    UpiQrSceneStats,
+    UpiQrSceneExport,
+    UpiQrSceneImport,
+    UpiQrSceneAmount,
+    UpiQrSceneNoteInput,
+    UpiQrSceneCount,
+} UpiQrScene;
+
+static const char* const upi_qr_scene_names[UpiQrSceneCount] = {
+    [UpiQrSceneMenu] = "Menu",
+    [UpiQrSceneUsernameInput] = "User",
+    [UpiQrSceneBankInput] = "Bank",
+    [UpiQrSceneNameInput] = "Name",
+    [UpiQrSceneQrDisplay] = "QR",
+    [UpiQrSceneQrFullscreen] = "Full",
+    [UpiQrSceneSavedList] = "List",
+    [UpiQrSceneConfirmDelete] = "Delete",
+    [UpiQrSceneStats] = "Stats",
+    [UpiQrSceneExport] = "Export",
+    [UpiQrSceneImport] = "Import",
+    [UpiQrSceneAmount] = "Amount",
+    [UpiQrSceneNoteInput] = "Note",
+};
 
 typedef struct {
     Gui* gui;
@@ -31,43 +142,126 @@ typedef struct {
     SceneManager* scene_manager;
     TextInput* text_input;
     Submenu* submenu;
-    Widget* widget;
+    View* qr_view;
+    View* amount_view;
     Popup* popup;
     
-    char input_buffer[MAX_UPI_LENGTH];
-    char username_buffer[32];
-    char bank_buffer[32];
+    char input_buffer[MAX_UPI_LENGTH]; // The username is typed here, "@bank" appended
+    char text_buffer[32]; // Scratch for text input steps that do not edit in place
     char name_buffer[32];
-    UpiEntry saved_entries[MAX_SAVED_ENTRIES];
-    uint32_t saved_count;
+    UpiQrEntries* saved;
     uint32_t selected_index;
     
+    // Saved entries are loaded off the UI thread after launch; the stamp of the
+    // file they came from lets later visits to the list skip re-parsing
+    bool saved_loaded;
+    UpiQrSavedStamp saved_stamp;
+    uint32_t saved_generation; // Bumped on every write
+    bool saved_dirty; // Last-used stamps changed since the file was written
+    FuriThread* loader;
+    UpiQrEntries* loader_entries;
+    UpiQrSavedStamp loader_stamp;
+    uint32_t loader_generation;
+    
+    // CSV import, on its own thread while the import scene is up. It adds to saved
+    // directly: nothing else touches the entries until UpiQrCustomEventImportDone.
+    FuriThread* importer;
+    FuriMutex* import_mutex;
+    UpiQrImportProgress import_progress; // Latest batch, under import_mutex
+    bool import_ok;
+    char import_text[64]; // The popup keeps a pointer to its text
+    
+    // High-water marks of the events each scene handled
+    UpiQrStatsRecord scene_stats[UpiQrSceneCount];
+    UpiQrScene stats_scene;
+    
+    // BharatQR prefix of the merchant on screen, reused while it stays the same
+    UpiQrFormat format;
+    UpiQrEmvPrefix emv_prefix;
+    char emv_merchant[MAX_UPI_LENGTH + 32]; // "vpa|name" emv_prefix was built for
+    
+    // Encoding runs on the worker; the UI only ever renders the latest result
+    UpiQrWorker* worker;
+    UpiQrWorkerResult qr_result;
+    uint32_t qr_generation;
+    uint32_t qr_payload_bits; // Estimated before the request, shown on the stats screen
+    bool qr_ready;
+    uint8_t qr_max_size;
+    uint8_t qr_start_y;
+    bool qr_show_buttons;
+    bool qr_saved; // The symbol is the saved entry at selected_index
+    
+    // Fullscreen carousel over the saved entries around the selected one. Slides are
+    // encoded one at a time through the worker and rendered as soon as they arrive.
+    UpiQrSlide* carousel;
+    size_t carousel_count;
+    size_t carousel_index;
+    size_t carousel_pending; // Slide the worker is encoding, if carousel_generation
+    uint32_t carousel_generation;
+    
+    // Transaction of the amount scene. Its symbol is re-encoded on every key at one
+    // version, fixed for the worst-case amount, so it keeps its size while typing.
+    char amount[AMOUNT_MAX_LENGTH + 1];
+    char note_buffer[32];
+    char reference[16]; // tr, digits only
+    uint8_t amount_version; // 0 when even the worst case does not fit
+    size_t amount_prefix_length; // Payload bytes that stay put while the amount is keyed
+    uint32_t amount_generation;
+    
     Storage* storage;
 } UpiQrApp;
 
 typedef enum {
     UpiQrViewMenu,
     UpiQrViewTextInput,
-    UpiQrViewWidget,
+    UpiQrViewQr,
     UpiQrViewPopup,
+    UpiQrViewAmount,
 } UpiQrView;
 
 typedef enum {
-    UpiQrSceneMenu,
-    UpiQrSceneUsernameInput,
-    UpiQrSceneBankInput,
-    UpiQrSceneNameInput,
-    UpiQrSceneQrDisplay,
-    UpiQrSceneQrFullscreen,
-    UpiQrSceneSavedList,
-    UpiQrSceneConfirmDelete,
-    UpiQrSceneCount,
-} UpiQrScene;
+    // Above any submenu index, so they never collide with list selections
+    UpiQrCustomEventSave = 0x10000,
+    UpiQrCustomEventFullscreen,
+    UpiQrCustomEventExport,
+    UpiQrCustomEventPrevious,
+    UpiQrCustomEventNext,
+    UpiQrCustomEventQrReady,
+    UpiQrCustomEventSavedLoaded,
+    UpiQrCustomEventImportProgress,
+    UpiQrCustomEventImportDone,
+    UpiQrCustomEventAmount,
+    UpiQrCustomEventKeypad,
+    UpiQrCustomEventNote,
+} UpiQrCustomEvent;
+
+typedef enum {
+    // Saved list items that are not entries, above UPI_QR_ENTRIES_MAX
+    UpiQrListItemEmpty = 0xFFF0,
+    UpiQrListItemDeleteHint,
+    UpiQrListItemPrevious,
+    UpiQrListItemNext,
+    UpiQrListItemWriteStats,
+} UpiQrListItem;
 
 // Function prototypes
 static void upi_qr_app_load_saved(UpiQrApp* app);
 static void upi_qr_app_save_entries(UpiQrApp* app);
-static void upi_qr_draw_qr_code(Widget* widget, const char* upi_id, void* context);
+static void upi_qr_app_prewarm(UpiQrApp* app);
+static void upi_qr_request_qr_code(UpiQrApp* app);
+static void upi_qr_show_qr_code(UpiQrApp* app, uint8_t max_size, uint8_t start_y, bool show_buttons);
+static bool upi_qr_take_qr_code(UpiQrApp* app);
+static void upi_qr_carousel_start(UpiQrApp* app);
+static void upi_qr_carousel_stop(UpiQrApp* app);
+static void upi_qr_carousel_turn(UpiQrApp* app, bool forward);
+static bool upi_qr_app_write_stats(UpiQrApp* app);
+static bool upi_qr_app_export(UpiQrApp* app, uint8_t scale, char* name, size_t name_size);
+static void upi_qr_app_start_import(UpiQrApp* app);
+static void upi_qr_app_finish_import(UpiQrApp* app);
+static void upi_qr_amount_start(UpiQrApp* app);
+static bool upi_qr_amount_press(UpiQrApp* app, char key);
+static void upi_qr_amount_request(UpiQrApp* app);
+static bool upi_qr_amount_take(UpiQrApp* app);
 
 // Scene on_enter handlers
 void upi_qr_scene_menu_on_enter(void* context);
@@ -78,6 +272,11 @@ void upi_qr_scene_qr_display_on_enter(void* context);
 void upi_qr_scene_qr_fullscreen_on_enter(void* context);
 void upi_qr_scene_saved_list_on_enter(void* context);
 void upi_qr_scene_confirm_delete_on_enter(void* context);
+void upi_qr_scene_stats_on_enter(void* context);
+void upi_qr_scene_export_on_enter(void* context);
+void upi_qr_scene_import_on_enter(void* context);
+void upi_qr_scene_amount_on_enter(void* context);
+void upi_qr_scene_note_input_on_enter(void* context);
 
 // Scene on_event handlers
 bool upi_qr_scene_menu_on_event(void* context, SceneManagerEvent event);
@@ -88,6 +287,11 @@ bool upi_qr_scene_qr_display_on_event(void* context, SceneManagerEvent event);
 bool upi_qr_scene_qr_fullscreen_on_event(void* context, SceneManagerEvent event);
 bool upi_qr_scene_saved_list_on_event(void* context, SceneManagerEvent event);
 bool upi_qr_scene_confirm_delete_on_event(void* context, SceneManagerEvent event);
+bool upi_qr_scene_stats_on_event(void* context, SceneManagerEvent event);
+bool upi_qr_scene_export_on_event(void* context, SceneManagerEvent event);
+bool upi_qr_scene_import_on_event(void* context, SceneManagerEvent event);
+bool upi_qr_scene_amount_on_event(void* context, SceneManagerEvent event);
+bool upi_qr_scene_note_input_on_event(void* context, SceneManagerEvent event);
 
 // Scene on_exit handlers
 void upi_qr_scene_menu_on_exit(void* context);
@@ -98,6 +302,11 @@ void upi_qr_scene_qr_display_on_exit(void* context);
 void upi_qr_scene_qr_fullscreen_on_exit(void* context);
 void upi_qr_scene_saved_list_on_exit(void* context);
 void upi_qr_scene_confirm_delete_on_exit(void* context);
+void upi_qr_scene_stats_on_exit(void* context);
+void upi_qr_scene_export_on_exit(void* context);
+void upi_qr_scene_import_on_exit(void* context);
+void upi_qr_scene_amount_on_exit(void* context);
+void upi_qr_scene_note_input_on_exit(void* context);
 
 // Scene handlers - using function pointers directly
 void (*upi_qr_scene_on_enter_handlers[])(void*) = {
@@ -109,6 +318,11 @@ void (*upi_qr_scene_on_enter_handlers[])(void*) = {
     [UpiQrSceneQrFullscreen] = upi_qr_scene_qr_fullscreen_on_enter,
     [UpiQrSceneSavedList] = upi_qr_scene_saved_list_on_enter,
     [UpiQrSceneConfirmDelete] = upi_qr_scene_confirm_delete_on_enter,
+    [UpiQrSceneStats] = upi_qr_scene_stats_on_enter,
+    [UpiQrSceneExport] = upi_qr_scene_export_on_enter,
+    [UpiQrSceneImport] = upi_qr_scene_import_on_enter,
+    [UpiQrSceneAmount] = upi_qr_scene_amount_on_enter,
+    [UpiQrSceneNoteInput] = upi_qr_scene_note_input_on_enter,
 };
 
 bool (*upi_qr_scene_on_event_handlers[])(void*, SceneManagerEvent) = {
@@ -120,6 +334,11 @@ bool (*upi_qr_scene_on_event_handlers[])(void*, SceneManagerEvent) = {
     [UpiQrSceneQrFullscreen] = upi_qr_scene_qr_fullscreen_on_event,
     [UpiQrSceneSavedList] = upi_qr_scene_saved_list_on_event,
     [UpiQrSceneConfirmDelete] = upi_qr_scene_confirm_delete_on_event,
+    [UpiQrSceneStats] = upi_qr_scene_stats_on_event,
+    [UpiQrSceneExport] = upi_qr_scene_export_on_event,
+    [UpiQrSceneImport] = upi_qr_scene_import_on_event,
+    [UpiQrSceneAmount] = upi_qr_scene_amount_on_event,
+    [UpiQrSceneNoteInput] = upi_qr_scene_note_input_on_event,
 };
 
 void (*upi_qr_scene_on_exit_handlers[])(void*) = {
@@ -131,6 +350,11 @@ void (*upi_qr_scene_on_exit_handlers[])(void*) = {
     [UpiQrSceneQrFullscreen] = upi_qr_scene_qr_fullscreen_on_exit,
     [UpiQrSceneSavedList] = upi_qr_scene_saved_list_on_exit,
     [UpiQrSceneConfirmDelete] = upi_qr_scene_confirm_delete_on_exit,
+    [UpiQrSceneStats] = upi_qr_scene_stats_on_exit,
+    [UpiQrSceneExport] = upi_qr_scene_export_on_exit,
+    [UpiQrSceneImport] = upi_qr_scene_import_on_exit,
+    [UpiQrSceneAmount] = upi_qr_scene_amount_on_exit,
+    [UpiQrSceneNoteInput] = upi_qr_scene_note_input_on_exit,
 };
 
 static const SceneManagerHandlers upi_qr_scene_handlers = {
@@ -155,11 +379,11 @@ static void upi_qr_text_input_callback(void* context) {
 // Scene implementations
 void upi_qr_scene_menu_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneMenu;
     
     // Clear buffers when returning to menu
     memset(app->input_buffer, 0, MAX_UPI_LENGTH);
-    memset(app->username_buffer, 0, 32);
-    memset(app->bank_buffer, 0, 32);
+    memset(app->text_buffer, 0, 32);
     memset(app->name_buffer, 0, 32);
     
     submenu_reset(app->submenu);
@@ -167,6 +391,14 @@ void upi_qr_scene_menu_on_enter(void* context) {
     submenu_add_item(app->submenu, "New UPI ID", 0, upi_qr_submenu_callback, app);
     submenu_add_item(app->submenu, "Saved UPI IDs", 1, upi_qr_submenu_callback, app);
     submenu_add_item(app->submenu, "About", 2, upi_qr_submenu_callback, app);
+    submenu_add_item(app->submenu, "Stats", 3, upi_qr_submenu_callback, app);
+    submenu_add_item(
+        app->submenu,
+        upi_qr_format_names[app->format],
+        4,
+        upi_qr_submenu_callback,
+        app);
+    submenu_add_item(app->submenu, "Import CSV", 5, upi_qr_submenu_callback, app);
     
     view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewMenu);
 }
@@ -197,6 +429,22 @@ bool upi_qr_scene_menu_on_event(void* context, SceneManagerEvent event) {
                 view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
                 consumed = true;
                 break;
+            case 3: // Stats
+                scene_manager_next_scene(app->scene_manager, UpiQrSceneStats);
+                consumed = true;
+                break;
+            case 4: // Format, applies to every QR code from here on
+                app->format = (app->format + 1) % UpiQrFormatCount;
+                upi_qr_app_prewarm(app);
+                upi_qr_scene_menu_on_enter(app);
+                submenu_set_selected_item(app->submenu, 4);
+                consumed = true;
+                break;
+            case 5: // Import CSV, on top of whatever the file holds by now
+                upi_qr_app_load_saved(app);
+                scene_manager_next_scene(app->scene_manager, UpiQrSceneImport);
+                consumed = true;
+                break;
         }
     }
     
@@ -210,6 +458,8 @@ void upi_qr_scene_menu_on_exit(void* context) {
 
 void upi_qr_scene_username_input_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneUsernameInput;
+    app->qr_saved = false;
     
     text_input_reset(app->text_input);
     text_input_set_header_text(app->text_input, "Enter Username:");
@@ -217,7 +467,7 @@ void upi_qr_scene_username_input_on_enter(void* context) {
         app->text_input,
         upi_qr_text_input_callback,
         app,
-        app->username_buffer,
+        app->input_buffer,
         32,
         true);
     
@@ -242,6 +492,11 @@ void upi_qr_scene_username_input_on_exit(void* context) {
 
 void upi_qr_scene_bank_input_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneBankInput;
+    
+    // Coming back to this step replaces the bank typed last time
+    char* at = strchr(app->input_buffer, '@');
+    if(at) *at = '\0';
     
     text_input_reset(app->text_input);
     text_input_set_header_text(app->text_input, "Enter Bank (e.g., ybl, paytm):");
@@ -249,7 +504,7 @@ void upi_qr_scene_bank_input_on_enter(void* context) {
         app->text_input,
         upi_qr_text_input_callback,
         app,
-        app->bank_buffer,
+        app->text_buffer,
         32,
         true);
     
@@ -262,7 +517,8 @@ bool upi_qr_scene_bank_input_on_event(void* context, SceneManagerEvent event) {
     
     if(event.type == SceneManagerEventTypeCustom) {
         // Combine username and bank to create UPI ID
-        snprintf(app->input_buffer, MAX_UPI_LENGTH, "%s@%s", app->username_buffer, app->bank_buffer);
+        size_t length = strlen(app->input_buffer);
+        snprintf(app->input_buffer + length, MAX_UPI_LENGTH - length, "@%s", app->text_buffer);
         scene_manager_next_scene(app->scene_manager, UpiQrSceneNameInput);
         consumed = true;
     }
@@ -276,6 +532,7 @@ void upi_qr_scene_bank_input_on_exit(void* context) {
 
 void upi_qr_scene_name_input_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneNameInput;
     
     text_input_reset(app->text_input);
     text_input_set_header_text(app->text_input, "Enter Name (optional):");
@@ -308,11 +565,14 @@ void upi_qr_scene_name_input_on_exit(void* context) {
 
 void upi_qr_scene_qr_display_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneQrDisplay;
     
-    widget_reset(app->widget);
-    upi_qr_draw_qr_code(app->widget, app->input_buffer, app);
+    // Larger QR code taking the screen above the buttons, quiet zone included; a
+    // placeholder is shown until the worker posts the encoded symbol
+    upi_qr_request_qr_code(app);
+    upi_qr_show_qr_code(app, 52, 0, true);
     
-    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewWidget);
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewQr);
 }
 
 bool upi_qr_scene_qr_display_on_event(void* context, SceneManagerEvent event) {
@@ -323,13 +583,14 @@ bool upi_qr_scene_qr_display_on_event(void* context, SceneManagerEvent event) {
         scene_manager_search_and_switch_to_previous_scene(app->scene_manager, UpiQrSceneMenu);
         consumed = true;
     } else if(event.type == SceneManagerEventTypeCustom) {
-        if(event.event == GuiButtonTypeLeft) { // Save button pressed
-            // Save the entry
-            if(app->saved_count < MAX_SAVED_ENTRIES) {
-                strcpy(app->saved_entries[app->saved_count].upi_id, app->input_buffer);
-                strcpy(app->saved_entries[app->saved_count].name, 
-                       strlen(app->name_buffer) > 0 ? app->name_buffer : "Unnamed");
-                app->saved_count++;
+        if(event.event == UpiQrCustomEventSave) { // Save button pressed
+            // Save the entry, on top of whatever the file holds by now
+            upi_qr_app_load_saved(app);
+            if(upi_qr_entries_add(
+                   app->saved,
+                   strlen(app->name_buffer) > 0 ? app->name_buffer : "Unnamed",
+                   app->input_buffer,
+                   furi_hal_rtc_get_timestamp())) {
                 upi_qr_app_save_entries(app);
                 
                 popup_reset(app->popup);
@@ -341,10 +602,21 @@ bool upi_qr_scene_qr_display_on_event(void* context, SceneManagerEvent event) {
                 view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
             }
             consumed = true;
-        } else if(event.event == GuiButtonTypeCenter) { // Fullscreen button pressed
+        } else if(event.event == UpiQrCustomEventFullscreen) { // Fullscreen button pressed
             // Switch to fullscreen QR view
             scene_manager_next_scene(app->scene_manager, UpiQrSceneQrFullscreen);
             consumed = true;
+        } else if(event.event == UpiQrCustomEventExport) { // Export button pressed
+            // Only a symbol that is on screen can be exported
+            if(app->qr_ready && app->qr_result.status >= 0) {
+                scene_manager_next_scene(app->scene_manager, UpiQrSceneExport);
+            }
+            consumed = true;
+        } else if(event.event == UpiQrCustomEventAmount) { // Up pressed
+            scene_manager_next_scene(app->scene_manager, UpiQrSceneAmount);
+            consumed = true;
+        } else if(event.event == UpiQrCustomEventQrReady) {
+            consumed = upi_qr_take_qr_code(app);
         }
     }
     
@@ -352,8 +624,7 @@ bool upi_qr_scene_qr_display_on_event(void* context, SceneManagerEvent event) {
 }
 
 void upi_qr_scene_qr_display_on_exit(void* context) {
-    UpiQrApp* app = context;
-    widget_reset(app->widget);
+    UNUSED(context);
     // Don't clear buffers here - they're needed for fullscreen view
     // Buffers will be cleared when returning to main menu
 }
@@ -361,84 +632,15 @@ void upi_qr_scene_qr_display_on_exit(void* context) {
 // Fullscreen QR scene - shows QR code taking up entire screen
 void upi_qr_scene_qr_fullscreen_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneQrFullscreen;
     
-    // Generate UPI payment string - simplified format
-    char upi_payment_string[256];
-    char encoded_name[64];
-    const char* payee_name = (strlen(app->name_buffer) > 0) ? app->name_buffer : "Payment";
-    
-    // URL encode the payee name (replace spaces with %20)
-    int j = 0;
-    for(int i = 0; payee_name[i] && j < (int)sizeof(encoded_name) - 3; i++) {
-        if(payee_name[i] == ' ') {
-            encoded_name[j++] = '%';
-            encoded_name[j++] = '2';
-            encoded_name[j++] = '0';
-        } else {
-            encoded_name[j++] = payee_name[i];
-        }
-    }
-    encoded_name[j] = '\0';
+    // Maximize for fullscreen: use full screen height, start at top.
+    // Reuses the symbol the display scene already received; saved entries get
+    // Left/Right to flip through their neighbours.
+    upi_qr_show_qr_code(app, 64, 0, false);
+    upi_qr_carousel_start(app);
     
-    snprintf(
-        upi_payment_string,
-        sizeof(upi_payment_string),
-        "upi://pay?pa=%s&pn=%s&cu=INR",
-        app->input_buffer,
-        encoded_name
-    );
-    
-
-    
-    // Generate actual QR code for fullscreen
-    uint8_t qr_version = 3;
-    uint16_t buffer_size = qrcode_getBufferSize(qr_version);
-    uint8_t* qr_buffer = malloc(buffer_size);
-    
-    if(qr_buffer) {
-        QRCode qrcode;
-        int8_t result = qrcode_initBytes(&qrcode, qr_buffer, MODE_BYTE, qr_version, ECC_LOW, 
-                                        (uint8_t*)upi_payment_string, strlen(upi_payment_string));
-        
-        if(result >= 0) {
-            // Calculate QR code display parameters - maximize for fullscreen
-            uint8_t qr_size = qrcode.size;
-            uint8_t max_display_size = 64; // Use full screen height
-            uint8_t module_size = max_display_size / qr_size;
-            if(module_size == 0) module_size = 1;
-            
-            uint8_t display_size = qr_size * module_size;
-            uint8_t start_x = (128 - display_size) / 2;
-            uint8_t start_y = 0; // Start at top
-            
-            // Draw QR code modules
-            for(uint8_t y = 0; y < qr_size; y++) {
-                for(uint8_t x = 0; x < qr_size; x++) {
-                    if(qrcode_getModule(&qrcode, x, y)) {
-                        // Draw filled rectangle for black modules
-                        for(uint8_t dy = 0; dy < module_size; dy++) {
-                            for(uint8_t dx = 0; dx < module_size; dx++) {
-                                widget_add_frame_element(app->widget, 
-                                    start_x + x * module_size + dx, 
-                                    start_y + y * module_size + dy, 
-                                    1, 1, 0);
-                            }
-                        }
-                    }
-                }
-            }
-        } else {
-            // Fallback to text display if QR generation fails
-            widget_add_string_element(app->widget, 64, 32, AlignCenter, AlignCenter, FontPrimary, "QR Gen Failed");
-        }
-        
-        free(qr_buffer);
-    } else {
-        // Fallback if memory allocation fails
-        widget_add_string_element(app->widget, 64, 32, AlignCenter, AlignCenter, FontPrimary, "Memory Error");
-    }
-    
-    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewWidget);
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewQr);
 }
 
 bool upi_qr_scene_qr_fullscreen_on_event(void* context, SceneManagerEvent event) {
@@ -448,6 +650,15 @@ bool upi_qr_scene_qr_fullscreen_on_event(void* context, SceneManagerEvent event)
     if(event.type == SceneManagerEventTypeBack) {
         scene_manager_previous_scene(app->scene_manager);
         consumed = true;
+    } else if(event.type == SceneManagerEventTypeCustom) {
+        if(event.event == UpiQrCustomEventQrReady) {
+            consumed = upi_qr_take_qr_code(app);
+        } else if(event.event == UpiQrCustomEventPrevious || event.event == UpiQrCustomEventNext) {
+            if(app->carousel) {
+                upi_qr_carousel_turn(app, event.event == UpiQrCustomEventNext);
+                consumed = true;
+            }
+        }
     }
     
     return consumed;
@@ -455,29 +666,72 @@ bool upi_qr_scene_qr_fullscreen_on_event(void* context, SceneManagerEvent event)
 
 void upi_qr_scene_qr_fullscreen_on_exit(void* context) {
     UpiQrApp* app = context;
+    upi_qr_carousel_stop(app);
+}
+
+// Lists one page of the saved entries, so a long list never turns into thousands of
+// submenu items. Both list scenes share the page kept in the saved list's state.
+static void upi_qr_submenu_add_entries(UpiQrApp* app, bool for_delete) {
+    size_t count = upi_qr_entries_count(app->saved);
+    uint32_t first = scene_manager_get_scene_state(app->scene_manager, UpiQrSceneSavedList);
+    if(first >= count) {
+        first = count > 0 ? ((count - 1) / SAVED_LIST_PAGE) * SAVED_LIST_PAGE : 0;
+        scene_manager_set_scene_state(app->scene_manager, UpiQrSceneSavedList, first);
+    }
+    
+    if(first > 0) {
+        submenu_add_item(app->submenu, "< Previous", UpiQrListItemPrevious, upi_qr_submenu_callback, app);
+    }
+    
+    for(size_t i = first; i < count && i < first + SAVED_LIST_PAGE; i++) {
+        char item_text[96];
+        if(for_delete) {
+            snprintf(item_text, sizeof(item_text), "Delete: %s", 
+                     upi_qr_entries_get_name(app->saved, i));
+        } else {
+            char vpa[UPI_QR_ENTRY_VPA_MAX];
+            upi_qr_entries_get_vpa(app->saved, i, vpa, sizeof(vpa));
+            snprintf(item_text, sizeof(item_text), "%s - %s", 
+                     upi_qr_entries_get_name(app->saved, i), 
+                     vpa);
+        }
+        submenu_add_item(app->submenu, item_text, i, upi_qr_submenu_callback, app);
+    }
     
-    // Clear the widget
-    widget_reset(app->widget);
+    if(first + SAVED_LIST_PAGE < count) {
+        submenu_add_item(app->submenu, "Next >", UpiQrListItemNext, upi_qr_submenu_callback, app);
+    }
+}
+
+// Returns true when the event was a page change and the list needs rebuilding
+static bool upi_qr_saved_list_turn_page(UpiQrApp* app, uint32_t event) {
+    uint32_t first = scene_manager_get_scene_state(app->scene_manager, UpiQrSceneSavedList);
+    
+    if(event == UpiQrListItemNext) {
+        first += SAVED_LIST_PAGE;
+    } else if(event == UpiQrListItemPrevious && first >= SAVED_LIST_PAGE) {
+        first -= SAVED_LIST_PAGE;
+    } else {
+        return false;
+    }
+    
+    scene_manager_set_scene_state(app->scene_manager, UpiQrSceneSavedList, first);
+    return true;
 }
 
 void upi_qr_scene_saved_list_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneSavedList;
     
     submenu_reset(app->submenu);
     submenu_set_header(app->submenu, "Saved UPI IDs");
     
-    for(uint32_t i = 0; i < app->saved_count; i++) {
-        char item_text[96];
-        snprintf(item_text, sizeof(item_text), "%s - %s", 
-                 app->saved_entries[i].name, 
-                 app->saved_entries[i].upi_id);
-        submenu_add_item(app->submenu, item_text, i, upi_qr_submenu_callback, app);
-    }
+    upi_qr_submenu_add_entries(app, false);
     
-    if(app->saved_count == 0) {
-        submenu_add_item(app->submenu, "No saved entries", 999, upi_qr_submenu_callback, app);
+    if(upi_qr_entries_count(app->saved) == 0) {
+        submenu_add_item(app->submenu, "No saved entries", UpiQrListItemEmpty, upi_qr_submenu_callback, app);
     } else {
-        submenu_add_item(app->submenu, "[Hold Back to Delete]", 998, upi_qr_submenu_callback, app);
+        submenu_add_item(app->submenu, "[Hold Back to Delete]", UpiQrListItemDeleteHint, upi_qr_submenu_callback, app);
     }
     
     view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewMenu);
@@ -488,15 +742,26 @@ bool upi_qr_scene_saved_list_on_event(void* context, SceneManagerEvent event) {
     bool consumed = false;
     
     if(event.type == SceneManagerEventTypeCustom) {
-        if(event.event < app->saved_count) {
+        if(event.event < upi_qr_entries_count(app->saved)) {
             app->selected_index = event.event;
-            strcpy(app->input_buffer, app->saved_entries[event.event].upi_id);
-            strcpy(app->name_buffer, app->saved_entries[event.event].name);
+            app->qr_saved = true;
+            upi_qr_entries_get_vpa(app->saved, event.event, app->input_buffer, MAX_UPI_LENGTH);
+            snprintf(app->name_buffer, sizeof(app->name_buffer), "%s", 
+                     upi_qr_entries_get_name(app->saved, event.event));
+            
+            // Move it to the front of the prewarm order. The stamp is written back with
+            // the next save or on exit, so showing the code never waits on the file.
+            upi_qr_entries_set_last_used(app->saved, event.event, furi_hal_rtc_get_timestamp());
+            app->saved_dirty = true;
+            upi_qr_app_prewarm(app);
             scene_manager_next_scene(app->scene_manager, UpiQrSceneQrDisplay);
             consumed = true;
+        } else if(upi_qr_saved_list_turn_page(app, event.event)) {
+            upi_qr_scene_saved_list_on_enter(app);
+            consumed = true;
         }
     } else if(event.type == SceneManagerEventTypeBack) {
-        if(app->saved_count > 0) {
+        if(upi_qr_entries_count(app->saved) > 0) {
             // Show delete menu
             scene_manager_next_scene(app->scene_manager, UpiQrSceneConfirmDelete);
             consumed = true;
@@ -513,16 +778,12 @@ void upi_qr_scene_saved_list_on_exit(void* context) {
 
 void upi_qr_scene_confirm_delete_on_enter(void* context) {
     UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneConfirmDelete;
     
     submenu_reset(app->submenu);
     submenu_set_header(app->submenu, "Delete Entry?");
     
-    for(uint32_t i = 0; i < app->saved_count; i++) {
-        char item_text[96];
-        snprintf(item_text, sizeof(item_text), "Delete: %s", 
-                 app->saved_entries[i].name);
-        submenu_add_item(app->submenu, item_text, i, upi_qr_submenu_callback, app);
-    }
+    upi_qr_submenu_add_entries(app, true);
     
     view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewMenu);
 }
@@ -532,12 +793,9 @@ bool upi_qr_scene_confirm_delete_on_event(void* context, SceneManagerEvent event
     bool consumed = false;
     
     if(event.type == SceneManagerEventTypeCustom) {
-        if(event.event < app->saved_count) {
+        if(event.event < upi_qr_entries_count(app->saved)) {
             // Delete entry
-            for(uint32_t i = event.event; i < app->saved_count - 1; i++) {
-                app->saved_entries[i] = app->saved_entries[i + 1];
-            }
-            app->saved_count--;
+            upi_qr_entries_remove(app->saved, event.event);
             upi_qr_app_save_entries(app);
             
             popup_reset(app->popup);
@@ -549,6 +807,8 @@ bool upi_qr_scene_confirm_delete_on_event(void* context, SceneManagerEvent event
             view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
             
             scene_manager_search_and_switch_to_previous_scene(app->scene_manager, UpiQrSceneSavedList);
+        } else if(upi_qr_saved_list_turn_page(app, event.event)) {
+            upi_qr_scene_confirm_delete_on_enter(app);
         }
         consumed = true;
     }
@@ -561,180 +821,1337 @@ void upi_qr_scene_confirm_delete_on_exit(void* context) {
     submenu_reset(app->submenu);
 }
 
-// Widget button callback
-static void upi_qr_widget_button_callback(GuiButtonType result, InputType type, void* context) {
-    UpiQrApp* app = context;
-    if(type == InputTypeShort) {
-        view_dispatcher_send_custom_event(app->view_dispatcher, result);
+// Debug screen: one row per scene that handled events, then the encoder.
+// Columns: peak stack below the event handler, lowest free stack of the thread;
+// the encoder adds its peak arena use and arena blocks (see upi_qr_stats.h).
+static void upi_qr_stats_add_item(UpiQrApp* app, const char* label, const UpiQrStatsRecord* stats) {
+    if(stats->samples == 0) return;
+    
+    char item_text[64];
+    int length = snprintf(item_text, sizeof(item_text), "%s s%lu f%lu",
+             label,
+             (unsigned long)stats->stack_peak,
+             (unsigned long)stats->stack_free_min);
+    if(stats->allocations > 0 && length > 0 && length < (int)sizeof(item_text)) {
+        snprintf(item_text + length, sizeof(item_text) - length, " h%lu a%lu",
+                 (unsigned long)stats->arena_peak,
+                 (unsigned long)stats->allocations);
     }
+    submenu_add_item(app->submenu, item_text, UpiQrListItemEmpty, upi_qr_submenu_callback, app);
 }
 
-// UPI QR code drawing with actual QR code generation
-static void upi_qr_draw_qr_code(Widget* widget, const char* upi_id, void* context) {
-    // Generate UPI payment string - simplified format
-    UpiQrApp* app = (UpiQrApp*)context;
-    char upi_payment_string[256];
-    char encoded_name[64];
-    const char* payee_name = (strlen(app->name_buffer) > 0) ? app->name_buffer : "Payment";
+void upi_qr_scene_stats_on_enter(void* context) {
+    UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneStats;
     
-    // URL encode the payee name (replace spaces with %20)
-    int j = 0;
-    for(int i = 0; payee_name[i] && j < (int)sizeof(encoded_name) - 3; i++) {
-        if(payee_name[i] == ' ') {
-            encoded_name[j++] = '%';
-            encoded_name[j++] = '2';
-            encoded_name[j++] = '0';
-        } else {
-            encoded_name[j++] = payee_name[i];
-        }
+    submenu_reset(app->submenu);
+    submenu_set_header(app->submenu, "Stack/Heap Marks");
+    
+    for(uint32_t i = 0; i < UpiQrSceneCount; i++) {
+        upi_qr_stats_add_item(app, upi_qr_scene_names[i], &app->scene_stats[i]);
+    }
+    
+    UpiQrStatsRecord encode_stats;
+    upi_qr_worker_get_stats(app->worker, &encode_stats);
+    upi_qr_stats_add_item(app, "Encode", &encode_stats);
+    
+    if(app->qr_payload_bits > 0) {
+        char item_text[64];
+        snprintf(
+            item_text,
+            sizeof(item_text),
+            "Payload %lu bits v%u",
+            (unsigned long)app->qr_payload_bits,
+            app->qr_ready && app->qr_result.status >= 0 ? app->qr_result.qrcode.version : 0);
+        submenu_add_item(app->submenu, item_text, UpiQrListItemEmpty, upi_qr_submenu_callback, app);
     }
-    encoded_name[j] = '\0';
     
-    snprintf(
-        upi_payment_string,
-        sizeof(upi_payment_string),
-        "upi://pay?pa=%s&pn=%s&cu=INR",
-        upi_id,
-        encoded_name
-    );
+    submenu_add_item(app->submenu, "[Write stats.log]", UpiQrListItemWriteStats, upi_qr_submenu_callback, app);
+    
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewMenu);
+}
+
+bool upi_qr_scene_stats_on_event(void* context, SceneManagerEvent event) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event.type == SceneManagerEventTypeCustom && event.event == UpiQrListItemWriteStats) {
+        popup_reset(app->popup);
+        popup_set_header(
+            app->popup,
+            upi_qr_app_write_stats(app) ? "Logged!" : "Log Failed",
+            64,
+            20,
+            AlignCenter,
+            AlignCenter);
+        popup_set_timeout(app->popup, 1000);
+        popup_set_context(app->popup, app);
+        popup_set_callback(app->popup, NULL);
+        popup_enable_timeout(app->popup);
+        view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
+        consumed = true;
+    }
     
+    return consumed;
+}
 
+void upi_qr_scene_stats_on_exit(void* context) {
+    UpiQrApp* app = context;
+    submenu_reset(app->submenu);
+}
+
+// Export scene: one item per scale, each with the image size it produces. Items
+// are numbered by their scale.
+void upi_qr_scene_export_on_enter(void* context) {
+    UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneExport;
+    
+    submenu_reset(app->submenu);
+    submenu_set_header(app->submenu, "Export BMP/XBM/SVG");
     
-    // Generate actual QR code
-    uint8_t qr_version = 3; // Start with version 3 for UPI strings
-    uint16_t buffer_size = qrcode_getBufferSize(qr_version);
-    uint8_t* qr_buffer = malloc(buffer_size);
+    for(uint8_t scale = 1; scale <= UPI_QR_EXPORT_SCALE_MAX; scale *= 2) {
+        char item_text[32];
+        uint16_t size = upi_qr_export_get_size(&app->qr_result.qrcode, scale);
+        snprintf(item_text, sizeof(item_text), "%ux: %u x %u px", scale, size, size);
+        submenu_add_item(app->submenu, item_text, scale, upi_qr_submenu_callback, app);
+    }
+    
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewMenu);
+}
+
+bool upi_qr_scene_export_on_event(void* context, SceneManagerEvent event) {
+    UpiQrApp* app = context;
+    bool consumed = false;
     
-    if(qr_buffer) {
-        QRCode qrcode;
-        int8_t result = qrcode_initBytes(&qrcode, qr_buffer, MODE_BYTE, qr_version, ECC_LOW, 
-                                        (uint8_t*)upi_payment_string, strlen(upi_payment_string));
+    if(event.type == SceneManagerEventTypeCustom && event.event >= 1 &&
+       event.event <= UPI_QR_EXPORT_SCALE_MAX) {
+        char name[MAX_UPI_LENGTH + 16];
+        bool exported = upi_qr_app_export(app, event.event, name, sizeof(name));
         
-        if(result >= 0) {
-            // Calculate QR code display parameters - maximize size for screen
-            uint8_t qr_size = qrcode.size;
-            uint8_t max_display_size = 55; // Larger QR code taking most of screen
-            uint8_t module_size = max_display_size / qr_size;
-            if(module_size == 0) module_size = 1;
+        popup_reset(app->popup);
+        popup_set_header(
+            app->popup, exported ? "Exported!" : "Export Failed", 64, 10, AlignCenter, AlignCenter);
+        if(exported) {
+            popup_set_text(app->popup, name, 64, 32, AlignCenter, AlignCenter);
+        }
+        popup_set_timeout(app->popup, 2000);
+        popup_set_context(app->popup, app);
+        popup_set_callback(app->popup, NULL);
+        popup_enable_timeout(app->popup);
+        view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
+        consumed = true;
+    }
+    
+    return consumed;
+}
+
+void upi_qr_scene_export_on_exit(void* context) {
+    UpiQrApp* app = context;
+    submenu_reset(app->submenu);
+}
+
+// Import scene: a popup with the progress of the import thread, then its counts.
+// Back only leaves once the import is done.
+void upi_qr_scene_import_on_enter(void* context) {
+    UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneImport;
+    
+    snprintf(app->import_text, sizeof(app->import_text), "%s", IMPORT_FILE + sizeof(SAVE_PATH));
+    popup_reset(app->popup);
+    popup_set_header(app->popup, "Importing...", 64, 10, AlignCenter, AlignCenter);
+    popup_set_text(app->popup, app->import_text, 64, 32, AlignCenter, AlignCenter);
+    popup_set_context(app->popup, app);
+    popup_set_callback(app->popup, NULL);
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewPopup);
+    
+    upi_qr_app_start_import(app);
+}
+
+bool upi_qr_scene_import_on_event(void* context, SceneManagerEvent event) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event.type == SceneManagerEventTypeBack) {
+        consumed = app->importer != NULL;
+    } else if(event.type == SceneManagerEventTypeCustom) {
+        if(event.event == UpiQrCustomEventImportProgress && app->importer) {
+            UpiQrImportProgress progress;
+            furi_mutex_acquire(app->import_mutex, FuriWaitForever);
+            progress = app->import_progress;
+            furi_mutex_release(app->import_mutex);
             
-            uint8_t display_size = qr_size * module_size;
-            uint8_t start_x = (128 - display_size) / 2;
-            uint8_t start_y = 5; // Start near top
+            snprintf(
+                app->import_text,
+                sizeof(app->import_text),
+                "%lu%%, %lu added",
+                (unsigned long)(progress.bytes_total ? (uint64_t)progress.bytes_read * 100 / progress.bytes_total : 0),
+                (unsigned long)progress.added);
+            popup_set_text(app->popup, app->import_text, 64, 32, AlignCenter, AlignCenter);
+            consumed = true;
+        } else if(event.event == UpiQrCustomEventImportDone) {
+            upi_qr_app_finish_import(app);
             
-            // Draw QR code modules
-            for(uint8_t y = 0; y < qr_size; y++) {
-                for(uint8_t x = 0; x < qr_size; x++) {
-                    if(qrcode_getModule(&qrcode, x, y)) {
-                        // Draw filled rectangle for black modules
-                        for(uint8_t dy = 0; dy < module_size; dy++) {
-                            for(uint8_t dx = 0; dx < module_size; dx++) {
-                                widget_add_frame_element(widget, 
-                                    start_x + x * module_size + dx, 
-                                    start_y + y * module_size + dy, 
-                                    1, 1, 0);
-                            }
-                        }
-                    }
-                }
+            snprintf(
+                app->import_text,
+                sizeof(app->import_text),
+                "%lu added\n%lu dup, %lu bad",
+                (unsigned long)app->import_progress.added,
+                (unsigned long)app->import_progress.duplicates,
+                (unsigned long)app->import_progress.invalid);
+            popup_set_header(
+                app->popup,
+                app->import_ok ? "Imported!" : "Import Failed",
+                64,
+                10,
+                AlignCenter,
+                AlignCenter);
+            popup_set_text(app->popup, app->import_text, 64, 32, AlignCenter, AlignCenter);
+            consumed = true;
+        }
+    }
+    
+    return consumed;
+}
+
+void upi_qr_scene_import_on_exit(void* context) {
+    UpiQrApp* app = context;
+    popup_reset(app->popup);
+}
+
+// Amount scene: a keypad for the cashier and the transaction's QR code, updated on
+// every key. Hold OK to add a note. Coming back from the note keeps the transaction.
+void upi_qr_scene_amount_on_enter(void* context) {
+    UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneAmount;
+    
+    // A new transaction gets a reference of its own: the time and 3 random digits
+    if(scene_manager_get_scene_state(app->scene_manager, UpiQrSceneAmount) == 0) {
+        app->amount[0] = '\0';
+        app->note_buffer[0] = '\0';
+        snprintf(
+            app->reference,
+            sizeof(app->reference),
+            "%010lu%03lu",
+            (unsigned long)furi_hal_rtc_get_timestamp(),
+            (unsigned long)(furi_hal_random_get() % 1000));
+        with_view_model(
+            app->amount_view,
+            UpiQrAmountViewModel * model,
+            {
+                model->amount[0] = '\0';
+                model->key = 0;
+                model->symbol.message = "Generating...";
+            },
+            false);
+    }
+    scene_manager_set_scene_state(app->scene_manager, UpiQrSceneAmount, 0);
+    
+    upi_qr_amount_start(app);
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewAmount);
+}
+
+bool upi_qr_scene_amount_on_event(void* context, SceneManagerEvent event) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event.type == SceneManagerEventTypeCustom) {
+        if(event.event == UpiQrCustomEventKeypad) {
+            uint8_t key = 0;
+            with_view_model(
+                app->amount_view, UpiQrAmountViewModel * model, { key = model->key; }, false);
+            if(upi_qr_amount_press(app, upi_qr_keypad_keys[key])) upi_qr_amount_request(app);
+            consumed = true;
+        } else if(event.event == UpiQrCustomEventNote) {
+            scene_manager_set_scene_state(app->scene_manager, UpiQrSceneAmount, 1);
+            scene_manager_next_scene(app->scene_manager, UpiQrSceneNoteInput);
+            consumed = true;
+        } else if(event.event == UpiQrCustomEventQrReady) {
+            consumed = upi_qr_amount_take(app);
+        }
+    }
+    
+    return consumed;
+}
+
+void upi_qr_scene_amount_on_exit(void* context) {
+    UpiQrApp* app = context;
+    // Anything still encoding is for a screen that is gone
+    app->amount_generation = 0;
+}
+
+void upi_qr_scene_note_input_on_enter(void* context) {
+    UpiQrApp* app = context;
+    app->stats_scene = UpiQrSceneNoteInput;
+    
+    text_input_reset(app->text_input);
+    text_input_set_header_text(app->text_input, "Enter Note (optional):");
+    text_input_set_result_callback(
+        app->text_input,
+        upi_qr_text_input_callback,
+        app,
+        app->note_buffer,
+        sizeof(app->note_buffer),
+        false);
+    
+    view_dispatcher_switch_to_view(app->view_dispatcher, UpiQrViewTextInput);
+}
+
+bool upi_qr_scene_note_input_on_event(void* context, SceneManagerEvent event) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event.type == SceneManagerEventTypeCustom) {
+        scene_manager_previous_scene(app->scene_manager);
+        consumed = true;
+    }
+    
+    return consumed;
+}
+
+void upi_qr_scene_note_input_on_exit(void* context) {
+    UNUSED(context);
+}
+
+// QR view callbacks
+static void upi_qr_view_draw_callback(Canvas* canvas, void* model) {
+    UpiQrViewModel* qr_model = model;
+    const UpiQrBitmap* bitmap = qr_model->bitmap;
+    
+    canvas_clear(canvas);
+    
+    if(bitmap->message) {
+        canvas_set_font(canvas, FontSecondary);
+        canvas_draw_str_aligned(canvas, 64, 30, AlignCenter, AlignCenter, bitmap->message);
+    } else {
+        canvas_draw_xbm(canvas, bitmap->x, bitmap->y, bitmap->size, bitmap->size, bitmap->data);
+    }
+    
+    if(qr_model->slides > 1) {
+        char position[8];
+        snprintf(position, sizeof(position), "%u/%u", qr_model->slide + 1, qr_model->slides);
+        canvas_set_font(canvas, FontSecondary);
+        canvas_draw_str(canvas, 0, 63, position);
+    }
+    
+    // Buttons - Left for Save, Center for Fullscreen, Right for Export, Up for Amount
+    if(qr_model->show_buttons) {
+        canvas_set_font(canvas, FontSecondary);
+        canvas_draw_str_aligned(canvas, 127, 0, AlignRight, AlignTop, "^ Amount");
+        elements_button_left(canvas, "Save");
+        elements_button_center(canvas, "Full");
+        elements_button_right(canvas, "Export");
+    }
+}
+
+static bool upi_qr_view_input_callback(InputEvent* event, void* context) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event->type == InputTypeShort) {
+        if(event->key == InputKeyLeft) {
+            // Save on the display scene, previous slide in fullscreen
+            view_dispatcher_send_custom_event(
+                app->view_dispatcher,
+                app->qr_show_buttons ? UpiQrCustomEventSave : UpiQrCustomEventPrevious);
+            consumed = true;
+        } else if(event->key == InputKeyRight) {
+            // Export on the display scene, next slide in fullscreen
+            view_dispatcher_send_custom_event(
+                app->view_dispatcher,
+                app->qr_show_buttons ? UpiQrCustomEventExport : UpiQrCustomEventNext);
+            consumed = true;
+        } else if(event->key == InputKeyOk) {
+            view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventFullscreen);
+            consumed = true;
+        } else if(event->key == InputKeyUp && app->qr_show_buttons) {
+            view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventAmount);
+            consumed = true;
+        }
+    }
+    
+    return consumed;
+}
+
+// Amount view callbacks
+static void upi_qr_amount_draw_callback(Canvas* canvas, void* model) {
+    UpiQrAmountViewModel* amount_model = model;
+    const UpiQrBitmap* bitmap = &amount_model->symbol;
+    
+    canvas_clear(canvas);
+    
+    if(bitmap->message) {
+        canvas_set_font(canvas, FontSecondary);
+        canvas_draw_str_aligned(canvas, 32, 30, AlignCenter, AlignCenter, bitmap->message);
+    } else {
+        canvas_draw_xbm(canvas, bitmap->x, bitmap->y, bitmap->size, bitmap->size, bitmap->data);
+    }
+    
+    char amount[AMOUNT_MAX_LENGTH + 4];
+    snprintf(amount, sizeof(amount), "Rs %s", amount_model->amount[0] ? amount_model->amount : "0");
+    canvas_set_font(canvas, FontPrimary);
+    canvas_draw_str_aligned(canvas, 96, 0, AlignCenter, AlignTop, amount);
+    
+    // 3 x 4 keys of 21 x 12 pixels, the one under the cursor inverted
+    canvas_set_font(canvas, FontSecondary);
+    for(uint8_t i = 0; i < KEYPAD_COLUMNS * KEYPAD_ROWS; i++) {
+        uint8_t x = 65 + (i % KEYPAD_COLUMNS) * 21;
+        uint8_t y = 15 + (i / KEYPAD_COLUMNS) * 12;
+        char label[2] = {upi_qr_keypad_keys[i], '\0'};
+        
+        if(i == amount_model->key) {
+            canvas_draw_box(canvas, x, y, 20, 11);
+            canvas_set_color(canvas, ColorWhite);
+        }
+        canvas_draw_str_aligned(canvas, x + 10, y + 6, AlignCenter, AlignCenter, label);
+        canvas_set_color(canvas, ColorBlack);
+    }
+}
+
+// Arrows move the cursor without leaving the view; keys go to the scene
+static bool upi_qr_amount_input_callback(InputEvent* event, void* context) {
+    UpiQrApp* app = context;
+    bool consumed = false;
+    
+    if(event->type == InputTypeShort || event->type == InputTypeRepeat) {
+        int8_t step = 0;
+        if(event->key == InputKeyLeft) step = -1;
+        if(event->key == InputKeyRight) step = 1;
+        if(event->key == InputKeyUp) step = -KEYPAD_COLUMNS;
+        if(event->key == InputKeyDown) step = KEYPAD_COLUMNS;
+        
+        if(step) {
+            with_view_model(
+                app->amount_view,
+                UpiQrAmountViewModel * model,
+                {
+                    uint8_t count = KEYPAD_COLUMNS * KEYPAD_ROWS;
+                    model->key = (model->key + count + step) % count;
+                },
+                true);
+            consumed = true;
+        } else if(event->key == InputKeyOk && event->type == InputTypeShort) {
+            view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventKeypad);
+            consumed = true;
+        }
+    } else if(event->type == InputTypeLong && event->key == InputKeyOk) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventNote);
+        consumed = true;
+    }
+    
+    return consumed;
+}
+
+// Escape text for a link parameter: control and non-ASCII bytes, and whatever would
+// end the value or be read as another parameter, become %XX in every link. A space
+// is %20 in the UPI link; the compact link spends one byte on it as '+'.
+static void upi_qr_escape_text(UpiQrFormat format, const char* text, char* out, size_t out_size) {
+    size_t j = 0;
+    for(size_t i = 0; text[i] && j + 3 < out_size; i++) {
+        uint8_t c = text[i];
+        if(c == ' ') {
+            if(format == UpiQrFormatCompact) {
+                out[j++] = '+';
+            } else {
+                memcpy(out + j, "%20", 3);
+                j += 3;
             }
-            
+        } else if(c < ' ' || c > '~' || strchr("&=%#+", c)) {
+            snprintf(out + j, out_size - j, "%%%02X", c);
+            j += 3;
         } else {
-            // Fallback to text display if QR generation fails
-            widget_add_string_element(widget, 64, 30, AlignCenter, AlignCenter, FontSecondary, "QR Gen Failed");
+            out[j++] = c;
+        }
+    }
+    out[j] = '\0';
+}
+
+// Append a payment's parameters to a link. tr and am are digits (and a point), so
+// the mixed-mode encoder puts their runs in numeric segments.
+static int upi_qr_append_payment(
+    UpiQrFormat format,
+    const UpiQrPayment* payment,
+    char* payload,
+    size_t payload_size,
+    int length) {
+    if(!payment) return length;
+    
+    char note[96]; // Every byte of note_buffer escaped
+    upi_qr_escape_text(format, payment->note ? payment->note : "", note, sizeof(note));
+    const char* const parameters[][2] = {
+        {"tr", payment->reference},
+        {"am", payment->amount},
+        {"tn", note},
+    };
+    
+    for(size_t i = 0; i < COUNT_OF(parameters) && length >= 0 && length < (int)payload_size; i++) {
+        const char* value = parameters[i][1];
+        if(!value || !value[0]) continue;
+        length += snprintf(
+            payload + length, payload_size - length, "&%s=%s", parameters[i][0], value);
+    }
+    
+    return length;
+}
+
+// Generate UPI payment string - simplified format, or a BharatQR payload. Without a
+// payment the code is static; BharatQR carries its amount and reference, not the note.
+static int upi_qr_format_payload(
+    UpiQrFormat format,
+    const char* upi_id,
+    const char* name,
+    const UpiQrPayment* payment,
+    char* payload,
+    size_t payload_size) {
+    char encoded_name[96]; // Every byte of name_buffer escaped
+    const char* payee_name = (strlen(name) > 0) ? name : "Payment";
+    
+    if(format == UpiQrFormatBharatQr) {
+        UpiQrEmvPrefix prefix;
+        if(!upi_qr_emv_prefix_init(&prefix, upi_id, payee_name, EMV_MERCHANT_CITY)) return -1;
+        return upi_qr_emv_build(
+            &prefix,
+            payment ? payment->amount : NULL,
+            payment ? payment->reference : NULL,
+            payload,
+            payload_size);
+    }
+    
+    upi_qr_escape_text(format, payee_name, encoded_name, sizeof(encoded_name));
+    
+    int length;
+    if(format == UpiQrFormatCompact) {
+        // Scheme and host are case-insensitive, and in capitals they join alphanumeric
+        // segments; INR is the only currency, so cu is left out
+        length = snprintf(payload, payload_size, "UPI://PAY?pa=%s&pn=%s", upi_id, encoded_name);
+    } else {
+        length = snprintf(payload, payload_size, "upi://pay?pa=%s&pn=%s&cu=INR", upi_id, encoded_name);
+    }
+    
+    return upi_qr_append_payment(format, payment, payload, payload_size, length);
+}
+
+static void upi_qr_build_payload(
+    UpiQrApp* app,
+    const UpiQrPayment* payment,
+    char* payload,
+    size_t payload_size) {
+    if(app->format != UpiQrFormatBharatQr) {
+        upi_qr_format_payload(
+            app->format, app->input_buffer, app->name_buffer, payment, payload, payload_size);
+        return;
+    }
+    
+    // Only the tail and its CRC are new when the merchant is the one last shown
+    char merchant[sizeof(app->emv_merchant)];
+    snprintf(merchant, sizeof(merchant), "%s|%s", app->input_buffer, app->name_buffer);
+    if(strcmp(merchant, app->emv_merchant) != 0) {
+        const char* name = strlen(app->name_buffer) > 0 ? app->name_buffer : "Payment";
+        if(!upi_qr_emv_prefix_init(&app->emv_prefix, app->input_buffer, name, EMV_MERCHANT_CITY)) {
+            app->emv_merchant[0] = '\0';
+            payload[0] = '\0';
+            return;
+        }
+        memcpy(app->emv_merchant, merchant, sizeof(merchant));
+    }
+    
+    if(upi_qr_emv_build(
+           &app->emv_prefix,
+           payment ? payment->amount : NULL,
+           payment ? payment->reference : NULL,
+           payload,
+           payload_size) < 0) {
+        payload[0] = '\0';
+    }
+}
+
+// Pixel where each module of the symbol starts, and where the last one ends, for a
+// symbol and quiet zone filling size pixels. At 1.5 pixels per module or more the
+// scale is fractional: module i starts at (i + QR_QUIET_ZONE) * size / modules,
+// rounded, so modules are n or n + 1 pixels wide with the rounding error spread
+// evenly. Below that a module that is a whole pixel off is more than half a module
+// off, which breaks the 1:1:3:1:1 finder pattern check of scanners, so the scale is
+// whole pixels and the spare pixels widen the quiet zone instead.
+static void upi_qr_bitmap_map_edges(uint8_t* edges, uint8_t symbol_size, uint8_t size) {
+    uint8_t modules = symbol_size + 2 * QR_QUIET_ZONE;
+    
+    if(2 * size >= 3 * modules) {
+        for(uint16_t i = 0; i <= symbol_size; i++) {
+            edges[i] = (2 * (i + QR_QUIET_ZONE) * size + modules) / (2 * modules);
+        }
+    } else {
+        uint8_t module_size = size / modules;
+        uint8_t offset = (size - symbol_size * module_size) / 2;
+        for(uint16_t i = 0; i <= symbol_size; i++) {
+            edges[i] = offset + i * module_size;
+        }
+    }
+}
+
+// Rasterize an encoded symbol over the whole max_size square with at least
+// QR_QUIET_ZONE light modules around it. Rows and columns share one edge map.
+static void upi_qr_bitmap_set_qr(
+    UpiQrBitmap* bitmap,
+    QRCode* qrcode,
+    uint8_t max_size,
+    uint8_t start_y) {
+    if(max_size > QR_BITMAP_MAX_SIZE) max_size = QR_BITMAP_MAX_SIZE;
+    if(qrcode->size + 2 * QR_QUIET_ZONE > max_size) {
+        bitmap->message = "QR Too Large";
+        return;
+    }
+    
+    uint8_t symbol_edges[QR_BITMAP_MAX_SIZE + 1];
+    upi_qr_bitmap_map_edges(symbol_edges, qrcode->size, max_size);
+    
+    uint8_t stride = (max_size + 7) / 8;
+    memset(bitmap->data, 0, stride * max_size);
+    
+    for(uint8_t y = 0; y < qrcode->size; y++) {
+        uint8_t* row = bitmap->data + symbol_edges[y] * stride;
+        for(uint8_t x = 0; x < qrcode->size; x++) {
+            if(!qrcode_getModule(qrcode, x, y)) continue;
+            for(uint8_t pixel = symbol_edges[x]; pixel < symbol_edges[x + 1]; pixel++) {
+                row[pixel / 8] |= 1 << (pixel % 8);
+            }
         }
         
-        free(qr_buffer);
+        // The module's other pixel rows repeat its first
+        for(uint8_t pixel = symbol_edges[y] + 1; pixel < symbol_edges[y + 1]; pixel++) {
+            memcpy(bitmap->data + pixel * stride, row, stride);
+        }
+    }
+    
+    bitmap->size = max_size;
+    bitmap->x = (128 - max_size) / 2;
+    bitmap->y = start_y;
+    bitmap->message = NULL;
+}
+
+// Render a worker result, or the reason there is none
+static void upi_qr_bitmap_set_result(
+    UpiQrBitmap* bitmap,
+    UpiQrWorkerResult* result,
+    uint8_t max_size,
+    uint8_t start_y) {
+    if(result->status < 0) {
+        // Fallback to text display if QR generation fails
+        bitmap->message = "QR Gen Failed";
     } else {
-        // Fallback if memory allocation fails
-        widget_add_string_element(widget, 64, 30, AlignCenter, AlignCenter, FontSecondary, "Memory Error");
+        upi_qr_bitmap_set_qr(bitmap, &result->qrcode, max_size, start_y);
+    }
+}
+
+// Hand the current payload to the worker; never waits for the encode. Saved entries
+// the worker prewarmed are shown straight from its cache.
+static void upi_qr_request_qr_code(UpiQrApp* app) {
+    char upi_payment_string[UPI_QR_PAYLOAD_MAX];
+    upi_qr_build_payload(app, NULL, upi_payment_string, sizeof(upi_payment_string));
+    
+    app->qr_payload_bits = qrcode_getBitLength(
+        MODE_MIXED, QR_VERSION, (const uint8_t*)upi_payment_string, strlen(upi_payment_string));
+    
+    if(upi_qr_worker_lookup(app->worker, upi_payment_string, QR_VERSION, &app->qr_result)) {
+        app->qr_generation = app->qr_result.generation;
+        app->qr_ready = true;
+        return;
+    }
+    
+    app->qr_generation = upi_qr_worker_request(app->worker, upi_payment_string, QR_VERSION);
+    app->qr_ready = false;
+}
+
+// Queue the most recently used saved entries for idle-time encoding
+static void upi_qr_app_prewarm(UpiQrApp* app) {
+    // Keep the top UPI_QR_PREWARM_MAX by last use, newest first
+    size_t order[UPI_QR_PREWARM_MAX];
+    size_t count = 0;
+    for(size_t i = 0; i < upi_qr_entries_count(app->saved); i++) {
+        uint32_t last_used = upi_qr_entries_get_last_used(app->saved, i);
+        size_t j = count;
+        if(count < UPI_QR_PREWARM_MAX) {
+            count++;
+        } else if(last_used > upi_qr_entries_get_last_used(app->saved, order[count - 1])) {
+            j = count - 1;
+        } else {
+            continue;
+        }
+        while(j > 0 && upi_qr_entries_get_last_used(app->saved, order[j - 1]) < last_used) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    
+    char* payloads = NULL;
+    size_t payloads_size = 0;
+    
+    for(size_t i = 0; i < count; i++) {
+        char vpa[UPI_QR_ENTRY_VPA_MAX];
+        char payload[UPI_QR_PAYLOAD_MAX];
+        upi_qr_entries_get_vpa(app->saved, order[i], vpa, sizeof(vpa));
+        int length = upi_qr_format_payload(
+            app->format, vpa, upi_qr_entries_get_name(app->saved, order[i]), NULL, payload, sizeof(payload));
+        if(length < 0) length = 0;
+        if(length >= (int)sizeof(payload)) length = sizeof(payload) - 1;
+        
+        payloads = realloc(payloads, payloads_size + length + 1);
+        memcpy(payloads + payloads_size, payload, length + 1);
+        payloads_size += length + 1;
     }
     
-    // Add buttons - Left for Save, Center for Fullscreen
-    widget_add_button_element(widget, GuiButtonTypeLeft, "Save", upi_qr_widget_button_callback, context);
-    widget_add_button_element(widget, GuiButtonTypeCenter, "Full", upi_qr_widget_button_callback, context);
+    upi_qr_worker_prewarm(app->worker, payloads, count, QR_VERSION);
+}
+
+// Render the latest result (or a placeholder while it is pending) into the QR view
+static void upi_qr_show_qr_code(UpiQrApp* app, uint8_t max_size, uint8_t start_y, bool show_buttons) {
+    app->qr_max_size = max_size;
+    app->qr_start_y = start_y;
+    app->qr_show_buttons = show_buttons;
+    
+    with_view_model(
+        app->qr_view,
+        UpiQrViewModel * model,
+        {
+            model->show_buttons = show_buttons;
+            model->bitmap = &model->symbol;
+            model->slides = 0;
+            if(!app->qr_ready) {
+                model->symbol.message = "Generating...";
+            } else {
+                upi_qr_bitmap_set_result(&model->symbol, &app->qr_result, max_size, start_y);
+            }
+        },
+        true);
+}
+
+// Worker thread: tell the UI thread a result is waiting
+static void upi_qr_worker_callback(void* context) {
+    UpiQrApp* app = context;
+    view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventQrReady);
+}
+
+// Point the QR view at the current slide
+static void upi_qr_carousel_show(UpiQrApp* app) {
+    const UpiQrBitmap* bitmap = &app->carousel[app->carousel_index].bitmap;
+    
+    with_view_model(
+        app->qr_view,
+        UpiQrViewModel * model,
+        {
+            model->bitmap = bitmap;
+            model->slide = app->carousel_index;
+            model->slides = app->carousel_count;
+        },
+        true);
+}
+
+static void upi_qr_carousel_store(UpiQrApp* app, size_t index, UpiQrWorkerResult* result) {
+    UpiQrSlide* slide = &app->carousel[index];
+    upi_qr_bitmap_set_result(&slide->bitmap, result, app->qr_max_size, app->qr_start_y);
+    slide->ready = true;
+    
+    // Only the slide on screen needs a redraw; the others are drawn when turned to
+    if(index == app->carousel_index) upi_qr_carousel_show(app);
+}
+
+// Encode the next missing slide, nearest after the current one first. Prewarmed
+// entries come straight from the worker's cache, the rest one request at a time.
+static void upi_qr_carousel_fill(UpiQrApp* app) {
+    if(app->carousel_generation) return;
+    
+    for(size_t step = 1; step <= app->carousel_count; step++) {
+        size_t index = (app->carousel_index + step) % app->carousel_count;
+        UpiQrSlide* slide = &app->carousel[index];
+        if(slide->ready) continue;
+        
+        char vpa[UPI_QR_ENTRY_VPA_MAX];
+        char payload[UPI_QR_PAYLOAD_MAX];
+        upi_qr_entries_get_vpa(app->saved, slide->entry, vpa, sizeof(vpa));
+        if(upi_qr_format_payload(
+               app->format,
+               vpa,
+               upi_qr_entries_get_name(app->saved, slide->entry),
+               NULL,
+               payload,
+               sizeof(payload)) < 0) {
+            payload[0] = '\0';
+        }
+        
+        UpiQrWorkerResult result;
+        if(upi_qr_worker_lookup(app->worker, payload, QR_VERSION, &result)) {
+            upi_qr_carousel_store(app, index, &result);
+            continue;
+        }
+        
+        app->carousel_pending = index;
+        app->carousel_generation = upi_qr_worker_request(app->worker, payload, QR_VERSION);
+        return;
+    }
+}
+
+// Render the saved entries around the selected one into slides, as many as
+// QR_CAROUSEL_BUDGET holds. Does nothing for a symbol that was never saved.
+static void upi_qr_carousel_start(UpiQrApp* app) {
+    size_t total = upi_qr_entries_count(app->saved);
+    size_t count = QR_CAROUSEL_BUDGET / sizeof(UpiQrSlide);
+    if(count > total) count = total;
+    if(!app->qr_saved || app->selected_index >= total || count < 2) return;
+    
+    size_t first = app->selected_index > count / 2 ? app->selected_index - count / 2 : 0;
+    if(first + count > total) first = total - count;
+    
+    app->carousel = malloc(count * sizeof(UpiQrSlide));
+    app->carousel_count = count;
+    app->carousel_index = app->selected_index - first;
+    for(size_t i = 0; i < count; i++) {
+        app->carousel[i].entry = first + i;
+        app->carousel[i].ready = false;
+        app->carousel[i].bitmap.message = "Generating...";
+    }
+    
+    // The selected entry is already encoded, or about to be: adopt its request
+    if(app->qr_ready) {
+        upi_qr_carousel_store(app, app->carousel_index, &app->qr_result);
+    } else {
+        app->carousel_pending = app->carousel_index;
+        app->carousel_generation = app->qr_generation;
+    }
+    
+    upi_qr_carousel_show(app);
+    upi_qr_carousel_fill(app);
+}
+
+static void upi_qr_carousel_stop(UpiQrApp* app) {
+    if(!app->carousel) return;
+    
+    // Nothing may draw a slide once they are freed
+    with_view_model(
+        app->qr_view,
+        UpiQrViewModel * model,
+        {
+            model->bitmap = &model->symbol;
+            model->slides = 0;
+        },
+        false);
+    
+    free(app->carousel);
+    app->carousel = NULL;
+    app->carousel_generation = 0;
+}
+
+// Make the next or previous slide current; its entry becomes the selection, so
+// going back shows it on the display scene
+static void upi_qr_carousel_turn(UpiQrApp* app, bool forward) {
+    app->carousel_index =
+        (app->carousel_index + (forward ? 1 : app->carousel_count - 1)) % app->carousel_count;
+    upi_qr_carousel_show(app);
+    
+    size_t entry = app->carousel[app->carousel_index].entry;
+    app->selected_index = entry;
+    upi_qr_entries_get_vpa(app->saved, entry, app->input_buffer, MAX_UPI_LENGTH);
+    snprintf(app->name_buffer, sizeof(app->name_buffer), "%s", upi_qr_entries_get_name(app->saved, entry));
+}
+
+// UI thread: pick up the posted result; stale generations are dropped
+static bool upi_qr_take_qr_code(UpiQrApp* app) {
+    UpiQrWorkerResult result;
+    if(!upi_qr_worker_take_result(app->worker, &result)) return false;
+    
+    bool taken = false;
+    if(app->carousel && result.generation == app->carousel_generation) {
+        app->carousel_generation = 0;
+        upi_qr_carousel_store(app, app->carousel_pending, &result);
+        upi_qr_carousel_fill(app);
+        taken = true;
+    }
+    
+    if(result.generation == app->qr_generation) {
+        app->qr_result = result;
+        app->qr_result.qrcode.modules = app->qr_result.modules; // Still points into result
+        app->qr_ready = true;
+        if(!app->carousel) {
+            upi_qr_show_qr_code(app, app->qr_max_size, app->qr_start_y, app->qr_show_buttons);
+        }
+        taken = true;
+    }
+    
+    return taken;
+}
+
+// Whatever the keypad does, the transaction's payload agrees with its worst case up
+// to where the amount goes, so the worker can keep the parity of that much. A frame
+// of its own, so its buffer is gone before upi_qr_amount_request builds another.
+static size_t upi_qr_amount_prefix_length(UpiQrApp* app, const char* worst_case) {
+    char payload[UPI_QR_PAYLOAD_MAX];
+    UpiQrPayment payment = {"", app->note_buffer, app->reference};
+    upi_qr_build_payload(app, &payment, payload, sizeof(payload));
+    
+    size_t length = 0;
+    while(worst_case[length] && worst_case[length] == payload[length]) {
+        length++;
+    }
+    return length;
+}
+
+// Fix the amount scene's version for the largest amount with this note, then encode
+static void upi_qr_amount_start(UpiQrApp* app) {
+    char payload[UPI_QR_PAYLOAD_MAX];
+    UpiQrPayment payment = {AMOUNT_WORST_CASE, app->note_buffer, app->reference};
+    upi_qr_build_payload(app, &payment, payload, sizeof(payload));
+    
+    app->amount_version = 0;
+    if(payload[0]) {
+        app->amount_version = qrcode_getMinVersion(
+            MODE_MIXED, ECC_LOW, (const uint8_t*)payload, strlen(payload), QR_VERSION);
+    }
+    app->amount_prefix_length = upi_qr_amount_prefix_length(app, payload);
+    
+    upi_qr_amount_request(app);
+}
+
+// Apply a keypad key to the amount: up to AMOUNT_DIGITS rupees and AMOUNT_DECIMALS
+// paise, one point and no leading zeros. Returns false when the key is refused.
+static bool upi_qr_amount_press(UpiQrApp* app, char key) {
+    char* amount = app->amount;
+    size_t length = strlen(amount);
+    const char* point = strchr(amount, '.');
+    
+    if(key == '<') {
+        if(length == 0) return false;
+        amount[--length] = '\0';
+    } else if(key == '.') {
+        if(point) return false;
+        if(length == 0) amount[length++] = '0';
+        amount[length++] = '.';
+        amount[length] = '\0';
+    } else {
+        size_t digits = point ? (size_t)(amount + length - point - 1) : length;
+        if(digits >= (point ? AMOUNT_DECIMALS : AMOUNT_DIGITS)) return false;
+        if(length == 1 && amount[0] == '0') length = 0;
+        amount[length++] = key;
+        amount[length] = '\0';
+    }
+    
+    with_view_model(
+        app->amount_view,
+        UpiQrAmountViewModel * model,
+        { memcpy(model->amount, app->amount, sizeof(model->amount)); },
+        true);
+    return true;
+}
+
+// Hand the transaction to the worker at the fixed version. Never waits: a request
+// from the previous key that is still queued is replaced, and the symbol on screen
+// stays until the new one arrives.
+static void upi_qr_amount_request(UpiQrApp* app) {
+    if(app->amount_version == 0) {
+        app->amount_generation = 0;
+        with_view_model(
+            app->amount_view,
+            UpiQrAmountViewModel * model,
+            { model->symbol.message = "QR Too Large"; },
+            true);
+        return;
+    }
+    
+    // "12." goes out as 12; a zero amount is left out, so the payer enters it
+    char amount[sizeof(app->amount)];
+    memcpy(amount, app->amount, sizeof(amount));
+    size_t length = strlen(amount);
+    if(length > 0 && amount[length - 1] == '.') amount[length - 1] = '\0';
+    if(strspn(amount, "0.") == strlen(amount)) amount[0] = '\0';
+    
+    char payload[UPI_QR_PAYLOAD_MAX];
+    UpiQrPayment payment = {amount, app->note_buffer, app->reference};
+    upi_qr_build_payload(app, &payment, payload, sizeof(payload));
+    app->amount_generation = upi_qr_worker_request_fixed(
+        app->worker, payload, app->amount_prefix_length, app->amount_version);
+}
+
+// UI thread: show the transaction's symbol at the left, next to the keypad
+static bool upi_qr_amount_take(UpiQrApp* app) {
+    UpiQrWorkerResult result;
+    if(!upi_qr_worker_take_result(app->worker, &result)) return false;
+    if(result.generation != app->amount_generation) return false;
+    
+    result.qrcode.modules = result.modules;
+    with_view_model(
+        app->amount_view,
+        UpiQrAmountViewModel * model,
+        {
+            upi_qr_bitmap_set_result(&model->symbol, &result, QR_BITMAP_MAX_SIZE, 0);
+            model->symbol.x = 0;
+        },
+        true);
+    return true;
 }
 
 // File operations
-static void upi_qr_app_load_saved(UpiQrApp* app) {
-    File* file = storage_file_alloc(app->storage);
+static void upi_qr_saved_parse_line(UpiQrEntries* entries, char* line) {
+    char* separator = strchr(line, '|');
+    if(!separator) return;
+    *separator = '\0';
+    
+    // Optional third field: last-used timestamp
+    uint32_t last_used = 0;
+    char* stamp = strchr(separator + 1, '|');
+    if(stamp) {
+        *stamp = '\0';
+        last_used = strtoul(stamp + 1, NULL, 10);
+    }
+    
+    upi_qr_entries_add(entries, line, separator + 1, last_used);
+}
+
+static void upi_qr_saved_parse(Storage* storage, UpiQrEntries* entries) {
+    File* file = storage_file_alloc(storage);
     
     if(storage_file_open(file, SAVE_FILE, FSAM_READ, FSOM_OPEN_EXISTING)) {
         char buffer[256];
-        size_t bytes_read;
-        app->saved_count = 0;
+        size_t length = 0;
         
-        while((bytes_read = storage_file_read(file, buffer, sizeof(buffer) - 1)) > 0) {
-            buffer[bytes_read] = '\0';
+        while(true) {
+            size_t bytes_read = storage_file_read(file, buffer + length, sizeof(buffer) - 1 - length);
+            length += bytes_read;
+            buffer[length] = '\0';
             
-            // Manual string parsing to replace strtok
             char* current = buffer;
-            char* line_end;
-            
-            while(current && *current && app->saved_count < MAX_SAVED_ENTRIES) {
+            while(*current) {
                 // Find end of current line
-                line_end = strchr(current, '\n');
-                if(line_end) {
-                    *line_end = '\0';
-                }
+                char* line_end = strchr(current, '\n');
                 
-                // Process the line
-                if(*current) {
-                    char* separator = strchr(current, '|');
-                    if(separator) {
-                        *separator = '\0';
-                        strncpy(app->saved_entries[app->saved_count].name, current, 31);
-                        app->saved_entries[app->saved_count].name[31] = '\0';
-                        strncpy(app->saved_entries[app->saved_count].upi_id, separator + 1, MAX_UPI_LENGTH - 1);
-                        app->saved_entries[app->saved_count].upi_id[MAX_UPI_LENGTH - 1] = '\0';
-                        app->saved_count++;
-                    }
-                }
+                // A line cut off by the read is finished after the next one
+                if(!line_end && bytes_read > 0 && current != buffer) break;
                 
-                // Move to next line
-                if(line_end) {
-                    current = line_end + 1;
-                } else {
-                    break;
-                }
+                if(line_end) *line_end = '\0';
+                upi_qr_saved_parse_line(entries, current);
+                current = line_end ? line_end + 1 : buffer + length;
             }
+            
+            length -= current - buffer;
+            memmove(buffer, current, length);
+            if(bytes_read == 0) break;
         }
         storage_file_close(file);
     }
     
-    storage_file_free(file);
+    storage_file_free(file);    
+    upi_qr_entries_trim(entries);
 }
 
-static void upi_qr_app_save_entries(UpiQrApp* app) {
+// Size and modification time identify a file version well enough to skip re-parsing
+static void upi_qr_saved_get_stamp(Storage* storage, UpiQrSavedStamp* stamp) {
+    FileInfo info;
+    memset(stamp, 0, sizeof(UpiQrSavedStamp));
+    
+    if(storage_common_stat(storage, SAVE_FILE, &info) == FSE_OK) {
+        stamp->exists = true;
+        stamp->size = info.size;
+        storage_common_timestamp(storage, SAVE_FILE, &stamp->timestamp);
+    }
+}
+
+static bool upi_qr_saved_stamp_equal(const UpiQrSavedStamp* a, const UpiQrSavedStamp* b) {
+    return a->exists == b->exists && a->size == b->size && a->timestamp == b->timestamp;
+}
+
+// Loader thread: parses into its own buffer, the UI thread adopts it on
+// UpiQrCustomEventSavedLoaded
+static int32_t upi_qr_saved_loader_thread(void* context) {
+    UpiQrApp* app = context;
+    
+    upi_qr_saved_get_stamp(app->storage, &app->loader_stamp);
+    app->loader_entries = upi_qr_entries_alloc();
+    upi_qr_saved_parse(app->storage, app->loader_entries);
+    
+    view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventSavedLoaded);
+    return 0;
+}
+
+// Start loading the saved entries without holding up the UI thread
+static void upi_qr_app_start_load(UpiQrApp* app) {
+    if(app->loader) return;
+    
+    app->loader_entries = NULL;
+    app->loader_generation = app->saved_generation;
+    app->loader = furi_thread_alloc_ex("UpiQrLoader", 1024, upi_qr_saved_loader_thread, app);
+    furi_thread_start(app->loader);
+}
+
+// Adopt the loader's result, waiting for it if it is still running
+static void upi_qr_app_finish_load(UpiQrApp* app) {
+    if(!app->loader) return;
+    
+    furi_thread_join(app->loader);
+    furi_thread_free(app->loader);
+    app->loader = NULL;
+    
+    // Entries edited meanwhile were written back, which makes this result stale
+    if(app->loader_generation == app->saved_generation) {
+        UpiQrEntries* entries = app->saved;
+        app->saved = app->loader_entries;
+        app->loader_entries = entries;
+        app->saved_stamp = app->loader_stamp;
+        app->saved_loaded = true;
+        app->saved_dirty = false;
+        upi_qr_app_prewarm(app);
+    }
+    
+    upi_qr_entries_free(app->loader_entries);
+    app->loader_entries = NULL;
+}
+
+// Make sure the entries in memory match the file, re-parsing only when its stamp moved
+static void upi_qr_app_load_saved(UpiQrApp* app) {
+    upi_qr_app_finish_load(app);
+    
+    UpiQrSavedStamp stamp;
+    upi_qr_saved_get_stamp(app->storage, &stamp);
+    if(app->saved_loaded && upi_qr_saved_stamp_equal(&stamp, &app->saved_stamp)) return;
+    
+    // The file changed under us; last-used stamps not yet written go with the old list
+    upi_qr_entries_reset(app->saved);
+    upi_qr_saved_parse(app->storage, app->saved);
+    app->saved_stamp = stamp;
+    app->saved_loaded = true;
+    app->saved_dirty = false;
+    app->saved_generation++;
+    
+    upi_qr_app_prewarm(app);
+}
+
+// Import thread: reports each batch to the UI thread, then the end
+static void upi_qr_import_progress_callback(const UpiQrImportProgress* progress, void* context) {
+    UpiQrApp* app = context;
+    
+    furi_mutex_acquire(app->import_mutex, FuriWaitForever);
+    app->import_progress = *progress;
+    furi_mutex_release(app->import_mutex);
+    
+    view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventImportProgress);
+}
+
+static int32_t upi_qr_import_thread(void* context) {
+    UpiQrApp* app = context;
+    
+    // Imported entries were never shown, so they sort last for prewarming
+    app->import_ok = upi_qr_import_csv(
+        app->storage, IMPORT_FILE, SAVE_FILE, app->saved, 0, upi_qr_import_progress_callback, app);
+    
+    view_dispatcher_send_custom_event(app->view_dispatcher, UpiQrCustomEventImportDone);
+    return 0;
+}
+
+static void upi_qr_app_start_import(UpiQrApp* app) {
+    if(app->importer) return;
+    
+    storage_simply_mkdir(app->storage, SAVE_PATH);
+    memset(&app->import_progress, 0, sizeof(app->import_progress));
+    app->import_ok = false;
+    app->importer = furi_thread_alloc_ex("UpiQrImport", 1024, upi_qr_import_thread, app);
+    furi_thread_start(app->importer);
+}
+
+// Wait for the import thread; the file it appended to is the saved file now
+static void upi_qr_app_finish_import(UpiQrApp* app) {
+    if(!app->importer) return;
+    
+    furi_thread_join(app->importer);
+    furi_thread_free(app->importer);
+    app->importer = NULL;
+    
+    // A file that was not fully written no longer matches the entries: re-read it
+    // next time instead
+    if(app->import_ok) {
+        upi_qr_saved_get_stamp(app->storage, &app->saved_stamp);
+    } else {
+        app->saved_loaded = false;
+    }
+    app->saved_generation++;
+    
+    upi_qr_app_prewarm(app);
+}
+
+// Rewrite the saved file from the entries in memory, SAVE_WRITE_SIZE bytes per
+// write. Our own write: its stamp is remembered so the list is not re-parsed. A
+// write that fails leaves a file that no longer matches, so it is re-read next time.
+static bool upi_qr_app_write_entries(UpiQrApp* app) {
     // Ensure directory exists
     storage_simply_mkdir(app->storage, SAVE_PATH);
     
     File* file = storage_file_alloc(app->storage);
+    bool ok = storage_file_open(file, SAVE_FILE, FSAM_WRITE, FSOM_CREATE_ALWAYS);
+    
+    if(ok) {
+        char* chunk = malloc(SAVE_WRITE_SIZE);
+        size_t length = 0;
+        for(size_t i = 0; ok && i <= upi_qr_entries_count(app->saved); i++) {
+            bool last = i == upi_qr_entries_count(app->saved);
+            if(length > 0 && (last || length + UPI_QR_ENTRY_LINE_MAX > SAVE_WRITE_SIZE)) {
+                ok = storage_file_write(file, chunk, length) == length;
+                length = 0;
+            }
+            if(!last) {
+                length += upi_qr_entries_format_line(
+                    app->saved, i, chunk + length, SAVE_WRITE_SIZE - length);
+            }
+        }
+        free(chunk);
+        storage_file_close(file);
+    }
+    
+    storage_file_free(file);
     
-    if(storage_file_open(file, SAVE_FILE, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
-        for(uint32_t i = 0; i < app->saved_count; i++) {
-            char buffer[128];
-            int len = snprintf(buffer, sizeof(buffer), "%s|%s\n", 
-                     app->saved_entries[i].name,
-                     app->saved_entries[i].upi_id);
+    if(ok) {
+        upi_qr_saved_get_stamp(app->storage, &app->saved_stamp);
+        app->saved_dirty = false;
+    } else {
+        app->saved_loaded = false;
+    }
+    return ok;
+}
+
+static void upi_qr_app_save_entries(UpiQrApp* app) {
+    upi_qr_app_write_entries(app);
+    
+    // Drop any load that started before the write
+    app->saved_generation++;
+    
+    upi_qr_app_prewarm(app);
+}
+
+#if QR_PROFILE
+static const char* const upi_qr_stage_names[QR_STAGE_COUNT] =
+    {"data", "ecc", "function", "codewords", "mask", "penalty", "format"};
+
+// Average cycles per encode of each encoder stage and of each trial mask, with the
+// penalty the latest encode gave that mask
+static void upi_qr_app_write_profile(UpiQrApp* app, File* file) {
+    QRProfile profile;
+    upi_qr_worker_get_profile(app->worker, &profile);
+    if(profile.encodes == 0) return;
+    
+    char buffer[64];
+    int len = snprintf(
+        buffer,
+        sizeof(buffer),
+        "# profile of %lu encodes, cycles each\n",
+        (unsigned long)profile.encodes);
+    storage_file_write(file, buffer, len);
+    
+    for(uint8_t i = 0; i < QR_STAGE_COUNT; i++) {
+        len = snprintf(
+            buffer,
+            sizeof(buffer),
+            "Stage %s %lu\n",
+            upi_qr_stage_names[i],
+            (unsigned long)(profile.ticks[i] / profile.encodes));
+        storage_file_write(file, buffer, len);
+    }
+    for(uint8_t i = 0; i < 8; i++) {
+        len = snprintf(
+            buffer,
+            sizeof(buffer),
+            "Mask %u %lu penalty %lu\n",
+            i,
+            (unsigned long)(profile.maskTicks[i] / profile.encodes),
+            (unsigned long)profile.penalty[i]);
+        storage_file_write(file, buffer, len);
+    }
+}
+#endif
+
+// Appends every non-empty record to the stats log, one block per call. Only the
+// stats screen's "[Write stats.log]" item calls it, so the file grows on request.
+static bool upi_qr_app_write_stats(UpiQrApp* app) {
+    storage_simply_mkdir(app->storage, SAVE_PATH);
+    
+    File* file = storage_file_alloc(app->storage);
+    bool written = storage_file_open(file, STATS_FILE, FSAM_WRITE, FSOM_OPEN_APPEND);
+    
+    if(written) {
+        char buffer[112];
+        int len = snprintf(buffer, sizeof(buffer), 
+                 "# tick %lu: label samples stack_peak stack_free_min [arena_peak allocations]\n",
+                 (unsigned long)furi_get_tick());
+        storage_file_write(file, buffer, len);
+        
+        UpiQrStatsRecord encode_stats;
+        upi_qr_worker_get_stats(app->worker, &encode_stats);
+        
+        for(uint32_t i = 0; i <= UpiQrSceneCount; i++) {
+            const UpiQrStatsRecord* stats = i < UpiQrSceneCount ? &app->scene_stats[i] : &encode_stats;
+            if(stats->samples == 0) continue;
+            
+            len = upi_qr_stats_format(
+                i < UpiQrSceneCount ? upi_qr_scene_names[i] : "Encode", stats, buffer, sizeof(buffer) - 1);
+            buffer[len++] = '\n';
             storage_file_write(file, buffer, len);
         }
+#if QR_PROFILE
+        upi_qr_app_write_profile(app, file);
+#endif
         storage_file_close(file);
     }
     
     storage_file_free(file);
+    return written;
+}
+
+// Writes the symbol on screen next to the saved entries as "<name>.bmp", "<name>.xbm"
+// and "<name>.svg", name being the VPA and scale made into a C identifier
+static bool upi_qr_app_export(UpiQrApp* app, uint8_t scale, char* name, size_t name_size) {
+    storage_simply_mkdir(app->storage, SAVE_PATH);
+    
+    snprintf(name, name_size, "qr_%s_%ux", app->input_buffer, scale);
+    for(char* c = name; *c; c++) {
+        bool keep = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9');
+        if(!keep) *c = '_';
+    }
+    
+    char path[sizeof(SAVE_PATH) + MAX_UPI_LENGTH + 24];
+    snprintf(path, sizeof(path), "%s/%s.bmp", SAVE_PATH, name);
+    if(!upi_qr_export_bmp(app->storage, path, &app->qr_result.qrcode, scale)) return false;
+    
+    snprintf(path, sizeof(path), "%s/%s.xbm", SAVE_PATH, name);
+    if(!upi_qr_export_xbm(app->storage, path, name, &app->qr_result.qrcode, scale)) return false;
+    
+    snprintf(path, sizeof(path), "%s/%s.svg", SAVE_PATH, name);
+    return upi_qr_export_svg(app->storage, path, &app->qr_result.qrcode, scale);
 }
 
 // View dispatcher callbacks
 static bool upi_qr_custom_event_callback(void* context, uint32_t event) {
     furi_assert(context);
     UpiQrApp* app = context;
-    return scene_manager_handle_custom_event(app->scene_manager, event);
+    
+    // Loading finishes in whatever scene is up, so it is handled above the scenes
+    if(event == UpiQrCustomEventSavedLoaded) {
+        upi_qr_app_finish_load(app);
+        return true;
+    }
+    
+    // Charged to the handling scene, including any scene it moves to
+    UpiQrStatsMark mark;
+    UpiQrScene scene = app->stats_scene;
+    upi_qr_stats_begin(&mark);
+    bool consumed = scene_manager_handle_custom_event(app->scene_manager, event);
+    upi_qr_stats_end(&mark, &app->scene_stats[scene]);
+    
+    return consumed;
 }
 
 static bool upi_qr_back_event_callback(void* context) {
     furi_assert(context);
     UpiQrApp* app = context;
-    return scene_manager_handle_back_event(app->scene_manager);
+    
+    UpiQrStatsMark mark;
+    UpiQrScene scene = app->stats_scene;
+    upi_qr_stats_begin(&mark);
+    bool consumed = scene_manager_handle_back_event(app->scene_manager);
+    upi_qr_stats_end(&mark, &app->scene_stats[scene]);
+    
+    return consumed;
 }
 
 // App lifecycle
@@ -756,45 +2173,100 @@ UpiQrApp* upi_qr_app_alloc() {
     // Create views
     app->submenu = submenu_alloc();
     app->text_input = text_input_alloc();
-    app->widget = widget_alloc();
+    app->qr_view = view_alloc();
+    view_set_context(app->qr_view, app);
+    view_set_draw_callback(app->qr_view, upi_qr_view_draw_callback);
+    view_set_input_callback(app->qr_view, upi_qr_view_input_callback);
+    view_allocate_model(app->qr_view, ViewModelTypeLocking, sizeof(UpiQrViewModel));
+    with_view_model(
+        app->qr_view,
+        UpiQrViewModel * model,
+        {
+            model->bitmap = &model->symbol;
+            model->symbol.message = "Generating...";
+            model->slides = 0;
+        },
+        false);
+    app->amount_view = view_alloc();
+    view_set_context(app->amount_view, app);
+    view_set_draw_callback(app->amount_view, upi_qr_amount_draw_callback);
+    view_set_input_callback(app->amount_view, upi_qr_amount_input_callback);
+    view_allocate_model(app->amount_view, ViewModelTypeLocking, sizeof(UpiQrAmountViewModel));
     app->popup = popup_alloc();
     
     view_dispatcher_add_view(app->view_dispatcher, UpiQrViewMenu, submenu_get_view(app->submenu));
     view_dispatcher_add_view(app->view_dispatcher, UpiQrViewTextInput, text_input_get_view(app->text_input));
-    view_dispatcher_add_view(app->view_dispatcher, UpiQrViewWidget, widget_get_view(app->widget));
+    view_dispatcher_add_view(app->view_dispatcher, UpiQrViewQr, app->qr_view);
     view_dispatcher_add_view(app->view_dispatcher, UpiQrViewPopup, popup_get_view(app->popup));
-    
-    // Initialize data
-    app->saved_count = 0;
+    view_dispatcher_add_view(app->view_dispatcher, UpiQrViewAmount, app->amount_view);
+    
+    app->worker = upi_qr_worker_alloc(upi_qr_worker_callback, app);
+    app->qr_generation = 0;
+    app->qr_payload_bits = 0;
+    app->qr_ready = false;
+    app->qr_saved = false;
+    app->format = UpiQrFormatUri;
+    app->emv_merchant[0] = '\0';
+    app->carousel = NULL;
+    app->carousel_generation = 0;
+    app->amount[0] = '\0';
+    app->note_buffer[0] = '\0';
+    app->amount_generation = 0;
+    
+    // Initialize data; saved entries are loaded once the menu is up
+    app->saved = upi_qr_entries_alloc();
     app->selected_index = 0;
+    app->saved_loaded = false;
+    app->saved_dirty = false;
+    app->saved_generation = 0;
+    app->loader = NULL;
+    app->loader_entries = NULL;
+    app->importer = NULL;
+    app->import_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    memset(app->scene_stats, 0, sizeof(app->scene_stats));
+    app->stats_scene = UpiQrSceneMenu;
     memset(app->input_buffer, 0, MAX_UPI_LENGTH);
-    memset(app->username_buffer, 0, 32);
-    memset(app->bank_buffer, 0, 32);
+    memset(app->text_buffer, 0, 32);
     memset(app->name_buffer, 0, 32);
     
-    // Load saved entries
-    upi_qr_app_load_saved(app);
-    
     return app;
 }
 
 void upi_qr_app_free(UpiQrApp* app) {
+    // Stop the loader, the importer and the worker first, they post to the view dispatcher
+    upi_qr_app_finish_load(app);
+    upi_qr_app_finish_import(app);
+    upi_qr_worker_free(app->worker);
+    
+    // Last-used stamps, unless the file changed since it was read
+    if(app->saved_dirty && app->saved_loaded) {
+        UpiQrSavedStamp stamp;
+        upi_qr_saved_get_stamp(app->storage, &stamp);
+        if(upi_qr_saved_stamp_equal(&stamp, &app->saved_stamp)) upi_qr_app_write_entries(app);
+    }
+    upi_qr_carousel_stop(app);
+    
     // Remove views
     view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewMenu);
     view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewTextInput);
-    view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewWidget);
+    view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewQr);
     view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewPopup);
+    view_dispatcher_remove_view(app->view_dispatcher, UpiQrViewAmount);
     
     // Free views
     submenu_free(app->submenu);
     text_input_free(app->text_input);
-    widget_free(app->widget);
+    view_free(app->qr_view);
+    view_free(app->amount_view);
     popup_free(app->popup);
     
     // Free core
     scene_manager_free(app->scene_manager);
     view_dispatcher_free(app->view_dispatcher);
     
+    upi_qr_entries_free(app->saved);
+    furi_mutex_free(app->import_mutex);
+    
     // Close records
     furi_record_close(RECORD_GUI);
     furi_record_close(RECORD_STORAGE);
@@ -806,7 +2278,11 @@ int32_t upi_qr_app(void* p) {
     UNUSED(p);
     UpiQrApp* app = upi_qr_app_alloc();
     
+    UpiQrStatsMark mark;
+    upi_qr_stats_begin(&mark);
     scene_manager_next_scene(app->scene_manager, UpiQrSceneMenu);
+    upi_qr_stats_end(&mark, &app->scene_stats[UpiQrSceneMenu]);
+    upi_qr_app_start_load(app);
     
     view_dispatcher_run(app->view_dispatcher);
     
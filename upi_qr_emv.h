@@ -0,0 +1,41 @@
+#pragma once
+
+#include <furi.h>
+
+// EMVCo merchant-presented (BharatQR) payloads carrying a UPI VPA. Each data object
+// is "TTLLvalue": a two-digit tag, a two-digit length and the value, with a CRC-16
+// over everything last. What depends only on the merchant is built once into a
+// prefix together with the CRC register after it; a payload then appends just the
+// per-transaction objects and finishes the CRC from there.
+#define UPI_QR_EMV_PREFIX_MAX 192
+#define UPI_QR_EMV_NAME_MAX 25 // Longer merchant names are truncated
+#define UPI_QR_EMV_CITY_MAX 15
+
+typedef struct {
+    char data[UPI_QR_EMV_PREFIX_MAX];
+    size_t length;
+    uint16_t crc; // CRC register after data
+} UpiQrEmvPrefix;
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, no reflection), continued from crc; start
+// a new one with 0xFFFF
+uint16_t upi_qr_emv_crc16(uint16_t crc, const void* data, size_t length);
+
+// Builds the merchant's static objects: payload format, the UPI merchant account
+// template holding the VPA, category, currency (INR), country, name and city.
+// Returns false when the VPA does not fit a data object.
+bool upi_qr_emv_prefix_init(
+    UpiQrEmvPrefix* prefix,
+    const char* vpa,
+    const char* name,
+    const char* city);
+
+// Writes prefix, point of initiation, the amount and reference label when given
+// (NULL or "" to leave out) and the CRC. A payload with an amount is marked
+// dynamic. Returns its length, or -1 when it does not fit payload_size.
+int upi_qr_emv_build(
+    const UpiQrEmvPrefix* prefix,
+    const char* amount,
+    const char* reference,
+    char* payload,
+    size_t payload_size);
@@ -0,0 +1,213 @@
+#include "upi_qr_entries.h"
+
+#define ENTRIES_NO_HANDLE 0xFF
+#define ENTRIES_MAX_HANDLES 0xFF
+#define ENTRIES_ARENA_MAX (1UL << 24)
+
+typedef struct {
+    uint32_t text : 24; // "name\0username\0" in the arena
+    uint32_t handle : 8; // Handle table index, ENTRIES_NO_HANDLE when the VPA has no '@'
+    uint32_t last_used;
+} EntryRecord;
+
+struct UpiQrEntries {
+    EntryRecord* records;
+    uint32_t count;
+    uint32_t capacity;
+    
+    uint32_t* handles; // Arena offsets of the interned PSP handles
+    uint32_t handle_count;
+    uint32_t handle_capacity;
+    
+    char* arena;
+    uint32_t arena_size;
+    uint32_t arena_capacity;
+    uint32_t arena_garbage; // Bytes left behind by removed entries
+};
+
+// Grow an array geometrically, starting small: most users save a handful of entries
+static void* entries_grow(void* data, uint32_t* capacity, uint32_t needed, size_t item_size) {
+    if(needed <= *capacity) return data;
+    
+    uint32_t grown = *capacity ? *capacity : 8;
+    while(grown < needed) grown *= 2;
+    *capacity = grown;
+    return realloc(data, grown * item_size);
+}
+
+static uint32_t entries_intern_text(UpiQrEntries* entries, const char* text, size_t length) {
+    uint32_t offset = entries->arena_size;
+    entries->arena = entries_grow(
+        entries->arena, &entries->arena_capacity, entries->arena_size + length + 1, 1);
+    memcpy(entries->arena + offset, text, length);
+    entries->arena[offset + length] = '\0';
+    entries->arena_size += length + 1;
+    return offset;
+}
+
+static uint8_t entries_intern_handle(UpiQrEntries* entries, const char* handle, size_t length) {
+    for(uint32_t i = 0; i < entries->handle_count; i++) {
+        const char* interned = entries->arena + entries->handles[i];
+        if(strncmp(interned, handle, length) == 0 && interned[length] == '\0') return i;
+    }
+    
+    if(entries->handle_count == ENTRIES_MAX_HANDLES) return ENTRIES_NO_HANDLE;
+    
+    entries->handles = entries_grow(
+        entries->handles, &entries->handle_capacity, entries->handle_count + 1, sizeof(uint32_t));
+    entries->handles[entries->handle_count] = entries_intern_text(entries, handle, length);
+    return entries->handle_count++;
+}
+
+// Rebuild the arena without the text of removed entries
+static void entries_compact(UpiQrEntries* entries) {
+    char* old_arena = entries->arena;
+    entries->arena = NULL;
+    entries->arena_size = 0;
+    entries->arena_capacity = 0;
+    entries->arena_garbage = 0;
+    
+    for(uint32_t i = 0; i < entries->handle_count; i++) {
+        const char* handle = old_arena + entries->handles[i];
+        entries->handles[i] = entries_intern_text(entries, handle, strlen(handle));
+    }
+    
+    for(uint32_t i = 0; i < entries->count; i++) {
+        const char* name = old_arena + entries->records[i].text;
+        size_t name_length = strlen(name);
+        size_t text_length = name_length + 1 + strlen(name + name_length + 1);
+        entries->records[i].text = entries_intern_text(entries, name, text_length);
+    }
+    
+    free(old_arena);
+}
+
+UpiQrEntries* upi_qr_entries_alloc(void) {
+    UpiQrEntries* entries = malloc(sizeof(UpiQrEntries));
+    memset(entries, 0, sizeof(UpiQrEntries));
+    return entries;
+}
+
+void upi_qr_entries_free(UpiQrEntries* entries) {
+    upi_qr_entries_reset(entries);
+    free(entries);
+}
+
+void upi_qr_entries_reset(UpiQrEntries* entries) {
+    free(entries->records);
+    free(entries->handles);
+    free(entries->arena);
+    memset(entries, 0, sizeof(UpiQrEntries));
+}
+
+size_t upi_qr_entries_count(const UpiQrEntries* entries) {
+    return entries->count;
+}
+
+bool upi_qr_entries_add(
+    UpiQrEntries* entries,
+    const char* name,
+    const char* vpa,
+    uint32_t last_used) {
+    if(entries->count == UPI_QR_ENTRIES_MAX) return false;
+    
+    size_t name_length = strnlen(name, UPI_QR_ENTRY_NAME_MAX - 1);
+    size_t vpa_length = strnlen(vpa, UPI_QR_ENTRY_VPA_MAX - 1);
+    const char* at = memchr(vpa, '@', vpa_length);
+    size_t username_length = at ? (size_t)(at - vpa) : vpa_length;
+    
+    if(entries->arena_size + name_length + vpa_length + 2 > ENTRIES_ARENA_MAX) return false;
+    
+    uint8_t handle = ENTRIES_NO_HANDLE;
+    if(at) {
+        handle = entries_intern_handle(entries, at + 1, vpa_length - username_length - 1);
+        if(handle == ENTRIES_NO_HANDLE) username_length = vpa_length;
+    }
+    
+    // Name and username go in as one "name\0username\0" run so a record needs one offset
+    uint32_t text = entries_intern_text(entries, name, name_length);
+    entries_intern_text(entries, vpa, username_length);
+    
+    entries->records =
+        entries_grow(entries->records, &entries->capacity, entries->count + 1, sizeof(EntryRecord));
+    EntryRecord* record = &entries->records[entries->count++];
+    record->text = text;
+    record->handle = handle;
+    record->last_used = last_used;
+    
+    return true;
+}
+
+void upi_qr_entries_remove(UpiQrEntries* entries, size_t index) {
+    if(index >= entries->count) return;
+    
+    const char* name = entries->arena + entries->records[index].text;
+    size_t name_length = strlen(name);
+    entries->arena_garbage += name_length + strlen(name + name_length + 1) + 2;
+    
+    memmove(
+        &entries->records[index],
+        &entries->records[index + 1],
+        (entries->count - index - 1) * sizeof(EntryRecord));
+    entries->count--;
+    
+    if(entries->arena_garbage * 2 > entries->arena_size) entries_compact(entries);
+}
+
+const char* upi_qr_entries_get_name(const UpiQrEntries* entries, size_t index) {
+    return entries->arena + entries->records[index].text;
+}
+
+size_t upi_qr_entries_get_vpa(const UpiQrEntries* entries, size_t index, char* vpa, size_t size) {
+    const EntryRecord* record = &entries->records[index];
+    const char* name = entries->arena + record->text;
+    const char* username = name + strlen(name) + 1;
+    
+    if(record->handle == ENTRIES_NO_HANDLE) {
+        return snprintf(vpa, size, "%s", username);
+    }
+    return snprintf(vpa, size, "%s@%s", username, entries->arena + entries->handles[record->handle]);
+}
+
+uint32_t upi_qr_entries_get_last_used(const UpiQrEntries* entries, size_t index) {
+    return entries->records[index].last_used;
+}
+
+void upi_qr_entries_set_last_used(UpiQrEntries* entries, size_t index, uint32_t last_used) {
+    entries->records[index].last_used = last_used;
+}
+
+size_t upi_qr_entries_format_line(const UpiQrEntries* entries, size_t index, char* line, size_t size) {
+    char vpa[UPI_QR_ENTRY_VPA_MAX];
+    upi_qr_entries_get_vpa(entries, index, vpa, sizeof(vpa));
+    return snprintf(
+        line,
+        size,
+        "%s|%s|%lu\n",
+        upi_qr_entries_get_name(entries, index),
+        vpa,
+        (unsigned long)entries->records[index].last_used);
+}
+
+void upi_qr_entries_trim(UpiQrEntries* entries) {
+    if(entries->count == 0) {
+        upi_qr_entries_reset(entries);
+        return;
+    }
+    
+    if(entries->arena_garbage) entries_compact(entries);
+    
+    entries->records = realloc(entries->records, entries->count * sizeof(EntryRecord));
+    entries->capacity = entries->count;
+    if(entries->handle_count) {
+        entries->handles = realloc(entries->handles, entries->handle_count * sizeof(uint32_t));
+        entries->handle_capacity = entries->handle_count;
+    }
+    entries->arena = realloc(entries->arena, entries->arena_size);
+    entries->arena_capacity = entries->arena_size;
+}
+
+size_t upi_qr_entries_get_memory(const UpiQrEntries* entries) {
+    return sizeof(UpiQrEntries) + entries->capacity * sizeof(EntryRecord) +
+           entries->handle_capacity * sizeof(uint32_t) + entries->arena_capacity;
+}
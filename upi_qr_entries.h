@@ -0,0 +1,52 @@
+#pragma once
+
+#include <furi.h>
+
+// Saved entries, stored compactly: names and VPA usernames live at their real length
+// in one string arena, and the PSP handle after the '@' ("ybl", "okaxis", ...) is
+// interned once and referenced by a one-byte index. A record costs 8 bytes plus its
+// text, so thousands of entries fit in the heap a FAP gets.
+#define UPI_QR_ENTRIES_MAX 4096
+#define UPI_QR_ENTRY_NAME_MAX 32 // Including the terminator
+#define UPI_QR_ENTRY_VPA_MAX 64 // Including the terminator
+#define UPI_QR_ENTRY_LINE_MAX 128 // A saved file line, see upi_qr_entries_format_line
+
+typedef struct UpiQrEntries UpiQrEntries;
+
+UpiQrEntries* upi_qr_entries_alloc(void);
+
+void upi_qr_entries_free(UpiQrEntries* entries);
+
+void upi_qr_entries_reset(UpiQrEntries* entries);
+
+size_t upi_qr_entries_count(const UpiQrEntries* entries);
+
+// Appends an entry; name and VPA are truncated to the limits above. Returns false
+// once UPI_QR_ENTRIES_MAX entries are held.
+bool upi_qr_entries_add(
+    UpiQrEntries* entries,
+    const char* name,
+    const char* vpa,
+    uint32_t last_used);
+
+void upi_qr_entries_remove(UpiQrEntries* entries, size_t index);
+
+// Points into the arena; only valid until the next add or remove
+const char* upi_qr_entries_get_name(const UpiQrEntries* entries, size_t index);
+
+// Reassembles "username@handle" into vpa, returns its length
+size_t upi_qr_entries_get_vpa(const UpiQrEntries* entries, size_t index, char* vpa, size_t size);
+
+uint32_t upi_qr_entries_get_last_used(const UpiQrEntries* entries, size_t index);
+
+void upi_qr_entries_set_last_used(UpiQrEntries* entries, size_t index, uint32_t last_used);
+
+// Writes an entry as its line of the saved file, "name|vpa|last_used\n", and returns
+// its length; UPI_QR_ENTRY_LINE_MAX bytes always suffice
+size_t upi_qr_entries_format_line(const UpiQrEntries* entries, size_t index, char* line, size_t size);
+
+// Gives back the spare capacity left by growing, e.g. once a file is loaded
+void upi_qr_entries_trim(UpiQrEntries* entries);
+
+// Heap held by the records, the handle table and the arena
+size_t upi_qr_entries_get_memory(const UpiQrEntries* entries);
@@ -0,0 +1,201 @@
+#include "upi_qr_export.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPORT_CHUNK_SIZE 256 // Bytes gathered per storage write
+#define EXPORT_BMP_HEADER_SIZE 62 // File header, info header and two palette entries
+#define EXPORT_BMP_PIXELS_PER_METER 2835 // 72 dpi
+#define EXPORT_XBM_BYTES_PER_LINE 12
+
+// Output file with a sticky error, so a run of writes needs one check at the end.
+// Lives on the heap with the row it is writing; the UI thread's stack is small.
+typedef struct {
+    File* file;
+    uint8_t chunk[EXPORT_CHUNK_SIZE];
+    size_t length;
+    bool ok;
+    uint8_t line[]; // One pixel row
+} ExportWriter;
+
+static ExportWriter* export_open(Storage* storage, const char* path, size_t line_size) {
+    ExportWriter* writer = malloc(sizeof(ExportWriter) + line_size);
+    memset(writer->line, 0, line_size);
+    writer->length = 0;
+    writer->file = storage_file_alloc(storage);
+    writer->ok = storage_file_open(writer->file, path, FSAM_WRITE, FSOM_CREATE_ALWAYS);
+    return writer;
+}
+
+static void export_flush(ExportWriter* writer) {
+    if(writer->ok && writer->length > 0 &&
+       storage_file_write(writer->file, writer->chunk, writer->length) != writer->length) {
+        writer->ok = false;
+    }
+    writer->length = 0;
+}
+
+static void export_write(ExportWriter* writer, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    while(writer->ok && length > 0) {
+        size_t count = EXPORT_CHUNK_SIZE - writer->length;
+        if(count > length) count = length;
+        memcpy(writer->chunk + writer->length, bytes, count);
+        writer->length += count;
+        bytes += count;
+        length -= count;
+        if(writer->length == EXPORT_CHUNK_SIZE) export_flush(writer);
+    }
+}
+
+// Flushes and closes; a file that was not written completely is removed
+static bool export_close(ExportWriter* writer, Storage* storage, const char* path) {
+    export_flush(writer);
+    bool ok = writer->ok;
+    storage_file_close(writer->file);
+    storage_file_free(writer->file);
+    free(writer);
+    
+    if(!ok) storage_common_remove(storage, path);
+    return ok;
+}
+
+static void export_put_le(uint8_t* out, uint32_t value, uint8_t bytes) {
+    for(uint8_t i = 0; i < bytes; i++) {
+        out[i] = value >> (8 * i);
+    }
+}
+
+uint16_t upi_qr_export_get_size(QRCode* qrcode, uint8_t scale) {
+    return qrcode_getRasterSize(qrcode, scale, UPI_QR_EXPORT_QUIET_ZONE);
+}
+
+bool upi_qr_export_bmp(Storage* storage, const char* path, QRCode* qrcode, uint8_t scale) {
+    uint16_t size = upi_qr_export_get_size(qrcode, scale);
+    uint16_t modules = size / scale;
+    uint32_t stride = ((size + 7) / 8 + 3) & ~3u; // Rows are padded to 4 bytes
+    uint32_t image_size = stride * size;
+    
+    uint8_t header[EXPORT_BMP_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    export_put_le(header + 2, EXPORT_BMP_HEADER_SIZE + image_size, 4);
+    export_put_le(header + 10, EXPORT_BMP_HEADER_SIZE, 4); // Offset of the pixels
+    export_put_le(header + 14, 40, 4); // BITMAPINFOHEADER
+    export_put_le(header + 18, size, 4);
+    export_put_le(header + 22, size, 4); // Positive: the last row comes first
+    export_put_le(header + 26, 1, 2); // Planes
+    export_put_le(header + 28, 1, 2); // Bits per pixel
+    export_put_le(header + 34, image_size, 4);
+    export_put_le(header + 38, EXPORT_BMP_PIXELS_PER_METER, 4);
+    export_put_le(header + 42, EXPORT_BMP_PIXELS_PER_METER, 4);
+    export_put_le(header + 46, 2, 4); // Palette entries
+    memset(header + 54, 0xFF, 3); // Index 0 white, index 1 stays black
+    
+    // Padding bytes past the rasterized part of the row stay zero
+    ExportWriter* writer = export_open(storage, path, stride);
+    export_write(writer, header, sizeof(header));
+    
+    for(uint16_t row = modules; row-- > 0 && writer->ok;) {
+        qrcode_rasterizeRow(
+            qrcode, writer->line, row * scale, scale, UPI_QR_EXPORT_QUIET_ZONE, QR_RASTER_MSB);
+        for(uint8_t i = 0; i < scale; i++) {
+            export_write(writer, writer->line, stride);
+        }
+    }
+    
+    return export_close(writer, storage, path);
+}
+
+bool upi_qr_export_xbm(
+    Storage* storage,
+    const char* path,
+    const char* name,
+    QRCode* qrcode,
+    uint8_t scale) {
+    static const char hex[] = "0123456789abcdef";
+    uint16_t size = upi_qr_export_get_size(qrcode, scale);
+    uint16_t modules = size / scale;
+    uint16_t line_bytes = (size + 7) / 8;
+    
+    ExportWriter* writer = export_open(storage, path, line_bytes);
+    
+    char text[16];
+    const char* suffixes[] = {"_width ", "_height "};
+    for(uint8_t i = 0; i < 2; i++) {
+        export_write(writer, "#define ", 8);
+        export_write(writer, name, strlen(name));
+        export_write(writer, suffixes[i], strlen(suffixes[i]));
+        int length = snprintf(text, sizeof(text), "%u\n", size);
+        export_write(writer, text, length);
+    }
+    export_write(writer, "static unsigned char ", 21);
+    export_write(writer, name, strlen(name));
+    export_write(writer, "_bits[] = {\n   ", 15);
+    
+    uint32_t count = 0;
+    for(uint16_t row = 0; row < modules && writer->ok; row++) {
+        qrcode_rasterizeRow(
+            qrcode, writer->line, row * scale, scale, UPI_QR_EXPORT_QUIET_ZONE, QR_RASTER_XBM);
+        for(uint8_t i = 0; i < scale; i++) {
+            for(uint16_t j = 0; j < line_bytes; j++, count++) {
+                // "0xhh" items, EXPORT_XBM_BYTES_PER_LINE to a line
+                if(count > 0) {
+                    const char* separator = count % EXPORT_XBM_BYTES_PER_LINE ? ", " : ",\n   ";
+                    export_write(writer, separator, strlen(separator));
+                }
+                
+                uint8_t byte = writer->line[j];
+                char item[4] = {'0', 'x', hex[byte >> 4], hex[byte & 0x0F]};
+                export_write(writer, item, sizeof(item));
+            }
+        }
+    }
+    
+    export_write(writer, " };\n", 4);
+    return export_close(writer, storage, path);
+}
+
+static void export_svg_rect(void* context, const QRRect* rect) {
+    ExportWriter* writer = context;
+    char text[32];
+    int length = snprintf(
+        text,
+        sizeof(text),
+        "M%u %uh%uv%uh-%uz",
+        rect->x + UPI_QR_EXPORT_QUIET_ZONE,
+        rect->y + UPI_QR_EXPORT_QUIET_ZONE,
+        rect->width,
+        rect->height,
+        rect->width);
+    export_write(writer, text, length);
+}
+
+bool upi_qr_export_svg(Storage* storage, const char* path, QRCode* qrcode, uint8_t scale) {
+    uint16_t size = upi_qr_export_get_size(qrcode, scale);
+    uint16_t modules = size / scale;
+    
+    ExportWriter* writer = export_open(storage, path, 0);
+    
+    // Module units in the view box; width and height set the printed size
+    char text[160];
+    int length = snprintf(
+        text,
+        sizeof(text),
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\" viewBox=\"0 0 %u %u\" "
+        "shape-rendering=\"crispEdges\">\n",
+        size,
+        size,
+        modules,
+        modules);
+    export_write(writer, text, length);
+    length = snprintf(
+        text, sizeof(text), "<rect width=\"%u\" height=\"%u\" fill=\"#fff\"/>\n<path d=\"", modules, modules);
+    export_write(writer, text, length);
+    
+    qrcode_getRects(qrcode, true, export_svg_rect, writer);
+    
+    export_write(writer, "\"/>\n</svg>\n", 11);
+    return export_close(writer, storage, path);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <furi.h>
+#include <storage/storage.h>
+#include "qrcode.h"
+
+// Writes a symbol to a file as a 1bpp image with a quiet zone, dark modules black.
+// Pixel rows are rasterized one module row at a time and go out through a small
+// chunk buffer, so memory use grows with the image width, never its area.
+#define UPI_QR_EXPORT_QUIET_ZONE 4 // Modules of white border the spec asks for
+#define UPI_QR_EXPORT_SCALE_MAX 32
+
+// Width and height in pixels of the exported image
+uint16_t upi_qr_export_get_size(QRCode* qrcode, uint8_t scale);
+
+// Windows BMP, bottom-up, with a two-color palette
+bool upi_qr_export_bmp(Storage* storage, const char* path, QRCode* qrcode, uint8_t scale);
+
+// X bitmap: C source declaring name_width, name_height and name_bits, name being a
+// valid C identifier
+bool upi_qr_export_xbm(
+    Storage* storage,
+    const char* path,
+    const char* name,
+    QRCode* qrcode,
+    uint8_t scale);
+
+// SVG: the dark modules as one path of rectangles, runs repeated on the rows below
+// merged, over a white square with the quiet zone. Sized as the bitmaps of the same
+// scale, but it prints sharp at any size.
+bool upi_qr_export_svg(Storage* storage, const char* path, QRCode* qrcode, uint8_t scale);
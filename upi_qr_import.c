@@ -0,0 +1,320 @@
+#include "upi_qr_import.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IMPORT_READ_SIZE 256
+#define IMPORT_WRITE_SIZE 1024 // Room for a batch of typical lines; longer ones flush early
+#define IMPORT_FIELDS 2 // name, vpa; later columns are dropped
+#define IMPORT_SET_SIZE 8192 // Power of two, twice UPI_QR_ENTRIES_MAX
+
+// VPA validation: each byte maps to a class, each class moves the state machine
+typedef enum {
+    VpaClassOther,
+    VpaClassLetter,
+    VpaClassDigit,
+    VpaClassPunct,
+    VpaClassAt,
+    VpaClassCount,
+} VpaClass;
+
+typedef enum {
+    VpaStateStart,
+    VpaStateUsername,
+    VpaStateHandleStart,
+    VpaStateHandle, // The only accepting state
+    VpaStateReject,
+    VpaStateCount,
+} VpaState;
+
+static const uint8_t vpa_classes[128] = {
+    ['a' ... 'z'] = VpaClassLetter,
+    ['A' ... 'Z'] = VpaClassLetter,
+    ['0' ... '9'] = VpaClassDigit,
+    ['.'] = VpaClassPunct,
+    ['-'] = VpaClassPunct,
+    ['_'] = VpaClassPunct,
+    ['@'] = VpaClassAt,
+};
+
+static const uint8_t vpa_transitions[VpaStateCount][VpaClassCount] = {
+    [VpaStateStart] =
+        {VpaStateReject, VpaStateUsername, VpaStateUsername, VpaStateReject, VpaStateReject},
+    [VpaStateUsername] =
+        {VpaStateReject, VpaStateUsername, VpaStateUsername, VpaStateUsername, VpaStateHandleStart},
+    [VpaStateHandleStart] =
+        {VpaStateReject, VpaStateHandle, VpaStateReject, VpaStateReject, VpaStateReject},
+    [VpaStateHandle] =
+        {VpaStateReject, VpaStateHandle, VpaStateHandle, VpaStateReject, VpaStateReject},
+    [VpaStateReject] =
+        {VpaStateReject, VpaStateReject, VpaStateReject, VpaStateReject, VpaStateReject},
+};
+
+bool upi_qr_import_vpa_valid(const char* vpa, size_t length) {
+    if(length >= UPI_QR_ENTRY_VPA_MAX) return false;
+    
+    uint8_t state = VpaStateStart;
+    for(size_t i = 0; i < length && state != VpaStateReject; i++) {
+        uint8_t c = vpa[i];
+        state = vpa_transitions[state][c < 128 ? vpa_classes[c] : VpaClassOther];
+    }
+    return state == VpaStateHandle;
+}
+
+typedef enum {
+    CsvFieldStart,
+    CsvUnquoted,
+    CsvQuoted,
+    CsvQuotedEnd, // A quote inside a quoted field: the end, or the first of ""
+} CsvState;
+
+typedef struct {
+    char text[UPI_QR_ENTRY_VPA_MAX];
+    size_t length;
+    bool overflow;
+} ImportField;
+
+typedef struct {
+    UpiQrEntries* entries;
+    uint32_t last_used;
+    UpiQrImportProgress progress;
+    UpiQrImportCallback callback;
+    void* context;
+    
+    CsvState state;
+    ImportField fields[IMPORT_FIELDS];
+    uint8_t field; // Fields ended so far in this record
+    uint32_t line;
+    
+    uint16_t* set; // Open addressing over entry index + 1, 0 for a free slot
+    
+    File* save;
+    bool ok;
+    char batch[IMPORT_WRITE_SIZE];
+    size_t batch_length;
+    uint32_t batch_entries;
+    
+    uint8_t read[IMPORT_READ_SIZE];
+} Importer;
+
+// FNV-1a
+static uint32_t import_hash(const char* text) {
+    uint32_t hash = 2166136261UL;
+    while(*text) {
+        hash = (hash ^ (uint8_t)*text++) * 16777619UL;
+    }
+    return hash;
+}
+
+// The slot holding vpa, or the free slot it would go in. Entries only hash to the
+// slot, so each candidate is compared by its VPA.
+static uint16_t* import_set_find(Importer* importer, const char* vpa) {
+    uint32_t slot = import_hash(vpa) & (IMPORT_SET_SIZE - 1);
+    
+    while(importer->set[slot]) {
+        char saved[UPI_QR_ENTRY_VPA_MAX];
+        upi_qr_entries_get_vpa(importer->entries, importer->set[slot] - 1, saved, sizeof(saved));
+        if(strcmp(saved, vpa) == 0) break;
+        slot = (slot + 1) & (IMPORT_SET_SIZE - 1);
+    }
+    return &importer->set[slot];
+}
+
+// Writes the batch to the saved file and reports progress
+static void import_flush(Importer* importer) {
+    if(importer->batch_length > 0 && importer->ok) {
+        importer->ok =
+            storage_file_write(importer->save, importer->batch, importer->batch_length) ==
+            importer->batch_length;
+    }
+    importer->batch_length = 0;
+    importer->batch_entries = 0;
+    
+    if(importer->callback) importer->callback(&importer->progress, importer->context);
+}
+
+static void import_end_record(Importer* importer) {
+    uint8_t fields = importer->field;
+    importer->field = 0;
+    importer->line++;
+    
+    // A lone field is the VPA
+    ImportField* name = &importer->fields[0];
+    ImportField* vpa = &importer->fields[fields > 1 ? 1 : 0];
+    if(fields == 1 && vpa->length == 0) return; // Blank line
+    
+    if(fields == 0 || vpa->overflow || !upi_qr_import_vpa_valid(vpa->text, vpa->length)) {
+        if(importer->line > 1) importer->progress.invalid++;
+        return;
+    }
+    
+    uint16_t* slot = import_set_find(importer, vpa->text);
+    if(*slot) {
+        importer->progress.duplicates++;
+        return;
+    }
+    
+    if(!upi_qr_entries_add(
+           importer->entries,
+           fields > 1 && name->length > 0 ? name->text : "Unnamed",
+           vpa->text,
+           importer->last_used)) {
+        importer->progress.invalid++;
+        return;
+    }
+    
+    size_t index = upi_qr_entries_count(importer->entries) - 1;
+    *slot = index + 1;
+    importer->progress.added++;
+    
+    if(importer->batch_length + UPI_QR_ENTRY_LINE_MAX > sizeof(importer->batch)) {
+        import_flush(importer);
+    }
+    importer->batch_length += upi_qr_entries_format_line(
+        importer->entries,
+        index,
+        importer->batch + importer->batch_length,
+        sizeof(importer->batch) - importer->batch_length);
+    if(++importer->batch_entries == UPI_QR_IMPORT_BATCH) import_flush(importer);
+}
+
+static void import_end_field(Importer* importer, bool unquoted) {
+    if(importer->field < IMPORT_FIELDS) {
+        ImportField* field = &importer->fields[importer->field];
+        while(unquoted && field->length > 0 && field->text[field->length - 1] == ' ') {
+            field->length--;
+        }
+        field->text[field->length] = '\0';
+    }
+    
+    importer->field++;
+    importer->state = CsvFieldStart;
+}
+
+static void import_field_put(Importer* importer, char c) {
+    if(importer->field >= IMPORT_FIELDS) return;
+    
+    ImportField* field = &importer->fields[importer->field];
+    if(field->length + 1 >= sizeof(field->text)) {
+        field->overflow = true;
+        return;
+    }
+    
+    // Separators of the saved file never make it into a name
+    field->text[field->length++] = ((uint8_t)c < ' ' || c == '|') ? ' ' : c;
+}
+
+static void import_put(Importer* importer, char c) {
+    switch(importer->state) {
+        case CsvFieldStart:
+            if(importer->field < IMPORT_FIELDS) {
+                importer->fields[importer->field].length = 0;
+                importer->fields[importer->field].overflow = false;
+            }
+            if(c == ' ' || c == '\t') return;
+            if(c == '"') {
+                importer->state = CsvQuoted;
+                return;
+            }
+            importer->state = CsvUnquoted;
+            // Fall through
+        case CsvUnquoted:
+            if(c == ',') {
+                import_end_field(importer, true);
+            } else if(c == '\n') {
+                import_end_field(importer, true);
+                import_end_record(importer);
+            } else if(c != '\r') {
+                import_field_put(importer, c);
+            }
+            break;
+        case CsvQuoted:
+            if(c == '"') {
+                importer->state = CsvQuotedEnd;
+            } else {
+                import_field_put(importer, c);
+            }
+            break;
+        case CsvQuotedEnd:
+            if(c == '"') {
+                import_field_put(importer, '"');
+                importer->state = CsvQuoted;
+            } else if(c == ',') {
+                import_end_field(importer, false);
+            } else if(c == '\n') {
+                import_end_field(importer, false);
+                import_end_record(importer);
+            }
+            // Anything else between the closing quote and the separator is dropped
+            break;
+    }
+}
+
+bool upi_qr_import_csv(
+    Storage* storage,
+    const char* csv_path,
+    const char* save_path,
+    UpiQrEntries* entries,
+    uint32_t last_used,
+    UpiQrImportCallback callback,
+    void* context) {
+    Importer* importer = malloc(sizeof(Importer));
+    memset(importer, 0, sizeof(Importer));
+    importer->entries = entries;
+    importer->last_used = last_used;
+    importer->callback = callback;
+    importer->context = context;
+    importer->state = CsvFieldStart;
+    
+    // What is saved already counts as a duplicate
+    importer->set = malloc(IMPORT_SET_SIZE * sizeof(uint16_t));
+    memset(importer->set, 0, IMPORT_SET_SIZE * sizeof(uint16_t));
+    for(size_t i = 0; i < upi_qr_entries_count(entries); i++) {
+        char vpa[UPI_QR_ENTRY_VPA_MAX];
+        upi_qr_entries_get_vpa(entries, i, vpa, sizeof(vpa));
+        uint16_t* slot = import_set_find(importer, vpa);
+        if(!*slot) *slot = i + 1;
+    }
+    
+    File* csv = storage_file_alloc(storage);
+    importer->save = storage_file_alloc(storage);
+    importer->ok = storage_file_open(csv, csv_path, FSAM_READ, FSOM_OPEN_EXISTING) &&
+                   storage_file_open(importer->save, save_path, FSAM_WRITE, FSOM_OPEN_APPEND);
+    
+    if(importer->ok) {
+        importer->progress.bytes_total = storage_file_size(csv);
+    
+        while(importer->ok) {
+            size_t bytes_read = storage_file_read(csv, importer->read, sizeof(importer->read));
+            if(bytes_read == 0) break;
+    
+            // Skip a UTF-8 byte order mark
+            size_t i = 0;
+            if(importer->progress.bytes_read == 0 && bytes_read >= 3 &&
+               memcmp(importer->read, "\xEF\xBB\xBF", 3) == 0) {
+                i = 3;
+            }
+            importer->progress.bytes_read += bytes_read;
+    
+            for(; i < bytes_read; i++) {
+                import_put(importer, importer->read[i]);
+            }
+        }
+    
+        // The last line may lack its newline, a quoted field its closing quote
+        if(importer->state == CsvQuoted) importer->state = CsvQuotedEnd;
+        if(importer->state != CsvFieldStart || importer->field > 0) import_put(importer, '\n');
+    }
+    
+    import_flush(importer);
+    bool ok = importer->ok;
+    
+    storage_file_close(importer->save);
+    storage_file_free(importer->save);
+    storage_file_close(csv);
+    storage_file_free(csv);
+    free(importer->set);
+    free(importer);
+    
+    return ok;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <furi.h>
+#include <storage/storage.h>
+#include "upi_qr_entries.h"
+
+// Bulk import of merchants from a CSV file. Each line is "name,vpa" (a line with one
+// field is just the VPA), fields may be quoted as in RFC 4180 and further columns
+// are ignored; a first line without a valid VPA is taken for a header. The file is
+// streamed through a fixed read buffer, each VPA is checked by a table-driven state
+// machine and looked up in a hash set of the VPAs already saved, and new entries are
+// appended to the saved file a batch at a time.
+#define UPI_QR_IMPORT_BATCH 32 // Entries per append to the saved file
+
+typedef struct {
+    uint32_t added;
+    uint32_t duplicates;
+    uint32_t invalid; // Malformed VPA, or no room left for it
+    uint32_t bytes_read;
+    uint32_t bytes_total;
+} UpiQrImportProgress;
+
+// Called on the importing thread after every batch and once at the end
+typedef void (*UpiQrImportCallback)(const UpiQrImportProgress* progress, void* context);
+
+// "username@handle": the username of letters, digits, '.', '-' and '_', starting with
+// a letter or digit, the handle of letters and digits, starting with a letter
+bool upi_qr_import_vpa_valid(const char* vpa, size_t length);
+
+// Adds the new VPAs of csv_path to entries and appends them to save_path, with
+// last_used as their timestamp. Returns false when the CSV could not be read or
+// save_path not written; entries may then hold more than the file.
+bool upi_qr_import_csv(
+    Storage* storage,
+    const char* csv_path,
+    const char* save_path,
+    UpiQrEntries* entries,
+    uint32_t last_used,
+    UpiQrImportCallback callback,
+    void* context);
@@ -0,0 +1,56 @@
+#include <furi.h>
+#include <gui/gui.h>
+#include <gui/view_dispatcher.h>
+#include <gui/view.h>
+
+#include "upi_qr_static_bitmap.h"
+
+// A single merchant's QR code, encoded at build time by tools/upi_qr_static_gen into
+// an XBM in flash. Nothing is encoded or rendered here: no encoder, worker or module
+// buffers, and every frame is one blit.
+
+typedef enum {
+    UpiQrStaticViewQr,
+} UpiQrStaticView;
+
+static void upi_qr_static_draw_callback(Canvas* canvas, void* model) {
+    UNUSED(model);
+    canvas_clear(canvas);
+    canvas_draw_xbm(
+        canvas,
+        (128 - UPI_QR_STATIC_SIZE) / 2,
+        0,
+        UPI_QR_STATIC_SIZE,
+        UPI_QR_STATIC_SIZE,
+        upi_qr_static_bits);
+}
+
+// Back leaves the app
+static bool upi_qr_static_navigation_callback(void* context) {
+    UNUSED(context);
+    return false;
+}
+
+int32_t upi_qr_static_app(void* p) {
+    UNUSED(p);
+    
+    Gui* gui = furi_record_open(RECORD_GUI);
+    ViewDispatcher* view_dispatcher = view_dispatcher_alloc();
+    view_dispatcher_set_navigation_event_callback(
+        view_dispatcher, upi_qr_static_navigation_callback);
+    
+    View* view = view_alloc();
+    view_set_draw_callback(view, upi_qr_static_draw_callback);
+    view_dispatcher_add_view(view_dispatcher, UpiQrStaticViewQr, view);
+    
+    view_dispatcher_attach_to_gui(view_dispatcher, gui, ViewDispatcherTypeFullscreen);
+    view_dispatcher_switch_to_view(view_dispatcher, UpiQrStaticViewQr);
+    view_dispatcher_run(view_dispatcher);
+    
+    view_dispatcher_remove_view(view_dispatcher, UpiQrStaticViewQr);
+    view_free(view);
+    view_dispatcher_free(view_dispatcher);
+    furi_record_close(RECORD_GUI);
+    
+    return 0;
+}
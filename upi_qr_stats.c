@@ -0,0 +1,78 @@
+#include "upi_qr_stats.h"
+
+// Same fill byte FreeRTOS paints new stacks with
+#define STATS_STACK_PATTERN 0xA5A5A5A5UL
+// Room left for upi_qr_stats_begin's own frame and the helpers it calls
+#define STATS_STACK_GUARD 128
+
+// Painting and scanning touch stack below the stack pointer on purpose
+__attribute__((noinline, no_sanitize_address)) void upi_qr_stats_begin(UpiQrStatsMark* mark) {
+    volatile uint32_t probe = 0;
+    
+    // The RTOS watermark is the least free stack the thread ever had, so at least that
+    // much lies below the current frame; paint it, minus a guard for this frame
+    uint32_t space = furi_thread_get_stack_space(furi_thread_get_current_id());
+    uint32_t paint = space > 2 * STATS_STACK_GUARD ? space - 2 * STATS_STACK_GUARD : 0;
+    
+    uint32_t* high = (uint32_t*)(((uintptr_t)&probe - STATS_STACK_GUARD) & ~(uintptr_t)3);
+    uint32_t* low = high - paint / sizeof(uint32_t);
+    for(volatile uint32_t* word = low; word < high; word++) {
+        *word = STATS_STACK_PATTERN;
+    }
+    
+    mark->painted_low = low;
+    mark->painted_high = high;
+}
+
+__attribute__((noinline, no_sanitize_address)) void
+    upi_qr_stats_end(UpiQrStatsMark* mark, UpiQrStatsRecord* record) {
+    volatile uint32_t* word = mark->painted_low;
+    while(word < mark->painted_high && *word == STATS_STACK_PATTERN) {
+        word++;
+    }
+    
+    // Nothing painted means no watermark to go by, rather than no stack used
+    uint32_t stack_peak = 0;
+    if(mark->painted_low < mark->painted_high) {
+        stack_peak = (uintptr_t)mark - (uintptr_t)word;
+    }
+    
+    UpiQrStatsRecord sample = {
+        .samples = 1,
+        .stack_peak = stack_peak,
+        .stack_free_min = furi_thread_get_stack_space(furi_thread_get_current_id()),
+    };
+    upi_qr_stats_merge(record, &sample);
+}
+
+void upi_qr_stats_merge(UpiQrStatsRecord* record, const UpiQrStatsRecord* sample) {
+    if(sample->samples == 0) return;
+    
+    if(record->samples == 0 || sample->stack_free_min < record->stack_free_min) {
+        record->stack_free_min = sample->stack_free_min;
+    }
+    if(sample->stack_peak > record->stack_peak) record->stack_peak = sample->stack_peak;
+    if(sample->arena_peak > record->arena_peak) record->arena_peak = sample->arena_peak;
+    record->allocations += sample->allocations;
+    record->samples += sample->samples;
+}
+
+int upi_qr_stats_format(const char* label, const UpiQrStatsRecord* record, char* out, size_t size) {
+    int length = snprintf(
+        out,
+        size,
+        "%s %lu %lu %lu",
+        label,
+        (unsigned long)record->samples,
+        (unsigned long)record->stack_peak,
+        (unsigned long)record->stack_free_min);
+    if(record->allocations > 0 && length >= 0 && (size_t)length < size) {
+        length += snprintf(
+            out + length,
+            size - length,
+            " %lu %lu",
+            (unsigned long)record->arena_peak,
+            (unsigned long)record->allocations);
+    }
+    return length;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <furi.h>
+
+// Resource high-water marks for scenes and encodes. Stack use is measured by painting
+// the free stack below the caller with a known pattern and, afterwards, finding the
+// deepest word that changed. Only the encoder's allocations can be told apart on the
+// device, so heap figures exist for encodes alone: the worker's arena records its
+// high-water mark and block count. Scenes allocate through furi and the GUI library,
+// which report nothing, and their records hold stack figures only.
+
+typedef struct {
+    uint32_t samples;
+    uint32_t stack_peak; // Deepest stack use below the measuring frame, bytes
+    uint32_t stack_free_min; // Lowest free stack the thread ever had (RTOS watermark)
+    uint32_t arena_peak; // Encodes: most of the worker's arena in use at once
+    uint32_t allocations; // Encodes: arena blocks handed out
+} UpiQrStatsRecord;
+
+// Lives in the measuring frame; its address is the point stack use is measured from
+typedef struct {
+    uint32_t* painted_low;
+    uint32_t* painted_high;
+} UpiQrStatsMark;
+
+void upi_qr_stats_begin(UpiQrStatsMark* mark);
+
+// Folds the use since upi_qr_stats_begin into record
+void upi_qr_stats_end(UpiQrStatsMark* mark, UpiQrStatsRecord* record);
+
+void upi_qr_stats_merge(UpiQrStatsRecord* record, const UpiQrStatsRecord* sample);
+
+// "label samples stack_peak stack_free_min", followed by "arena_peak allocations" for
+// records that have them, one line
+int upi_qr_stats_format(const char* label, const UpiQrStatsRecord* record, char* out, size_t size);
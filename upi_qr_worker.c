@@ -0,0 +1,512 @@
+#include "upi_qr_worker.h"
+
+#include <stdatomic.h>
+#if QR_PROFILE
+#include <furi_hal.h>
+#endif
+
+#define WORKER_STACK_SIZE (3 * 1024)
+
+typedef enum {
+    WorkerFlagRequest = (1 << 0),
+    WorkerFlagExit = (1 << 1),
+    WorkerFlagPrewarm = (1 << 2),
+} WorkerFlag;
+
+// Lock-free triple buffer: the producer owns one slot, the consumer owns one, and
+// the third is swapped between them with a single atomic exchange. The producer
+// never waits, and the consumer always gets the newest slot; anything in between
+// is overwritten, which is exactly the latest-wins behaviour wanted here.
+#define TRIPLE_FRESH 0x04
+
+typedef struct {
+    atomic_uint middle; // Slot index | TRIPLE_FRESH when unread
+    uint8_t back; // Producer's slot
+    uint8_t front; // Consumer's slot
+} TripleBuffer;
+
+static void triple_buffer_init(TripleBuffer* buffer) {
+    atomic_init(&buffer->middle, 1);
+    buffer->back = 0;
+    buffer->front = 2;
+}
+
+static void triple_buffer_publish(TripleBuffer* buffer) {
+    buffer->back = atomic_exchange(&buffer->middle, buffer->back | TRIPLE_FRESH) & 0x03;
+}
+
+static bool triple_buffer_has_fresh(TripleBuffer* buffer) {
+    return (atomic_load(&buffer->middle) & TRIPLE_FRESH) != 0;
+}
+
+static bool triple_buffer_take(TripleBuffer* buffer) {
+    if(!triple_buffer_has_fresh(buffer)) return false;
+    buffer->front = atomic_exchange(&buffer->middle, buffer->front) & 0x03;
+    return true;
+}
+
+typedef struct {
+    uint32_t generation;
+    uint8_t version;
+    bool fixed; // Encode at version itself, not the smallest that fits
+    uint16_t prefix_length; // Leading bytes shared with the previous fixed request
+    char payload[UPI_QR_PAYLOAD_MAX];
+} WorkerRequest;
+
+typedef struct {
+    const char* payload; // Points into the prewarm arena
+    bool ready;
+    int8_t status;
+    QRCode qrcode;
+    uint8_t modules[UPI_QR_MODULES_SIZE(UPI_QR_MAX_VERSION)];
+} PrewarmEntry;
+
+struct UpiQrWorker {
+    FuriThread* thread;
+    UpiQrWorkerCallback callback;
+    void* context;
+    
+    uint32_t generation; // Last generation handed out, UI thread only
+    
+    TripleBuffer requests;
+    WorkerRequest request_slots[3];
+    
+    TripleBuffer results;
+    UpiQrWorkerResult result_slots[3];
+    
+    // Prewarm cache and encode stats, shared with the UI thread under the mutex
+    FuriMutex* mutex;
+    char* prewarm_payloads;
+    PrewarmEntry prewarm[UPI_QR_PREWARM_MAX];
+    uint8_t prewarm_count;
+    uint8_t prewarm_version;
+    UpiQrStatsRecord encode_stats;
+#if QR_PROFILE
+    QRProfile profile;
+    
+    // Stage timings of the encode in progress, worker thread only
+    QRProfile profile_sample;
+#endif
+    
+    // Encoder scratch, allocated once up front and handed out by the arena allocator;
+    // only the worker thread touches it
+    uint8_t* arena;
+    size_t arena_size;
+    size_t arena_used;
+    size_t arena_peak; // Since the current encode started
+    uint32_t arena_allocations; // Likewise
+    QRAllocator allocator;
+    
+    // Parity of the last fixed request's prefix, worker thread only
+    QRPrefix prefix;
+    uint8_t* prefix_cache;
+    bool prefix_ready;
+    uint16_t prefix_length;
+    char prefix_text[UPI_QR_PAYLOAD_MAX];
+    
+    // Placement of the last fixed request, so the next only flips the modules of the
+    // codewords that changed; allocated with the first fixed request
+    QRIncremental incremental;
+    uint8_t* incremental_state;
+};
+
+static void* upi_qr_worker_arena_alloc(void* context, size_t size) {
+    UpiQrWorker* worker = context;
+    if(size > worker->arena_size - worker->arena_used) return NULL;
+    
+    void* block = worker->arena + worker->arena_used;
+    worker->arena_used += size;
+    if(worker->arena_used > worker->arena_peak) worker->arena_peak = worker->arena_used;
+    worker->arena_allocations++;
+    return block;
+}
+
+// Blocks come back in reverse order, so freeing one rewinds the arena to it
+static void upi_qr_worker_arena_free(void* context, void* ptr) {
+    UpiQrWorker* worker = context;
+    worker->arena_used = (uint8_t*)ptr - worker->arena;
+}
+
+#if QR_PROFILE
+// DWT cycle counter
+static uint32_t upi_qr_worker_clock(void* context) {
+    UNUSED(context);
+    return furi_hal_cortex_timer_get(0).start;
+}
+
+static void upi_qr_worker_merge_profile(QRProfile* profile, const QRProfile* sample) {
+    profile->encodes += sample->encodes;
+    for(uint8_t i = 0; i < QR_STAGE_COUNT; i++) {
+        profile->ticks[i] += sample->ticks[i];
+    }
+    for(uint8_t i = 0; i < 8; i++) {
+        profile->maskTicks[i] += sample->maskTicks[i];
+        if(sample->encodes > 0) profile->penalty[i] = sample->penalty[i];
+    }
+}
+#endif
+
+// Encodes a fixed request as its prefix, whose parity is kept from the previous
+// request, plus the tail, which alone goes through Reed-Solomon, and places it over
+// the previous request's symbol. Returns false when the caller should encode the
+// whole payload instead.
+static bool upi_qr_worker_encode_prefixed(
+    UpiQrWorker* worker,
+    const WorkerRequest* request,
+    uint8_t version,
+    UpiQrWorkerResult* result) {
+    uint8_t* workspace = worker->allocator.alloc(
+        worker->allocator.context, qrcode_getWorkspaceSize(version, ECC_LOW));
+    if(!workspace) return false;
+    
+    uint16_t length = request->prefix_length;
+    if(!worker->prefix_ready || worker->prefix.version != version ||
+       worker->prefix_length != length || memcmp(worker->prefix_text, request->payload, length) != 0) {
+        memcpy(worker->prefix_text, request->payload, length);
+        worker->prefix_length = length;
+        worker->prefix_ready = qrcode_initPrefix(
+                                   &worker->prefix,
+                                   worker->prefix_cache,
+                                   version,
+                                   ECC_LOW,
+                                   (const uint8_t*)request->payload,
+                                   length,
+                                   workspace) == 0;
+    }
+    
+    if(!worker->incremental_state) {
+        worker->incremental_state = malloc(qrcode_getIncrementalSize(UPI_QR_MAX_VERSION));
+    }
+    if(worker->incremental.state != worker->incremental_state ||
+       worker->incremental.version != version) {
+        qrcode_initIncremental(&worker->incremental, worker->incremental_state, version, ECC_LOW);
+    }
+    
+    // Segmenting prefix and tail apart can cost a header that just tips the version
+    bool encoded = worker->prefix_ready &&
+                   qrcode_initBytesIncremental(
+                       &result->qrcode,
+                       result->modules,
+                       &worker->incremental,
+                       &worker->prefix,
+                       (const uint8_t*)request->payload + length,
+                       strlen(request->payload) - length,
+                       workspace) == 0;
+    if(encoded) result->status = 0;
+    
+    worker->allocator.free(worker->allocator.context, workspace);
+    return encoded;
+}
+
+static void upi_qr_worker_encode(
+    UpiQrWorker* worker,
+    const WorkerRequest* request,
+    UpiQrWorkerResult* result) {
+    result->generation = request->generation;
+    result->status = -1;
+    
+    if(request->version == 0 || request->version > UPI_QR_MAX_VERSION) return;
+    
+    UpiQrStatsMark mark;
+    UpiQrStatsRecord sample = {0};
+    upi_qr_stats_begin(&mark);
+    worker->arena_peak = worker->arena_used;
+    worker->arena_allocations = 0;
+    
+#if QR_PROFILE
+    memset(&worker->profile_sample, 0, sizeof(QRProfile));
+    worker->profile_sample.clock = upi_qr_worker_clock;
+    qrcode_setProfile(&worker->profile_sample);
+#endif
+    
+    // The smallest version keeps modules as large as the screen allows; a fixed
+    // request only needs the payload to fit its own
+    size_t length = strlen(request->payload);
+    uint8_t version = qrcode_getMinVersion(
+        MODE_MIXED, ECC_LOW, (const uint8_t*)request->payload, length, request->version);
+    if(request->fixed && version > 0) version = request->version;
+    
+    bool prefixed = version > 0 && request->prefix_length > 0 &&
+                    upi_qr_worker_encode_prefixed(worker, request, version, result);
+    if(version > 0 && !prefixed) {
+        result->status = qrcode_initBytesEx(
+            &result->qrcode,
+            result->modules,
+            MODE_MIXED,
+            version,
+            ECC_LOW,
+            (uint8_t*)request->payload,
+            length,
+            &worker->allocator);
+    }
+    
+    upi_qr_stats_end(&mark, &sample);
+    sample.arena_peak = worker->arena_peak;
+    sample.allocations = worker->arena_allocations;
+#if QR_PROFILE
+    qrcode_setProfile(NULL);
+#endif
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    upi_qr_stats_merge(&worker->encode_stats, &sample);
+#if QR_PROFILE
+    upi_qr_worker_merge_profile(&worker->profile, &worker->profile_sample);
+#endif
+    furi_mutex_release(worker->mutex);
+}
+
+// Files an encoded symbol under its payload, if that payload is on the prewarm list.
+// Entries are matched by the full payload, so this stays correct when the UI thread
+// replaced the list while the symbol was being encoded.
+static void upi_qr_worker_cache_store(
+    UpiQrWorker* worker,
+    const WorkerRequest* request,
+    const UpiQrWorkerResult* result) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    
+    if(!request->fixed && request->version == worker->prewarm_version) {
+        for(uint8_t i = 0; i < worker->prewarm_count; i++) {
+            PrewarmEntry* entry = &worker->prewarm[i];
+            if(entry->ready || strcmp(entry->payload, request->payload) != 0) continue;
+            
+            entry->status = result->status;
+            entry->qrcode = result->qrcode;
+            memcpy(entry->modules, result->modules, sizeof(entry->modules));
+            entry->ready = true;
+            break;
+        }
+    }
+    
+    furi_mutex_release(worker->mutex);
+}
+
+static void upi_qr_worker_serve_requests(UpiQrWorker* worker) {
+    while(triple_buffer_take(&worker->requests)) {
+        const WorkerRequest* request = &worker->request_slots[worker->requests.front];
+        UpiQrWorkerResult* result = &worker->result_slots[worker->results.back];
+        upi_qr_worker_encode(worker, request, result);
+        upi_qr_worker_cache_store(worker, request, result);
+        
+        // A newer payload arrived while encoding; this result is already stale
+        if(triple_buffer_has_fresh(&worker->requests)) continue;
+        
+        triple_buffer_publish(&worker->results);
+        if(worker->callback) worker->callback(worker->context);
+    }
+}
+
+// Encodes the first uncached prewarm payload. Returns false once the list is done.
+static bool upi_qr_worker_prewarm_step(UpiQrWorker* worker) {
+    WorkerRequest request = {0};
+    bool pending = false;
+    
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    for(uint8_t i = 0; i < worker->prewarm_count; i++) {
+        if(worker->prewarm[i].ready) continue;
+        
+        // Copy out, the UI thread may replace the list while this encodes
+        strncpy(request.payload, worker->prewarm[i].payload, UPI_QR_PAYLOAD_MAX - 1);
+        request.version = worker->prewarm_version;
+        pending = true;
+        break;
+    }
+    furi_mutex_release(worker->mutex);
+    
+    if(pending) {
+        // The back result slot is the producer's own until published, so it doubles
+        // as scratch space here
+        UpiQrWorkerResult* result = &worker->result_slots[worker->results.back];
+        upi_qr_worker_encode(worker, &request, result);
+        upi_qr_worker_cache_store(worker, &request, result);
+    }
+    
+    return pending;
+}
+
+static int32_t upi_qr_worker_thread(void* context) {
+    UpiQrWorker* worker = context;
+    
+    while(true) {
+        uint32_t flags = furi_thread_flags_wait(
+            WorkerFlagRequest | WorkerFlagExit | WorkerFlagPrewarm,
+            FuriFlagWaitAny,
+            FuriWaitForever);
+        if(flags & FuriFlagError) continue;
+        if(flags & WorkerFlagExit) break;
+        
+        furi_thread_set_current_priority(FuriThreadPriorityNormal);
+        upi_qr_worker_serve_requests(worker);
+        
+        // Idle time: fill the cache one symbol at a time, backing off to the top of
+        // the loop as soon as the UI asks for anything
+        furi_thread_set_current_priority(FuriThreadPriorityLowest);
+        while(!(furi_thread_flags_get() & (WorkerFlagRequest | WorkerFlagExit)) &&
+              upi_qr_worker_prewarm_step(worker)) {
+        }
+    }
+    
+    return 0;
+}
+
+UpiQrWorker* upi_qr_worker_alloc(UpiQrWorkerCallback callback, void* context) {
+    UpiQrWorker* worker = malloc(sizeof(UpiQrWorker));
+    memset(worker, 0, sizeof(UpiQrWorker));
+    
+    worker->callback = callback;
+    worker->context = context;
+    triple_buffer_init(&worker->requests);
+    triple_buffer_init(&worker->results);
+    worker->mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    
+    worker->arena_size = qrcode_getWorkspaceSize(UPI_QR_MAX_VERSION, ECC_LOW);
+    worker->arena = malloc(worker->arena_size);
+    worker->allocator.alloc = upi_qr_worker_arena_alloc;
+    worker->allocator.free = upi_qr_worker_arena_free;
+    worker->allocator.context = worker;
+    worker->prefix_cache = malloc(qrcode_getPrefixCacheSize(UPI_QR_MAX_VERSION, ECC_LOW));
+    
+    worker->thread =
+        furi_thread_alloc_ex("UpiQrWorker", WORKER_STACK_SIZE, upi_qr_worker_thread, worker);
+    furi_thread_start(worker->thread);
+    
+    return worker;
+}
+
+void upi_qr_worker_free(UpiQrWorker* worker) {
+    furi_thread_flags_set(furi_thread_get_id(worker->thread), WorkerFlagExit);
+    furi_thread_join(worker->thread);
+    furi_thread_free(worker->thread);
+    
+    furi_mutex_free(worker->mutex);
+    free(worker->arena);
+    free(worker->prefix_cache);
+    free(worker->incremental_state);
+    free(worker->prewarm_payloads);
+    free(worker);
+}
+
+static uint32_t upi_qr_worker_submit(
+    UpiQrWorker* worker,
+    const char* payload,
+    uint8_t version,
+    bool fixed,
+    size_t prefix_length) {
+    WorkerRequest* request = &worker->request_slots[worker->requests.back];
+    request->generation = ++worker->generation;
+    request->version = version;
+    request->fixed = fixed;
+    strncpy(request->payload, payload, UPI_QR_PAYLOAD_MAX - 1);
+    request->payload[UPI_QR_PAYLOAD_MAX - 1] = '\0';
+    size_t length = strlen(request->payload);
+    request->prefix_length = prefix_length < length ? prefix_length : length;
+    
+    triple_buffer_publish(&worker->requests);
+    furi_thread_flags_set(furi_thread_get_id(worker->thread), WorkerFlagRequest);
+    
+    return request->generation;
+}
+
+uint32_t upi_qr_worker_request(UpiQrWorker* worker, const char* payload, uint8_t version) {
+    return upi_qr_worker_submit(worker, payload, version, false, 0);
+}
+
+uint32_t upi_qr_worker_request_fixed(
+    UpiQrWorker* worker,
+    const char* payload,
+    size_t prefix_length,
+    uint8_t version) {
+    return upi_qr_worker_submit(worker, payload, version, true, prefix_length);
+}
+
+void upi_qr_worker_prewarm(UpiQrWorker* worker, char* payloads, size_t count, uint8_t version) {
+    if(count > UPI_QR_PREWARM_MAX) count = UPI_QR_PREWARM_MAX;
+    
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    
+    PrewarmEntry* previous = malloc(sizeof(worker->prewarm));
+    memcpy(previous, worker->prewarm, sizeof(worker->prewarm));
+    uint8_t previous_count = worker->prewarm_version == version ? worker->prewarm_count : 0;
+    
+    const char* payload = payloads;
+    for(uint8_t i = 0; i < count; i++) {
+        PrewarmEntry* entry = &worker->prewarm[i];
+        entry->payload = payload;
+        entry->ready = false;
+        
+        // Keep symbols that are already encoded; saving an entry reorders the list
+        // but rarely changes its payloads
+        for(uint8_t j = 0; j < previous_count; j++) {
+            if(previous[j].ready && strcmp(previous[j].payload, payload) == 0) {
+                *entry = previous[j];
+                entry->payload = payload;
+                break;
+            }
+        }
+        
+        payload += strlen(payload) + 1;
+    }
+    
+    free(worker->prewarm_payloads);
+    free(previous);
+    worker->prewarm_payloads = payloads;
+    worker->prewarm_count = count;
+    worker->prewarm_version = version;
+    
+    furi_mutex_release(worker->mutex);
+    
+    furi_thread_flags_set(furi_thread_get_id(worker->thread), WorkerFlagPrewarm);
+}
+
+bool upi_qr_worker_lookup(
+    UpiQrWorker* worker,
+    const char* payload,
+    uint8_t version,
+    UpiQrWorkerResult* result) {
+    bool found = false;
+    
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    
+    if(version == worker->prewarm_version) {
+        for(uint8_t i = 0; i < worker->prewarm_count; i++) {
+            PrewarmEntry* entry = &worker->prewarm[i];
+            if(!entry->ready || strcmp(entry->payload, payload) != 0) continue;
+            
+            result->status = entry->status;
+            result->qrcode = entry->qrcode;
+            memcpy(result->modules, entry->modules, sizeof(result->modules));
+            found = true;
+            break;
+        }
+    }
+    
+    furi_mutex_release(worker->mutex);
+    
+    if(found) {
+        result->generation = ++worker->generation;
+        result->qrcode.modules = result->modules;
+    }
+    
+    return found;
+}
+
+void upi_qr_worker_get_stats(UpiQrWorker* worker, UpiQrStatsRecord* stats) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    *stats = worker->encode_stats;
+    furi_mutex_release(worker->mutex);
+}
+
+#if QR_PROFILE
+void upi_qr_worker_get_profile(UpiQrWorker* worker, QRProfile* profile) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    *profile = worker->profile;
+    furi_mutex_release(worker->mutex);
+}
+#endif
+
+bool upi_qr_worker_take_result(UpiQrWorker* worker, UpiQrWorkerResult* result) {
+    if(!triple_buffer_take(&worker->results)) return false;
+    
+    *result = worker->result_slots[worker->results.front];
+    result->qrcode.modules = result->modules;
+    
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <furi.h>
+#include "qrcode.h"
+#include "upi_qr_stats.h"
+
+#define UPI_QR_PAYLOAD_MAX 256
+#define UPI_QR_MAX_VERSION 6
+#define UPI_QR_MODULES_SIZE(version) ((((4 * (version) + 17) * (4 * (version) + 17)) + 7) / 8)
+#define UPI_QR_PREWARM_MAX 8
+
+typedef struct UpiQrWorker UpiQrWorker;
+
+typedef struct {
+    uint32_t generation;
+    int8_t status; // qrcode_initBytes result, or -1 when the payload does not fit
+    QRCode qrcode;
+    uint8_t modules[UPI_QR_MODULES_SIZE(UPI_QR_MAX_VERSION)];
+} UpiQrWorkerResult;
+
+// Called on the worker thread whenever a fresh result has been published
+typedef void (*UpiQrWorkerCallback)(void* context);
+
+UpiQrWorker* upi_qr_worker_alloc(UpiQrWorkerCallback callback, void* context);
+
+void upi_qr_worker_free(UpiQrWorker* worker);
+
+// Queues a payload for encoding and returns its generation. Never blocks: a request
+// that has not been picked up yet is simply replaced by the newer one. Payloads are
+// split into numeric, alphanumeric and byte segments and encoded at the smallest
+// version that fits, up to `version`.
+uint32_t upi_qr_worker_request(UpiQrWorker* worker, const char* payload, uint8_t version);
+
+// As upi_qr_worker_request, but encodes at exactly `version`, so successive payloads
+// of one screen keep the same symbol size. Fails when the payload does not fit it.
+// The first `prefix_length` bytes are expected to repeat from request to request: the
+// worker keeps their Reed-Solomon parity and only divides the rest of the payload.
+uint32_t upi_qr_worker_request_fixed(
+    UpiQrWorker* worker,
+    const char* payload,
+    size_t prefix_length,
+    uint8_t version);
+
+// Replaces the idle-time prewarm list. `payloads` holds `count` NUL-terminated strings
+// back to back, most recently used first, and is owned by the worker from here on.
+// Symbols already cached for a payload that is still listed are kept. Between requests
+// the worker encodes the list at low priority, one symbol at a time, so a request
+// never waits for more than a single prewarm encode.
+void upi_qr_worker_prewarm(UpiQrWorker* worker, char* payloads, size_t count, uint8_t version);
+
+// Copies out a prewarmed symbol for the payload, if there is one, under a fresh
+// generation so any encode still in flight is treated as stale.
+bool upi_qr_worker_lookup(
+    UpiQrWorker* worker,
+    const char* payload,
+    uint8_t version,
+    UpiQrWorkerResult* result);
+
+// Copies out the stack/heap high-water marks of every encode so far
+void upi_qr_worker_get_stats(UpiQrWorker* worker, UpiQrStatsRecord* stats);
+
+#if QR_PROFILE
+// Copies out the stage timings of every encode so far, in cycles, and the mask
+// penalties of the latest one
+void upi_qr_worker_get_profile(UpiQrWorker* worker, QRProfile* profile);
+#endif
+
+// Copies out the latest published result. Returns false when nothing new arrived
+// since the previous call.
+bool upi_qr_worker_take_result(UpiQrWorker* worker, UpiQrWorkerResult* result);